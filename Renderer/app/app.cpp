@@ -1,5 +1,7 @@
 #include "app.h"
+#include <stdio.h>
 #include "../core/renderer.h"
+#include "../core/profiler.h"
 
 
 Window* App::window_;
@@ -30,6 +32,8 @@ void App::Init() const
 	if (renderer_) {
 		
 	}
+	//cheap enough to keep on, space prints the report
+	profiler_enable(true);
 }
 
 void App::Start() const
@@ -42,16 +46,20 @@ void App::Start() const
 
 void App::Update()
 {
+	profiler_begin_frame();
+
 	//run user renderer
 	if (renderer_) {
 		renderer_->Render();
 	}
 
 	//display rendering result on screen
-	window_->Display(renderer_->framebuffer());
+	window_->Display(renderer_->framebuffer(), renderer_->thread_pool());
 
 	//poll events
 	window_->PollEvents();
+
+	profiler_end_frame();
 }
 
 void App::set_renderer(Renderer* renderer)
@@ -61,6 +69,8 @@ void App::set_renderer(Renderer* renderer)
 
 void App::KeyCallback(Window *window, KeyCode key, bool pressed)
 {
+	if (key == KEY_SPACE && pressed)
+		profiler_print_report(stdout);
 	renderer_->KeyEventResponse(key, pressed);
 }
 
@@ -69,6 +79,15 @@ void App::ButtonCallback(Window *window, Button button, bool pressed)
 	float pos_x, pos_y;
 	window->CursorPos(pos_x, pos_y);
 	printf("cursor x: %f, y: %f\n", pos_x, pos_y);
+	if (pressed && renderer_->render_target()) {
+		//window rows count down from the top, framebuffer rows up from the bottom
+		float distance;
+		int picked = renderer_->PickModel((int)pos_x, window->height() - 1 - (int)pos_y, &distance);
+		if (picked >= 0)
+			printf("picked model %d at distance %f\n", picked, distance);
+		else
+			printf("picked nothing\n");
+	}
 
 	renderer_->ButtonEventResponse(button, pressed);
 }
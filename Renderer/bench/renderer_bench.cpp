@@ -0,0 +1,801 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include "core/image.h"
+#include "core/renderer.h"
+#include "core/matrix.h"
+#include "core/blit.h"
+#include "core/resample.h"
+#include "core/color.h"
+#include "core/simd.h"
+#include "core/mesh.h"
+#include "core/mesh_optimizer.h"
+#include "core/scene.h"
+#include "core/model.h"
+#include "core/pipeline.h"
+#include "core/shader.h"
+
+/*
+*  regression benchmarks of the core routines, in the manner of google benchmark: every case
+*  runs a calibrated number of iterations per repetition and reports the median and the best
+*  repetition; inputs come from fixed seeds, so numbers are comparable between builds
+*  usage: renderer_bench [--filter=substring] [--min_time=seconds] [--repetitions=n] [--format=console|csv|json]
+*/
+
+using std::vector;
+using std::string;
+
+typedef std::chrono::steady_clock Clock;
+
+//iteration driver handed to every case, only the time between KeepRunning calls is measured
+class BenchState
+{
+public:
+	BenchState(long long iterations, int arg)
+		: iterations_(iterations), remaining_(iterations), arg_(arg), items_(0), bytes_(0), elapsed_(0), running_(false) {}
+
+	bool KeepRunning()
+	{
+		if (remaining_ == iterations_ && !running_)
+			ResumeTiming();
+		if (remaining_-- > 0)
+			return true;
+		PauseTiming();
+		return false;
+	}
+	//exclude per-iteration setup from the measurement
+	void PauseTiming()
+	{
+		if (running_)
+			elapsed_ += std::chrono::duration<double>(Clock::now() - start_).count();
+		running_ = false;
+	}
+	void ResumeTiming()
+	{
+		start_ = Clock::now();
+		running_ = true;
+	}
+
+	int arg() const { return arg_; }
+	long long iterations() const { return iterations_; }
+	double seconds() const { return elapsed_; }
+	//totals over all iterations
+	void SetItemsProcessed(long long items) { items_ = items; }
+	void SetBytesProcessed(long long bytes) { bytes_ = bytes; }
+	long long items() const { return items_; }
+	long long bytes() const { return bytes_; }
+
+private:
+	long long iterations_;
+	long long remaining_;
+	int arg_;
+	long long items_;
+	long long bytes_;
+	double elapsed_;
+	bool running_;
+	Clock::time_point start_;
+};
+
+typedef void(*BenchFunc)(BenchState& state);
+
+struct Benchmark
+{
+	string name;
+	BenchFunc func;
+	int arg;
+};
+
+/*
+*  inputs
+*/
+//fixed-seed generator, the same sequence on every platform
+class Random
+{
+public:
+	explicit Random(unsigned seed) : state_(seed) {}
+	unsigned Next() { state_ = state_ * 1664525u + 1013904223u; return state_ >> 8; }
+	int Range(int lo, int hi) { return lo + (int)(Next() % (unsigned)(hi - lo + 1)); }
+	float Unit() { return (Next() & 0xFFFF) / 65535.0f; }
+
+private:
+	unsigned state_;
+};
+
+//smooth gradients with noise on top, so that compressed formats see realistic runs
+static Image MakeImage(int width, int height, int channels, unsigned seed)
+{
+	Image image(width, height, channels);
+	Random random(seed);
+	for (int y = 0; y < height; y++) {
+		Byte *row = image.view().row(y);
+		for (int x = 0; x < width * channels; x++) {
+			int value = (x / channels * 255 / width + y * 255 / height) / 2;
+			if (random.Next() % 4 == 0)
+				value += random.Range(-16, 16);
+			row[x] = (Byte)std::min(std::max(value, 0), 255);
+		}
+	}
+	return image;
+}
+
+static void FillFrame(FrameBuffer *frame, unsigned seed)
+{
+	Random random(seed);
+	for (int y = 0; y < frame->height(); y++) {
+		if (frame->format() == FORMAT_RGBA32F) {
+			float *row = (float*)frame->row(y);
+			for (int x = 0; x < frame->width() * 4; x++)
+				row[x] = random.Unit() * 1.2f - 0.1f;
+		}
+		else {
+			Byte *row = frame->row(y);
+			for (int x = 0; x < frame->width() * 4; x++)
+				row[x] = (Byte)random.Next();
+		}
+	}
+}
+
+static const int TARGET_SIZE = 1024;
+
+/*
+*  rasterization
+*/
+//arg: line length in pixels
+static void BM_DrawLine(BenchState& state)
+{
+	Renderer renderer(TARGET_SIZE, TARGET_SIZE, FORMAT_BGRA8, 1, DEPTH_NONE);
+	Random random(1);
+	const int count = 1024;
+	vector<int> coords(count * 4);
+	long long pixels = 0;
+	for (int i = 0; i < count; i++) {
+		int x0 = random.Range(0, TARGET_SIZE - 1), y0 = random.Range(0, TARGET_SIZE - 1);
+		float angle = random.Unit() * 6.2831853f;
+		int x1 = std::min(std::max(x0 + (int)(cosf(angle) * state.arg()), 0), TARGET_SIZE - 1);
+		int y1 = std::min(std::max(y0 + (int)(sinf(angle) * state.arg()), 0), TARGET_SIZE - 1);
+		coords[i * 4 + 0] = x0; coords[i * 4 + 1] = y0; coords[i * 4 + 2] = x1; coords[i * 4 + 3] = y1;
+		pixels += std::max(abs(x1 - x0), abs(y1 - y0)) + 1;
+	}
+	while (state.KeepRunning()) {
+		for (int i = 0; i < count; i++)
+			renderer.DrawLine(coords[i * 4 + 0], coords[i * 4 + 1], coords[i * 4 + 2], coords[i * 4 + 3], Color::White);
+	}
+	state.SetItemsProcessed(pixels * state.iterations());
+}
+
+//arg: antialias, one batch of lines of up to 64 pixels, a quarter of them partly off screen
+static void BM_DrawLines(BenchState& state)
+{
+	Renderer renderer(TARGET_SIZE, TARGET_SIZE, FORMAT_BGRA8, 1, DEPTH_NONE);
+	Random random(14);
+	const int count = 16384;
+	vector<LineSegment> lines(count);
+	for (int i = 0; i < count; i++) {
+		LineSegment& line = lines[i];
+		line.x0 = random.Unit() * (TARGET_SIZE + 64) - 32;
+		line.y0 = random.Unit() * (TARGET_SIZE + 64) - 32;
+		line.x1 = line.x0 + random.Unit() * 128 - 64;
+		line.y1 = line.y0 + random.Unit() * 128 - 64;
+	}
+	while (state.KeepRunning())
+		renderer.DrawLines(&lines[0], count, Color::White, state.arg() != 0);
+	state.SetItemsProcessed((long long)count * state.iterations());
+}
+
+//arg: triangle size in pixels (legs of a right triangle), items are covered pixels
+static void TriangleFill(BenchState& state, bool flat)
+{
+	Renderer renderer(TARGET_SIZE, TARGET_SIZE, FORMAT_BGRA8, 1, DEPTH_NONE);
+	Random random(2);
+	const int count = 256;
+	int size = std::min(state.arg(), TARGET_SIZE);
+	vector<Vector3f> vertices(count * 3);
+	for (int i = 0; i < count; i++) {
+		float x = (float)random.Range(0, TARGET_SIZE - size), y = (float)random.Range(0, TARGET_SIZE - size);
+		vertices[i * 3 + 0] = Vector3f(x, y, 0.5f);
+		vertices[i * 3 + 1] = Vector3f(x + size, y, 0.5f);
+		vertices[i * 3 + 2] = Vector3f(x, y + size, 0.5f);
+	}
+	while (state.KeepRunning()) {
+		for (int i = 0; i < count; i++) {
+			if (flat)
+				renderer.DrawTriangle(vertices[i * 3], vertices[i * 3 + 1], vertices[i * 3 + 2], Color::White);
+			else
+				renderer.DrawTriangle(vertices[i * 3], vertices[i * 3 + 1], vertices[i * 3 + 2], Color::Red, Color::Cyan, Color::White);
+		}
+		renderer.Flush();
+	}
+	state.SetItemsProcessed((long long)count * size * size / 2 * state.iterations());
+}
+
+static void BM_TriangleFlat(BenchState& state) { TriangleFill(state, true); }
+static void BM_TriangleGradient(BenchState& state) { TriangleFill(state, false); }
+
+/*
+*  meshes
+*/
+//grid of quads over normalized device coordinates, faces and vertices in random order
+static void MakeShuffledGrid(int quads, Mesh *mesh)
+{
+	mesh->Clear();
+	for (int y = 0; y <= quads; y++) {
+		for (int x = 0; x <= quads; x++) {
+			Vertex vertex;
+			vertex.position_ = Point3d(x * 2.0f / quads - 1, y * 2.0f / quads - 1, 0.5f);
+			vertex.normal_ = Vector3f(0, 0, 1);
+			mesh->AddVertex(vertex);
+		}
+	}
+	for (int y = 0; y < quads; y++) {
+		for (int x = 0; x < quads; x++) {
+			int i = y * (quads + 1) + x;
+			mesh->AddFace(i, i + 1, i + quads + 2);
+			mesh->AddFace(i, i + quads + 2, i + quads + 1);
+		}
+	}
+	Random random(20);
+	vector<int> face_order(mesh->face_num()), vertex_remap(mesh->vertex_num());
+	for (size_t i = 0; i < face_order.size(); i++)
+		face_order[i] = (int)i;
+	for (size_t i = 0; i < vertex_remap.size(); i++)
+		vertex_remap[i] = (int)i;
+	for (size_t i = face_order.size() - 1; i > 0; i--)
+		std::swap(face_order[i], face_order[random.Next() % (i + 1)]);
+	for (size_t i = vertex_remap.size() - 1; i > 0; i--)
+		std::swap(vertex_remap[i], vertex_remap[random.Next() % (i + 1)]);
+	mesh->Reorder(face_order, vertex_remap);
+}
+
+//arg: optimized vertex order, items are triangles
+static void BM_DrawMesh(BenchState& state)
+{
+	Renderer renderer(TARGET_SIZE, TARGET_SIZE, FORMAT_BGRA8, 1, DEPTH_NONE);
+	Mesh mesh;
+	MakeShuffledGrid(512, &mesh);
+	if (state.arg() != 0)
+		optimize_vertex_cache(&mesh);
+	while (state.KeepRunning()) {
+		renderer.DrawMesh(mesh, Matrix4::Identity(), Color::White);
+		renderer.Flush();
+	}
+	state.SetItemsProcessed((long long)mesh.face_num() * state.iterations());
+}
+
+//the optimized grid of BM_DrawMesh through a ShaderPipeline, items are triangles
+template <typename Shader>
+static void ShadeMesh(BenchState& state, const Shader& shader)
+{
+	Renderer renderer(TARGET_SIZE, TARGET_SIZE, FORMAT_BGRA8, 1, DEPTH_NONE);
+	ShaderPipeline<Shader> pipeline(&renderer);
+	Mesh mesh;
+	MakeShuffledGrid(512, &mesh);
+	optimize_vertex_cache(&mesh);
+	while (state.KeepRunning())
+		pipeline.DrawMesh(mesh, shader);
+	state.SetItemsProcessed((long long)mesh.face_num() * state.iterations());
+}
+
+static void BM_ShadeMeshNormal(BenchState& state)
+{
+	ShadeMesh(state, NormalShader());
+}
+
+static void BM_ShadeMeshBlinnPhong(BenchState& state)
+{
+	BlinnPhongShader shader;
+	PointLight light = { Vector3f(1, 1, -2), { 1.0f, 1.0f, 1.0f }, std::numeric_limits<float>::infinity() };
+	shader.eye = Vector3f(0, 0, -2);
+	shader.lights = &light;
+	shader.light_num = 1;
+	ShadeMesh(state, shader);
+}
+
+static void BM_OptimizeVertexCache(BenchState& state)
+{
+	Mesh mesh;
+	while (state.KeepRunning()) {
+		state.PauseTiming();
+		MakeShuffledGrid(256, &mesh);
+		state.ResumeTiming();
+		optimize_vertex_cache(&mesh);
+	}
+	state.SetItemsProcessed((long long)mesh.face_num() * state.iterations());
+}
+
+//arg models of a unit cube scattered over [-100, 100]^3
+static void MakeCubeScene(int models, Mesh* cube, Scene* scene)
+{
+	Vertex corner;
+	for (int i = 0; i < 8; i++) {
+		corner.position_ = Point3d(i & 1 ? 1 : -1, i & 2 ? 1 : -1, i & 4 ? 1 : -1);
+		cube->AddVertex(corner);
+	}
+	const int faces[12][3] = { { 0, 2, 3 }, { 0, 3, 1 }, { 4, 5, 7 }, { 4, 7, 6 }, { 0, 1, 5 }, { 0, 5, 4 },
+		{ 2, 6, 7 }, { 2, 7, 3 }, { 0, 4, 6 }, { 0, 6, 2 }, { 1, 3, 7 }, { 1, 7, 5 } };
+	for (int i = 0; i < 12; i++)
+		cube->AddFace(faces[i][0], faces[i][1], faces[i][2]);
+	Random random(22);
+	for (int i = 0; i < models; i++) {
+		Matrix4 transform = Matrix4::TranslateMatrix(random.Unit() * 200 - 100, random.Unit() * 200 - 100, random.Unit() * 200 - 100);
+		scene->AddModel(new Model(cube, transform, Color::White));
+	}
+}
+
+//arg: models, culled through the bvh above SCENE_BVH_MIN_MODELS
+static void BM_SceneCull(BenchState& state)
+{
+	Mesh cube;
+	Scene scene;
+	MakeCubeScene(state.arg(), &cube, &scene);
+	Matrix4 view_projection = Matrix4::PerspectiveMatrix(1.0f, 1.0f, 0.5f, 100.0f) *
+		Matrix4::LookAtMatrix(Vector3f(0, 0, 0), Vector3f(1, 0, -1), Vector3f(0, 1, 0));
+	vector<int> visible;
+	vector<Byte> flags;
+	scene.Cull(view_projection, &visible, &flags);
+	while (state.KeepRunning())
+		scene.Cull(view_projection, &visible, &flags);
+	state.SetItemsProcessed((long long)state.arg() * state.iterations());
+}
+
+//arg: models, an eighth of them nudged before every refit of the bvh
+static void BM_SceneRefit(BenchState& state)
+{
+	Mesh cube;
+	Scene scene;
+	MakeCubeScene(state.arg(), &cube, &scene);
+	scene.hierarchy();
+	Random random(7);
+	while (state.KeepRunning()) {
+		state.PauseTiming();
+		for (int i = 0; i < scene.model_num(); i += 8) {
+			Matrix4 nudge = Matrix4::TranslateMatrix(random.Unit() - 0.5f, random.Unit() - 0.5f, random.Unit() - 0.5f);
+			scene.SetTransform(i, nudge * scene.model(i)->transform());
+		}
+		state.ResumeTiming();
+		scene.hierarchy();
+	}
+	state.SetItemsProcessed((long long)state.arg() * state.iterations());
+}
+
+//arg: models, 256 rays from the origin per iteration
+static void BM_ScenePick(BenchState& state)
+{
+	Mesh cube;
+	Scene scene;
+	MakeCubeScene(state.arg(), &cube, &scene);
+	scene.hierarchy();
+	Random random(9);
+	vector<Vector3f> directions(256);
+	for (Vector3f& direction : directions)
+		direction = Vector3f(random.Unit() * 2 - 1, random.Unit() * 2 - 1, random.Unit() * 2 - 1);
+	float distance;
+	while (state.KeepRunning()) {
+		for (const Vector3f& direction : directions)
+			scene.Pick(Vector3f(0, 0, 0), direction, &distance);
+	}
+	state.SetItemsProcessed((long long)directions.size() * state.iterations());
+}
+
+/*
+*  a 6 x 6 grid of spheres in 4 layers, farthest layer first so that nearer ones overdraw it, with
+*  lights of radius 4 scattered through the grid; returns the view projection that looks at it
+*/
+static Matrix4 MakeSphereScene(int lights, Mesh* sphere, Scene* scene)
+{
+	const int stacks = 16, slices = 32;
+	for (int i = 0; i <= stacks; i++) {
+		float theta = 3.14159265f * i / stacks;
+		for (int j = 0; j <= slices; j++) {
+			float phi = 2 * 3.14159265f * j / slices;
+			Vertex vertex;
+			vertex.normal_ = Vector3f(sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi));
+			vertex.position_ = Point3d(vertex.normal_.x, vertex.normal_.y, vertex.normal_.z);
+			sphere->AddVertex(vertex);
+		}
+	}
+	for (int i = 0; i < stacks; i++) {
+		for (int j = 0; j < slices; j++) {
+			int a = i * (slices + 1) + j, b = a + slices + 1;
+			sphere->AddFace(a, a + 1, b);
+			sphere->AddFace(a + 1, b + 1, b);
+		}
+	}
+	optimize_vertex_cache(sphere);
+	Random random(25);
+	for (int z = 3; z >= 0; z--) {
+		for (int i = 0; i < 36; i++) {
+			Matrix4 transform = Matrix4::TranslateMatrix((i % 6) * 2.5f - 6.25f + z * 0.6f, (i / 6) * 2.5f - 6.25f + z * 0.6f, -z * 2.5f);
+			scene->AddModel(new Model(sphere, transform, Color(random.Unit(), random.Unit(), random.Unit(), 1.0f)));
+		}
+	}
+	for (int i = 0; i < lights; i++) {
+		PointLight light = { Vector3f(random.Unit() * 16 - 8, random.Unit() * 16 - 8, 1.5f - random.Unit() * 10),
+			{ random.Unit(), random.Unit(), random.Unit() }, 4.0f };
+		scene->AddLight(light);
+	}
+	return Matrix4::PerspectiveMatrix(1.0f, 1.0f, 1.0f, 40.0f) *
+		Matrix4::LookAtMatrix(Vector3f(0, 0, 14), Vector3f(0, 0, -4), Vector3f(0, 1, 0));
+}
+
+//arg: lights, items are pixels of the frame
+static void SceneShade(BenchState& state, ShadingMode mode)
+{
+	Renderer renderer(TARGET_SIZE, TARGET_SIZE, FORMAT_BGRA8, 1, DEPTH_FLOAT32);
+	renderer.set_shading_mode(mode);
+	Mesh sphere;
+	Scene scene;
+	Matrix4 view_projection = MakeSphereScene(state.arg(), &sphere, &scene);
+	while (state.KeepRunning()) {
+		renderer.framebuffer()->Clear(Color::Black);
+		renderer.framebuffer()->ClearDepth();
+		renderer.DrawScene(scene, view_projection);
+	}
+	state.SetItemsProcessed((long long)TARGET_SIZE * TARGET_SIZE * state.iterations());
+}
+
+static void BM_SceneShadeForward(BenchState& state) { SceneShade(state, SHADING_FORWARD); }
+static void BM_SceneShadeDeferred(BenchState& state) { SceneShade(state, SHADING_DEFERRED); }
+
+/*
+*  image operations
+*/
+//arg: ResampleFilter, 1024 x 1024 rgba down to 512 x 512
+static void BM_ResizeDown(BenchState& state)
+{
+	Image source = MakeImage(1024, 1024, 4, 3);
+	while (state.KeepRunning()) {
+		state.PauseTiming();
+		Image image = source;
+		state.ResumeTiming();
+		image.Resize(512, 512, (ResampleFilter)state.arg());
+	}
+	state.SetBytesProcessed((long long)source.data_size() * state.iterations());
+}
+
+//arg: ResampleFilter, 512 x 512 rgba up to 1024 x 1024
+static void BM_ResizeUp(BenchState& state)
+{
+	Image source = MakeImage(512, 512, 4, 4);
+	while (state.KeepRunning()) {
+		state.PauseTiming();
+		Image image = source;
+		state.ResumeTiming();
+		image.Resize(1024, 1024, (ResampleFilter)state.arg());
+	}
+	state.SetBytesProcessed(1024LL * 1024 * 4 * state.iterations());
+}
+
+//arg: channels
+static void BM_FlipHorizontal(BenchState& state)
+{
+	Image image = MakeImage(2048, 2048, state.arg(), 5);
+	while (state.KeepRunning())
+		image.FlipHorizontal();
+	state.SetBytesProcessed((long long)image.data_size() * state.iterations());
+}
+
+static void BM_FlipVertical(BenchState& state)
+{
+	Image image = MakeImage(2048, 2048, state.arg(), 6);
+	while (state.KeepRunning())
+		image.FlipVertical();
+	state.SetBytesProcessed((long long)image.data_size() * state.iterations());
+}
+
+static const char *BENCH_TGA = "renderer_bench.tga";
+
+static void BM_SaveTGA(BenchState& state)
+{
+	Image image = MakeImage(1024, 1024, state.arg(), 7);
+	while (state.KeepRunning())
+		image.SaveAsFile(BENCH_TGA);
+	state.SetBytesProcessed((long long)image.data_size() * state.iterations());
+	remove(BENCH_TGA);
+}
+
+static void BM_LoadTGA(BenchState& state)
+{
+	Image image = MakeImage(1024, 1024, state.arg(), 8);
+	image.SaveAsFile(BENCH_TGA);
+	while (state.KeepRunning()) {
+		Image loaded;
+		loaded.LoadFromFile(BENCH_TGA);
+	}
+	state.SetBytesProcessed((long long)image.data_size() * state.iterations());
+	remove(BENCH_TGA);
+}
+
+/*
+*  math
+*/
+static Matrix4 MakeMatrix(Random& random)
+{
+	Matrix4 rotate = Matrix4::RotateMatrix(Vector3f(random.Unit(), random.Unit(), 1.0f), random.Unit() * 3.0f);
+	return Matrix4::TranslateMatrix(random.Unit(), random.Unit(), random.Unit()) * rotate * Matrix4::ScaleMatrix(2.0f, 1.5f, 0.5f);
+}
+
+static void BM_MatrixMultiply(BenchState& state)
+{
+	Random random(9);
+	const int count = 256;
+	vector<Matrix4> matrices(count);
+	for (int i = 0; i < count; i++)
+		matrices[i] = MakeMatrix(random);
+	vector<Matrix4> products(count);
+	while (state.KeepRunning()) {
+		for (int i = 0; i < count; i++)
+			products[i] = matrices[i] * matrices[(i + 1) % count];
+	}
+	state.SetItemsProcessed((long long)count * state.iterations());
+}
+
+static void BM_MatrixInverse(BenchState& state)
+{
+	Random random(10);
+	const int count = 256;
+	vector<Matrix4> matrices(count);
+	for (int i = 0; i < count; i++)
+		matrices[i] = MakeMatrix(random);
+	while (state.KeepRunning()) {
+		for (int i = 0; i < count; i++)
+			matrices[i].Inverse();
+	}
+	state.SetItemsProcessed((long long)count * state.iterations());
+}
+
+static void BM_MatrixTransform(BenchState& state)
+{
+	Random random(11);
+	const int count = 4096;
+	Matrix4 matrix = MakeMatrix(random);
+	vector<Vector4f> src(count), dst(count);
+	for (int i = 0; i < count; i++)
+		src[i] = Vector4f(random.Unit(), random.Unit(), random.Unit(), 1.0f);
+	while (state.KeepRunning())
+		matrix.Transform(&src[0], &dst[0], count);
+	state.SetItemsProcessed((long long)count * state.iterations());
+}
+
+/*
+*  display conversion
+*/
+//arg: PixelFormat, 1920 x 1080 frame into a window buffer
+static void BM_BlitFrame(BenchState& state)
+{
+	FrameBuffer frame(1920, 1080, (PixelFormat)state.arg());
+	FillFrame(&frame, 12);
+	vector<Byte> buffer((size_t)1920 * 1080 * 4);
+	while (state.KeepRunning())
+		blit_frame_bgr(&frame, 1920, 1080, &buffer[0]);
+	state.SetItemsProcessed(1920LL * 1080 * state.iterations());
+}
+
+//arg: channels
+static void BM_BlitImage(BenchState& state)
+{
+	Image image = MakeImage(1920, 1080, state.arg(), 13);
+	vector<Byte> buffer((size_t)1920 * 1080 * 4);
+	while (state.KeepRunning())
+		blit_image_bgr(image.view(), 1920, 1080, &buffer[0]);
+	state.SetItemsProcessed(1920LL * 1080 * state.iterations());
+}
+
+static vector<Benchmark> RegisterBenchmarks()
+{
+	vector<Benchmark> benchmarks;
+	char name[64];
+	auto add = [&](const char *base, const char *arg_name, BenchFunc func, int arg) {
+		snprintf(name, sizeof(name), arg_name ? "%s/%s" : "%s", base, arg_name);
+		benchmarks.push_back({ name, func, arg });
+	};
+	char number[16];
+	const int lengths[] = { 16, 256 };
+	for (int length : lengths) {
+		snprintf(number, sizeof(number), "%d", length);
+		add("draw_line", number, BM_DrawLine, length);
+	}
+	add("draw_lines", "aliased", BM_DrawLines, 0);
+	add("draw_lines", "antialiased", BM_DrawLines, 1);
+	const int sizes[] = { 8, 32, 128, 512 };
+	for (int size : sizes) {
+		snprintf(number, sizeof(number), "%d", size);
+		add("triangle_flat", number, BM_TriangleFlat, size);
+		add("triangle_gradient", number, BM_TriangleGradient, size);
+	}
+	add("draw_mesh", "shuffled", BM_DrawMesh, 0);
+	add("draw_mesh", "optimized", BM_DrawMesh, 1);
+	add("shade_mesh", "normal", BM_ShadeMeshNormal, 0);
+	add("shade_mesh", "blinn_phong", BM_ShadeMeshBlinnPhong, 0);
+	add("optimize_vertex_cache", NULL, BM_OptimizeVertexCache, 0);
+	const int model_counts[] = { 1000, 100000 };
+	for (int models : model_counts) {
+		snprintf(number, sizeof(number), "%d", models);
+		add("scene_cull", number, BM_SceneCull, models);
+		add("scene_refit", number, BM_SceneRefit, models);
+		add("scene_pick", number, BM_ScenePick, models);
+	}
+	const int light_counts[] = { 1, 32, 256 };
+	for (int lights : light_counts) {
+		snprintf(number, sizeof(number), "%d", lights);
+		add("scene_shade_forward", number, BM_SceneShadeForward, lights);
+		add("scene_shade_deferred", number, BM_SceneShadeDeferred, lights);
+	}
+	for (int filter = 0; filter < FILTER_NUM; filter++)
+		add("resize_down", resample_filter_name((ResampleFilter)filter), BM_ResizeDown, filter);
+	for (int filter = 0; filter < FILTER_NUM; filter++)
+		add("resize_up", resample_filter_name((ResampleFilter)filter), BM_ResizeUp, filter);
+
+	//image cases per channel count
+	struct { const char *name; BenchFunc func; } image_cases[] = {
+		{ "flip_horizontal", BM_FlipHorizontal }, { "flip_vertical", BM_FlipVertical },
+		{ "tga_save", BM_SaveTGA }, { "tga_load", BM_LoadTGA }, { "blit_image", BM_BlitImage },
+	};
+	const int channels[] = { 1, 3, 4 };
+	for (const auto& image_case : image_cases) {
+		for (int c : channels) {
+			snprintf(number, sizeof(number), "%d", c);
+			add(image_case.name, number, image_case.func, c);
+		}
+	}
+
+	add("matrix_multiply", NULL, BM_MatrixMultiply, 0);
+	add("matrix_inverse", NULL, BM_MatrixInverse, 0);
+	add("matrix_transform", NULL, BM_MatrixTransform, 0);
+	const char *formats[] = { "rgba8", "bgra8", "rgba32f" };
+	for (int format = 0; format < FORMAT_NUM; format++)
+		add("blit_frame", formats[format], BM_BlitFrame, format);
+	return benchmarks;
+}
+
+/*
+*  runner
+*/
+struct BenchResult
+{
+	string name;
+	long long iterations;
+	double median_ns;	//per iteration
+	double min_ns;
+	double items_per_second;	//of the median repetition, 0 when not reported
+	double bytes_per_second;
+};
+
+static BenchState RunOnce(const Benchmark& benchmark, long long iterations)
+{
+	BenchState state(iterations, benchmark.arg);
+	benchmark.func(state);
+	return state;
+}
+
+static BenchResult Run(const Benchmark& benchmark, double min_time, int repetitions)
+{
+	//grow the iteration count until one repetition takes min_time
+	long long iterations = 1;
+	while (true) {
+		BenchState state = RunOnce(benchmark, iterations);
+		if (state.seconds() >= min_time || iterations >= (1LL << 30))
+			break;
+		double scale = state.seconds() > 0 ? min_time * 1.4 / state.seconds() : 10.0;
+		iterations = std::max(iterations + 1, (long long)(iterations * std::min(std::max(scale, 1.5), 10.0)));
+	}
+
+	vector<BenchState> runs;
+	for (int r = 0; r < repetitions; r++)
+		runs.push_back(RunOnce(benchmark, iterations));
+	std::sort(runs.begin(), runs.end(), [](const BenchState& a, const BenchState& b) { return a.seconds() < b.seconds(); });
+	const BenchState& median = runs[runs.size() / 2];
+
+	BenchResult result;
+	result.name = benchmark.name;
+	result.iterations = iterations;
+	result.median_ns = median.seconds() * 1e9 / iterations;
+	result.min_ns = runs[0].seconds() * 1e9 / iterations;
+	result.items_per_second = median.items() / median.seconds();
+	result.bytes_per_second = median.bytes() / median.seconds();
+	return result;
+}
+
+typedef enum { OUTPUT_CONSOLE = 0, OUTPUT_CSV, OUTPUT_JSON } OutputFormat;
+
+static void PrintHeader(OutputFormat format, double min_time, int repetitions)
+{
+	const char *simd = simd_level_name(simd_level());
+	switch (format) {
+	case OUTPUT_CSV:
+		printf("name,iterations,median_ns,min_ns,items_per_second,bytes_per_second\n");
+		break;
+	case OUTPUT_JSON:
+		printf("{\n  \"context\": {\"simd\": \"%s\", \"min_time\": %g, \"repetitions\": %d},\n  \"benchmarks\": [", simd, min_time, repetitions);
+		break;
+	default:
+		printf("simd %s, %d repetitions of at least %g s\n", simd, repetitions, min_time);
+		printf("%-28s %12s %14s %14s %14s\n", "benchmark", "iterations", "median ns", "min ns", "throughput");
+		break;
+	}
+}
+
+static void PrintResult(OutputFormat format, const BenchResult& result, bool first)
+{
+	switch (format) {
+	case OUTPUT_CSV:
+		printf("%s,%lld,%.1f,%.1f,%.6g,%.6g\n", result.name.c_str(), result.iterations, result.median_ns, result.min_ns,
+			result.items_per_second, result.bytes_per_second);
+		break;
+	case OUTPUT_JSON:
+		printf("%s\n    {\"name\": \"%s\", \"iterations\": %lld, \"median_ns\": %.1f, \"min_ns\": %.1f, \"items_per_second\": %.6g, \"bytes_per_second\": %.6g}",
+			first ? "" : ",", result.name.c_str(), result.iterations, result.median_ns, result.min_ns,
+			result.items_per_second, result.bytes_per_second);
+		break;
+	default: {
+		char throughput[32] = "";
+		if (result.bytes_per_second > 0)
+			snprintf(throughput, sizeof(throughput), "%.1f MB/s", result.bytes_per_second / (1024.0 * 1024.0));
+		else if (result.items_per_second > 0)
+			snprintf(throughput, sizeof(throughput), "%.3g items/s", result.items_per_second);
+		printf("%-28s %12lld %14.1f %14.1f %14s\n", result.name.c_str(), result.iterations, result.median_ns, result.min_ns, throughput);
+		break;
+	}
+	}
+	fflush(stdout);
+}
+
+static void PrintUsage(const char *name)
+{
+	printf("usage: %s [--filter=substring] [--min_time=seconds] [--repetitions=n] [--format=console|csv|json]\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *filter = "";
+	double min_time = 0.1;
+	int repetitions = 5;
+	OutputFormat format = OUTPUT_CONSOLE;
+
+	for (int i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--filter=", 9) == 0) {
+			filter = argv[i] + 9;
+		}
+		else if (strncmp(argv[i], "--min_time=", 11) == 0) {
+			min_time = atof(argv[i] + 11);
+		}
+		else if (strncmp(argv[i], "--repetitions=", 14) == 0) {
+			repetitions = atoi(argv[i] + 14);
+		}
+		else if (strcmp(argv[i], "--format=csv") == 0) {
+			format = OUTPUT_CSV;
+		}
+		else if (strcmp(argv[i], "--format=json") == 0) {
+			format = OUTPUT_JSON;
+		}
+		else if (strcmp(argv[i], "--format=console") == 0) {
+			format = OUTPUT_CONSOLE;
+		}
+		else {
+			PrintUsage(argv[0]);
+			return 1;
+		}
+	}
+	if (min_time <= 0 || repetitions <= 0) {
+		PrintUsage(argv[0]);
+		return 1;
+	}
+
+	PrintHeader(format, min_time, repetitions);
+	bool first = true;
+	vector<Benchmark> benchmarks = RegisterBenchmarks();
+	for (size_t i = 0; i < benchmarks.size(); i++) {
+		if (strstr(benchmarks[i].name.c_str(), filter) == NULL)
+			continue;
+		PrintResult(format, Run(benchmarks[i], min_time, repetitions), first);
+		first = false;
+	}
+	if (format == OUTPUT_JSON)
+		printf("\n  ]\n}\n");
+	return 0;
+}
@@ -0,0 +1,68 @@
+#include <stdio.h>
+#include <math.h>
+#include <chrono>
+#include "core/image.h"
+#include "core/texture.h"
+#include "core/color.h"
+
+/*
+*  sampling throughput of the texture layouts: a screen-sized quad is textured at several
+*  rotations, so that at 90 degrees consecutive pixels walk down texture columns
+*  every layout must give the same result, the checksum is printed next to the timing
+*/
+
+static const int TEXTURE_SIZE = 4096;
+static const int SCREEN_SIZE = 1024;
+static const int REPEATS = 3;
+
+//one pass over the screen, texels per pixel = scale, returns the sum of red for the checksum
+static double SampleQuad(const Texture& texture, float degrees, float scale, SampleFilter filter)
+{
+	float radians = degrees * 3.14159265f / 180.0f;
+	float step = scale / TEXTURE_SIZE;
+	float dudx = cosf(radians) * step, dvdx = sinf(radians) * step;
+	float dudy = -dvdx, dvdy = dudx;
+	float lod = texture.Lod(dudx, dvdx, dudy, dvdy);
+	double sum = 0;
+	for (int y = 0; y < SCREEN_SIZE; y++) {
+		float u = 0.25f + y * dudy, v = 0.25f + y * dvdy;
+		for (int x = 0; x < SCREEN_SIZE; x++) {
+			sum += texture.Sample(u, v, lod, filter).r;
+			u += dudx;
+			v += dvdx;
+		}
+	}
+	return sum;
+}
+
+int main()
+{
+	//fixed seed noise, so runs are comparable
+	Image image(TEXTURE_SIZE, TEXTURE_SIZE, 4);
+	unsigned state = 12345;
+	for (int i = 0; i < image.data_size(); i++) {
+		state = state * 1664525u + 1013904223u;
+		image.data()[i] = (Byte)(state >> 24);
+	}
+
+	const float angles[] = { 0, 30, 45, 90 };
+	const float scales[] = { 1, 4 };
+	printf("layout,angle,texels_per_pixel,filter,msamples_per_second,checksum\n");
+	for (int l = 0; l < LAYOUT_NUM; l++) {
+		Texture texture(image, true, WRAP_REPEAT, (TextureLayout)l);
+		for (float angle : angles) {
+			for (float scale : scales) {
+				SampleFilter filter = scale > 1 ? SAMPLE_TRILINEAR : SAMPLE_BILINEAR;
+				double best = 1e30, checksum = 0;
+				for (int r = 0; r < REPEATS; r++) {
+					std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+					checksum = SampleQuad(texture, angle, scale, filter);
+					best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+				}
+				printf("%s,%g,%g,%s,%.1f,%.3f\n", texture_layout_name((TextureLayout)l), angle, scale,
+					filter == SAMPLE_TRILINEAR ? "trilinear" : "bilinear", (double)SCREEN_SIZE * SCREEN_SIZE / best / 1e6, checksum);
+			}
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,304 @@
+#include "blit.h"
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+#include <algorithm>
+#include "renderer.h"
+#include "thread_pool.h"
+#include "utils.h"
+#include "simd.h"
+#include "profiler.h"
+
+//rows per ParallelFor index
+static const int BLIT_BAND = 32;
+
+static void convert_row_scalar(const Byte* src, BlitFormat format, int begin, int end, Byte* dst)
+{
+	int x;
+	switch (format) {
+	case BLIT_GRAY8:
+		for (x = begin; x < end; x++) {
+			dst[x * 4 + 0] = dst[x * 4 + 1] = dst[x * 4 + 2] = src[x];
+			dst[x * 4 + 3] = 255;
+		}
+		break;
+	case BLIT_GRAY_ALPHA8:
+		for (x = begin; x < end; x++) {
+			dst[x * 4 + 0] = dst[x * 4 + 1] = dst[x * 4 + 2] = src[x * 2];
+			dst[x * 4 + 3] = src[x * 2 + 1];
+		}
+		break;
+	case BLIT_BGR8:
+		for (x = begin; x < end; x++) {
+			dst[x * 4 + 0] = src[x * 3 + 0];
+			dst[x * 4 + 1] = src[x * 3 + 1];
+			dst[x * 4 + 2] = src[x * 3 + 2];
+			dst[x * 4 + 3] = 255;
+		}
+		break;
+	case BLIT_RGB8:
+		for (x = begin; x < end; x++) {
+			dst[x * 4 + 0] = src[x * 3 + 2];
+			dst[x * 4 + 1] = src[x * 3 + 1];
+			dst[x * 4 + 2] = src[x * 3 + 0];
+			dst[x * 4 + 3] = 255;
+		}
+		break;
+	case BLIT_BGRA8:
+		if (end > begin)
+			memcpy(dst + begin * 4, src + begin * 4, (size_t)(end - begin) * 4);
+		break;
+	case BLIT_RGBA8:
+		for (x = begin; x < end; x++) {
+			dst[x * 4 + 0] = src[x * 4 + 2];
+			dst[x * 4 + 1] = src[x * 4 + 1];
+			dst[x * 4 + 2] = src[x * 4 + 0];
+			dst[x * 4 + 3] = src[x * 4 + 3];
+		}
+		break;
+	case BLIT_RGBA32F: {
+		const float *values = (const float*)src;
+		for (x = begin; x < end; x++) {
+			dst[x * 4 + 0] = FloatToByte(values[x * 4 + 2]);
+			dst[x * 4 + 1] = FloatToByte(values[x * 4 + 1]);
+			dst[x * 4 + 2] = FloatToByte(values[x * 4 + 0]);
+			dst[x * 4 + 3] = FloatToByte(values[x * 4 + 3]);
+		}
+		break;
+	}
+	default:
+		assert(0);
+		break;
+	}
+}
+
+#if SIMD_X86
+//swap bytes 0 and 2 of every 4-byte pixel
+static inline __m128i swap_red_blue_sse2(__m128i pixels)
+{
+	__m128i green_alpha = _mm_and_si128(pixels, _mm_set1_epi32((int)0xFF00FF00));
+	__m128i red_blue = _mm_and_si128(pixels, _mm_set1_epi32(0x00FF00FF));
+	red_blue = _mm_shufflehi_epi16(_mm_shufflelo_epi16(red_blue, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+	return _mm_or_si128(green_alpha, red_blue);
+}
+
+//FloatToByte of one rgba pixel, in bgra order
+static inline __m128i float_pixel_sse2(const float* rgba)
+{
+	__m128 value = _mm_loadu_ps(rgba);
+	value = _mm_shuffle_ps(value, value, _MM_SHUFFLE(3, 0, 1, 2));
+	value = _mm_min_ps(_mm_max_ps(value, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+	return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(value, _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f)));
+}
+
+static void convert_row_sse2(const Byte* src, BlitFormat format, int begin, int end, Byte* dst)
+{
+	__m128i alpha = _mm_set1_epi32((int)0xFF000000);
+	int x = begin;
+	switch (format) {
+	case BLIT_GRAY8:
+		for (; x + 16 <= end; x += 16) {
+			__m128i gray = _mm_loadu_si128((const __m128i*)(src + x));
+			__m128i gray_gray_lo = _mm_unpacklo_epi8(gray, gray), gray_gray_hi = _mm_unpackhi_epi8(gray, gray);
+			__m128i gray_alpha_lo = _mm_unpacklo_epi8(gray, _mm_set1_epi8((char)0xFF));
+			__m128i gray_alpha_hi = _mm_unpackhi_epi8(gray, _mm_set1_epi8((char)0xFF));
+			__m128i *out = (__m128i*)(dst + x * 4);
+			_mm_storeu_si128(out + 0, _mm_unpacklo_epi16(gray_gray_lo, gray_alpha_lo));
+			_mm_storeu_si128(out + 1, _mm_unpackhi_epi16(gray_gray_lo, gray_alpha_lo));
+			_mm_storeu_si128(out + 2, _mm_unpacklo_epi16(gray_gray_hi, gray_alpha_hi));
+			_mm_storeu_si128(out + 3, _mm_unpackhi_epi16(gray_gray_hi, gray_alpha_hi));
+		}
+		break;
+	case BLIT_BGR8:
+	case BLIT_RGB8:
+		//4-byte loads read one byte past each pixel, so the last pixel of the row is left to the tail
+		for (; x + 5 <= end; x += 4) {
+			const Byte *in = src + x * 3;
+			__m128i pixels = _mm_setr_epi32(*(const int*)(in), *(const int*)(in + 3), *(const int*)(in + 6), *(const int*)(in + 9));
+			pixels = _mm_or_si128(pixels, alpha);
+			if (format == BLIT_RGB8)
+				pixels = swap_red_blue_sse2(pixels);
+			_mm_storeu_si128((__m128i*)(dst + x * 4), pixels);
+		}
+		break;
+	case BLIT_RGBA8:
+		for (; x + 4 <= end; x += 4)
+			_mm_storeu_si128((__m128i*)(dst + x * 4), swap_red_blue_sse2(_mm_loadu_si128((const __m128i*)(src + x * 4))));
+		break;
+	case BLIT_RGBA32F: {
+		const float *values = (const float*)src;
+		for (; x + 4 <= end; x += 4) {
+			const float *in = values + x * 4;
+			__m128i low = _mm_packs_epi32(float_pixel_sse2(in), float_pixel_sse2(in + 4));
+			__m128i high = _mm_packs_epi32(float_pixel_sse2(in + 8), float_pixel_sse2(in + 12));
+			_mm_storeu_si128((__m128i*)(dst + x * 4), _mm_packus_epi16(low, high));
+		}
+		break;
+	}
+	default:
+		break;
+	}
+	convert_row_scalar(src, format, x, end, dst);
+}
+
+SIMD_TARGET_AVX2
+static void convert_row_avx2(const Byte* src, BlitFormat format, int begin, int end, Byte* dst)
+{
+	__m256i alpha = _mm256_set1_epi32((int)0xFF000000);
+	int x = begin;
+	switch (format) {
+	case BLIT_GRAY8:
+		for (; x + 8 <= end; x += 8) {
+			__m256i gray = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + x)));
+			__m256i pixels = _mm256_or_si256(_mm256_or_si256(gray, _mm256_slli_epi32(gray, 8)), _mm256_or_si256(_mm256_slli_epi32(gray, 16), alpha));
+			_mm256_storeu_si256((__m256i*)(dst + x * 4), pixels);
+		}
+		break;
+	case BLIT_BGR8:
+	case BLIT_RGB8: {
+		//each half loads 16 bytes for its 12, the 4 past the last pixel must stay inside the row
+		__m256i order = format == BLIT_BGR8 ?
+			_mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1) :
+			_mm256_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1, 2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+		for (; x + 10 <= end; x += 8) {
+			const Byte *in = src + x * 3;
+			__m256i pixels = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)in)), _mm_loadu_si128((const __m128i*)(in + 12)), 1);
+			_mm256_storeu_si256((__m256i*)(dst + x * 4), _mm256_or_si256(_mm256_shuffle_epi8(pixels, order), alpha));
+		}
+		break;
+	}
+	case BLIT_RGBA8: {
+		__m256i order = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15, 2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+		for (; x + 8 <= end; x += 8)
+			_mm256_storeu_si256((__m256i*)(dst + x * 4), _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(src + x * 4)), order));
+		break;
+	}
+	case BLIT_RGBA32F: {
+		const float *values = (const float*)src;
+		__m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f), scale = _mm256_set1_ps(255.0f), half = _mm256_set1_ps(0.5f);
+		//packs work per 128-bit lane, the pixels come out as 0 2 4 6 | 1 3 5 7
+		__m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+		for (; x + 8 <= end; x += 8) {
+			__m256i pairs[4];
+			for (int k = 0; k < 4; k++) {
+				__m256 value = _mm256_loadu_ps(values + (x + k * 2) * 4);
+				value = _mm256_permute_ps(value, _MM_SHUFFLE(3, 0, 1, 2));
+				value = _mm256_min_ps(_mm256_max_ps(value, zero), one);
+				pairs[k] = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(value, scale), half));
+			}
+			__m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(pairs[0], pairs[1]), _mm256_packs_epi32(pairs[2], pairs[3]));
+			_mm256_storeu_si256((__m256i*)(dst + x * 4), _mm256_permutevar8x32_epi32(packed, order));
+		}
+		break;
+	}
+	default:
+		break;
+	}
+	convert_row_scalar(src, format, x, end, dst);
+}
+#endif
+
+typedef void(*ConvertRowFunc)(const Byte* src, BlitFormat format, int begin, int end, Byte* dst);
+
+static ConvertRowFunc convert_row_func()
+{
+#if SIMD_X86
+	switch (simd_level()) {
+	case SIMD_AVX2: return convert_row_avx2;
+	case SIMD_SSE2: return convert_row_sse2;
+	default: break;
+	}
+#endif
+	return convert_row_scalar;
+}
+
+void convert_row_bgra8(const Byte* src, BlitFormat format, int width, Byte* dst)
+{
+	assert(format >= 0 && format < BLIT_NUM);
+	convert_row_func()(src, format, 0, width, dst);
+}
+
+//convert height rows of width pixels, row y of src starts at src + y * src_pitch (negative to flip)
+static void blit_rows(const Byte* src, ptrdiff_t src_pitch, BlitFormat format, int width, int height,
+	Byte* dst, ptrdiff_t dst_pitch, ThreadPool* pool)
+{
+	ProfileScope scope(STAGE_BLIT);
+	ConvertRowFunc convert_row = convert_row_func();
+	int bands = (height + BLIT_BAND - 1) / BLIT_BAND;
+
+	auto blit_band = [&](int band, int) {
+		int y1 = std::min((band + 1) * BLIT_BAND, height);
+		for (int y = band * BLIT_BAND; y < y1; y++)
+			convert_row(src + y * src_pitch, format, 0, width, dst + y * dst_pitch);
+	};
+
+	if (pool != NULL) {
+		pool->ParallelFor(bands, blit_band);
+	}
+	else {
+		for (int band = 0; band < bands; band++)
+			blit_band(band, 0);
+	}
+}
+
+static BlitFormat image_format(int channels, bool rgb)
+{
+	switch (channels) {
+	case 1: return BLIT_GRAY8;
+	case 2: return BLIT_GRAY_ALPHA8;
+	case 3: return rgb ? BLIT_RGB8 : BLIT_BGR8;
+	default: return rgb ? BLIT_RGBA8 : BLIT_BGRA8;
+	}
+}
+
+static BlitFormat frame_format(PixelFormat format)
+{
+	switch (format) {
+	case FORMAT_RGBA8: return BLIT_RGBA8;
+	case FORMAT_BGRA8: return BLIT_BGRA8;
+	case FORMAT_RGBA32F: return BLIT_RGBA32F;
+	default: assert(0); return BLIT_BGRA8;
+	}
+}
+
+//window origin is topLeft while frame and image are default as bottomLeft, so rows are walked upwards
+static void blit_image(const ImageView& src, bool rgb, int buffer_width, int buffer_height, Byte* buffer, ThreadPool* pool)
+{
+	int width = std::min(src.width, buffer_width);
+	int height = std::min(src.height, buffer_height);
+
+	assert(width > 0 && height > 0);
+	assert(src.channels >= 1 && src.channels <= 4);
+
+	blit_rows(src.row(src.height - 1), -(ptrdiff_t)src.pitch, image_format(src.channels, rgb), width, height,
+		buffer, (ptrdiff_t)buffer_width * 4, pool);
+}
+
+void blit_image_bgr(const ImageView& src, int buffer_width, int buffer_height, Byte* buffer, ThreadPool* pool)
+{
+	blit_image(src, false, buffer_width, buffer_height, buffer, pool);
+}
+
+void blit_image_rgb(const ImageView& src, int buffer_width, int buffer_height, Byte* buffer, ThreadPool* pool)
+{
+	blit_image(src, true, buffer_width, buffer_height, buffer, pool);
+}
+
+void blit_frame_bgr(FrameBuffer* src, int buffer_width, int buffer_height, Byte* buffer, ThreadPool* pool)
+{
+	int width = std::min(src->width(), buffer_width);
+	int height = std::min(src->height(), buffer_height);
+
+	assert(width > 0 && height > 0);
+
+	blit_rows(src->row(src->height() - 1), -(ptrdiff_t)src->pitch(), frame_format(src->format()), width, height,
+		buffer, (ptrdiff_t)buffer_width * 4, pool);
+}
+
+void blit_frame_image(FrameBuffer* src, Image* dst, ThreadPool* pool)
+{
+	assert(dst->width() == src->width() && dst->height() == src->height() && dst->channels() == 4);
+	ImageView view = dst->view();
+	blit_rows(src->row(0), src->pitch(), frame_format(src->format()), src->width(), src->height(),
+		view.data, view.pitch, pool);
+}
@@ -0,0 +1,29 @@
+#ifndef BLIT_H
+#define BLIT_H
+
+#include "image.h"
+
+class FrameBuffer;
+class ThreadPool;
+
+//source pixel layouts of the conversion kernels, named by byte order in memory; RGBA32F is four floats
+typedef enum { BLIT_GRAY8 = 0, BLIT_GRAY_ALPHA8, BLIT_BGR8, BLIT_RGB8, BLIT_BGRA8, BLIT_RGBA8, BLIT_RGBA32F, BLIT_NUM } BlitFormat;
+
+/*
+*  convert width pixels of one row into BGRA8; sources without alpha get 255, floats are clamped
+*  to [0, 1] and rounded like FloatToByte; scalar, SSE2 and AVX2 give identical bytes
+*/
+void convert_row_bgra8(const Byte* src, BlitFormat format, int width, Byte* dst);
+
+/*
+*  copy an image or a frame into a BGRA8 buffer of buffer_width x buffer_height pixels with the
+*  window origin (topLeft), cropping to the smaller size; rows are spread over pool when one is given
+*  blit_image_bgr takes tga channel order (gray, bgr or bgra), blit_image_rgb rgb(a) order
+*/
+void blit_image_bgr(const ImageView& src, int buffer_width, int buffer_height, Byte* buffer, ThreadPool* pool = NULL);
+void blit_image_rgb(const ImageView& src, int buffer_width, int buffer_height, Byte* buffer, ThreadPool* pool = NULL);
+void blit_frame_bgr(FrameBuffer* src, int buffer_width, int buffer_height, Byte* buffer, ThreadPool* pool = NULL);
+//copy frame into a 4-channel BGRA image of the same size, keeping the bottomLeft origin (tga layout)
+void blit_frame_image(FrameBuffer* src, Image* dst, ThreadPool* pool = NULL);
+
+#endif
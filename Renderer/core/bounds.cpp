@@ -0,0 +1,184 @@
+#include "bounds.h"
+#include <math.h>
+#include <algorithm>
+#include <limits>
+#include "matrix.h"
+#include "simd.h"
+
+BoundingBox transform_box(const BoundingBox& box, const Matrix4& transform)
+{
+	if (box_empty(box))
+		return box;
+	//center moves with the matrix, the extent grows by the absolute value of every entry
+	float center[3] = { (box.min.x + box.max.x) * 0.5f, (box.min.y + box.max.y) * 0.5f, (box.min.z + box.max.z) * 0.5f };
+	float extent[3] = { (box.max.x - box.min.x) * 0.5f, (box.max.y - box.min.y) * 0.5f, (box.max.z - box.min.z) * 0.5f };
+	float new_center[3], new_extent[3];
+	for (int row = 0; row < 3; row++) {
+		new_center[row] = transform(row, 3);
+		new_extent[row] = 0;
+		for (int col = 0; col < 3; col++) {
+			new_center[row] += transform(row, col) * center[col];
+			new_extent[row] += fabsf(transform(row, col)) * extent[col];
+		}
+	}
+	BoundingBox result;
+	result.min = Vector3f(new_center[0] - new_extent[0], new_center[1] - new_extent[1], new_center[2] - new_extent[2]);
+	result.max = Vector3f(new_center[0] + new_extent[0], new_center[1] + new_extent[1], new_center[2] + new_extent[2]);
+	return result;
+}
+
+BoundingSphere box_sphere(const BoundingBox& box)
+{
+	BoundingSphere sphere;
+	if (box_empty(box)) {
+		//outside every plane
+		sphere.center = Vector3f(0, 0, 0);
+		sphere.radius = -std::numeric_limits<float>::infinity();
+		return sphere;
+	}
+	sphere.center = Vector3f((box.min.x + box.max.x) * 0.5f, (box.min.y + box.max.y) * 0.5f, (box.min.z + box.max.z) * 0.5f);
+	float dx = box.max.x - sphere.center.x, dy = box.max.y - sphere.center.y, dz = box.max.z - sphere.center.z;
+	sphere.radius = sqrtf(dx * dx + dy * dy + dz * dz);
+	return sphere;
+}
+
+bool box_empty(const BoundingBox& box)
+{
+	return !(box.min.x <= box.max.x && box.min.y <= box.max.y && box.min.z <= box.max.z);
+}
+
+Frustum frustum_from_matrix(const Matrix4& view_projection)
+{
+	//-w <= x, y, z <= w: every plane is the last row plus or minus one of the others
+	static const int rows[6] = { 0, 0, 1, 1, 2, 2 };
+	static const float signs[6] = { 1, -1, 1, -1, 1, -1 };
+	Frustum frustum;
+	for (int i = 0; i < 6; i++) {
+		float *plane = frustum.planes[i];
+		for (int col = 0; col < 4; col++)
+			plane[col] = view_projection(3, col) + signs[i] * view_projection(rows[i], col);
+		float length = sqrtf(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+		float inv = length > 0 ? 1.0f / length : 0.0f;
+		for (int col = 0; col < 4; col++)
+			plane[col] *= inv;
+	}
+	return frustum;
+}
+
+bool box_in_frustum(const Frustum& frustum, const BoundingBox& box)
+{
+	if (box_empty(box))
+		return false;
+	for (int i = 0; i < 6; i++) {
+		const float *plane = frustum.planes[i];
+		//corner farthest along the plane normal
+		float x = plane[0] >= 0 ? box.max.x : box.min.x;
+		float y = plane[1] >= 0 ? box.max.y : box.min.y;
+		float z = plane[2] >= 0 ? box.max.z : box.min.z;
+		if (plane[0] * x + plane[1] * y + plane[2] * z + plane[3] < 0)
+			return false;
+	}
+	return true;
+}
+
+int classify_box(const Frustum& frustum, const BoundingBox& box)
+{
+	if (box_empty(box))
+		return -1;
+	int result = 1;
+	for (int i = 0; i < 6; i++) {
+		const float *plane = frustum.planes[i];
+		//corners farthest along and against the plane normal
+		bool px = plane[0] >= 0, py = plane[1] >= 0, pz = plane[2] >= 0;
+		float far_distance = plane[0] * (px ? box.max.x : box.min.x) + plane[1] * (py ? box.max.y : box.min.y) + plane[2] * (pz ? box.max.z : box.min.z) + plane[3];
+		if (far_distance < 0)
+			return -1;
+		float near_distance = plane[0] * (px ? box.min.x : box.max.x) + plane[1] * (py ? box.min.y : box.max.y) + plane[2] * (pz ? box.min.z : box.max.z) + plane[3];
+		if (near_distance < 0)
+			result = 0;
+	}
+	return result;
+}
+
+/*
+*  sphere kernels: distance = ((a * x + b * y) + c * z) + d in this order with separate
+*  multiplies and adds, outside when distance < -radius
+*/
+static int cull_spheres_scalar(const Frustum& frustum, const float* x, const float* y, const float* z, const float* radius, int begin, int end, Byte* visible)
+{
+	int count = 0;
+	for (int i = begin; i < end; i++) {
+		bool inside = true;
+		for (int p = 0; p < 6; p++) {
+			const float *plane = frustum.planes[p];
+			float distance = plane[0] * x[i] + plane[1] * y[i] + plane[2] * z[i] + plane[3];
+			inside = inside && !(distance < -radius[i]);
+		}
+		visible[i] = inside ? 1 : 0;
+		count += inside;
+	}
+	return count;
+}
+
+#if SIMD_X86
+static int cull_spheres_sse2(const Frustum& frustum, const float* x, const float* y, const float* z, const float* radius, int begin, int end, Byte* visible)
+{
+	int count = 0;
+	int i = begin;
+	for (; i + 4 <= end; i += 4) {
+		__m128 px = _mm_loadu_ps(x + i), py = _mm_loadu_ps(y + i), pz = _mm_loadu_ps(z + i);
+		__m128 neg_radius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(radius + i));
+		__m128 outside = _mm_setzero_ps();
+		for (int p = 0; p < 6; p++) {
+			const float *plane = frustum.planes[p];
+			__m128 distance = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane[0]), px), _mm_mul_ps(_mm_set1_ps(plane[1]), py));
+			distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(plane[2]), pz));
+			distance = _mm_add_ps(distance, _mm_set1_ps(plane[3]));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, neg_radius));
+		}
+		int mask = ~_mm_movemask_ps(outside) & 0xF;
+		for (int k = 0; k < 4; k++) {
+			visible[i + k] = (Byte)((mask >> k) & 1);
+			count += visible[i + k];
+		}
+	}
+	return count + cull_spheres_scalar(frustum, x, y, z, radius, i, end, visible);
+}
+
+SIMD_TARGET_AVX2
+static int cull_spheres_avx2(const Frustum& frustum, const float* x, const float* y, const float* z, const float* radius, int begin, int end, Byte* visible)
+{
+	int count = 0;
+	int i = begin;
+	for (; i + 8 <= end; i += 8) {
+		__m256 px = _mm256_loadu_ps(x + i), py = _mm256_loadu_ps(y + i), pz = _mm256_loadu_ps(z + i);
+		__m256 neg_radius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(radius + i));
+		__m256 outside = _mm256_setzero_ps();
+		for (int p = 0; p < 6; p++) {
+			const float *plane = frustum.planes[p];
+			__m256 distance = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane[0]), px), _mm256_mul_ps(_mm256_set1_ps(plane[1]), py));
+			distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(plane[2]), pz));
+			distance = _mm256_add_ps(distance, _mm256_set1_ps(plane[3]));
+			outside = _mm256_or_ps(outside, _mm256_cmp_ps(distance, neg_radius, _CMP_LT_OQ));
+		}
+		int mask = ~_mm256_movemask_ps(outside) & 0xFF;
+		for (int k = 0; k < 8; k++) {
+			visible[i + k] = (Byte)((mask >> k) & 1);
+			count += visible[i + k];
+		}
+	}
+	return count + cull_spheres_scalar(frustum, x, y, z, radius, i, end, visible);
+}
+#endif
+
+int cull_spheres(const Frustum& frustum, const float* x, const float* y, const float* z, const float* radius, int count, Byte* visible)
+{
+#if SIMD_X86
+	switch (simd_level()) {
+	case SIMD_AVX2: return cull_spheres_avx2(frustum, x, y, z, radius, 0, count, visible);
+	case SIMD_SSE2: return cull_spheres_sse2(frustum, x, y, z, radius, 0, count, visible);
+	default: break;
+	}
+#endif
+	return cull_spheres_scalar(frustum, x, y, z, radius, 0, count, visible);
+}
@@ -0,0 +1,52 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include "geometry.h"
+
+class Matrix4;
+
+typedef unsigned char Byte;
+
+//axis-aligned box, empty when min > max
+struct BoundingBox
+{
+	Vector3f min, max;
+};
+
+struct BoundingSphere
+{
+	Vector3f center;
+	float radius;
+};
+
+//box around the transformed corners of box
+BoundingBox transform_box(const BoundingBox& box, const Matrix4& transform);
+//sphere through the corners of box
+BoundingSphere box_sphere(const BoundingBox& box);
+bool box_empty(const BoundingBox& box);
+
+/*
+*  six planes of a view frustum, inside when a * x + b * y + c * z + d >= 0, with (a, b, c) normalized
+*  so that the value is a distance; order: left, right, bottom, top, near, far
+*/
+struct Frustum
+{
+	float planes[6][4];
+};
+
+//frustum of a view projection matrix (opengl clip space), in the space the matrix maps from
+Frustum frustum_from_matrix(const Matrix4& view_projection);
+
+//whether the box is not entirely outside one plane; conservative near the frustum corners
+bool box_in_frustum(const Frustum& frustum, const BoundingBox& box);
+//-1 when the box is entirely outside one plane, 1 when it is inside all of them, else 0
+int classify_box(const Frustum& frustum, const BoundingBox& box);
+
+/*
+*  frustum test of count spheres given as arrays of centers and radii: visible[i] becomes 1 when
+*  sphere i is not entirely outside one plane, else 0; returns the number of visible spheres
+*  scalar, SSE2 and AVX2 agree exactly
+*/
+int cull_spheres(const Frustum& frustum, const float* x, const float* y, const float* z, const float* radius, int count, Byte* visible);
+
+#endif
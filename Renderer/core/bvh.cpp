@@ -0,0 +1,242 @@
+#include "bvh.h"
+#include <assert.h>
+#include <math.h>
+#include <limits>
+
+static const int SAH_BINS = 16;
+//leaves are allowed up to this size when splitting would cost more than testing every item
+static const int SAH_MAX_LEAF = 2 * BVH_LEAF_SIZE;
+
+static inline BoundingBox empty_box()
+{
+	float inf = std::numeric_limits<float>::infinity();
+	BoundingBox box;
+	box.min = Vector3f(inf, inf, inf);
+	box.max = Vector3f(-inf, -inf, -inf);
+	return box;
+}
+
+static inline void grow(BoundingBox* box, const BoundingBox& other)
+{
+	box->min.x = std::min(box->min.x, other.min.x);
+	box->min.y = std::min(box->min.y, other.min.y);
+	box->min.z = std::min(box->min.z, other.min.z);
+	box->max.x = std::max(box->max.x, other.max.x);
+	box->max.y = std::max(box->max.y, other.max.y);
+	box->max.z = std::max(box->max.z, other.max.z);
+}
+
+static inline void grow(BoundingBox* box, const Vector3f& point)
+{
+	box->min.x = std::min(box->min.x, point.x);
+	box->min.y = std::min(box->min.y, point.y);
+	box->min.z = std::min(box->min.z, point.z);
+	box->max.x = std::max(box->max.x, point.x);
+	box->max.y = std::max(box->max.y, point.y);
+	box->max.z = std::max(box->max.z, point.z);
+}
+
+static inline float surface_area(const BoundingBox& box)
+{
+	if (box_empty(box))
+		return 0.0f;
+	float dx = box.max.x - box.min.x, dy = box.max.y - box.min.y, dz = box.max.z - box.min.z;
+	return 2.0f * (dx * dy + dy * dz + dz * dx);
+}
+
+static inline float component(const Vector3f& v, int axis)
+{
+	return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+float ray_box_entry(const Vector3f& origin, const Vector3f& inv_direction, float max_t, const BoundingBox& box)
+{
+	float t_min = 0.0f, t_max = max_t;
+	for (int axis = 0; axis < 3; axis++) {
+		float o = component(origin, axis), inv = component(inv_direction, axis);
+		float t0 = (component(box.min, axis) - o) * inv, t1 = (component(box.max, axis) - o) * inv;
+		if (t0 > t1)
+			std::swap(t0, t1);
+		//nan from a zero direction on a slab boundary keeps the previous range
+		t_min = t0 > t_min ? t0 : t_min;
+		t_max = t1 < t_max ? t1 : t_max;
+	}
+	return t_min <= t_max ? t_min : -1.0f;
+}
+
+Bvh::Bvh()
+{
+}
+
+Bvh::~Bvh()
+{
+}
+
+void Bvh::Build(const BoundingBox* boxes, int count)
+{
+	nodes_.clear();
+	items_.resize(count);
+	if (count == 0)
+		return;
+	//the builder partitions copies of the boxes, so every pass reads memory in order
+	vector<BvhBuildItem> build(count);
+	for (int i = 0; i < count; i++) {
+		const BoundingBox& box = boxes[i];
+		build[i].box = box;
+		//empty boxes (meshes without vertices) are parked at the origin, they never pass a test
+		build[i].centroid = box_empty(box) ? Vector3f(0, 0, 0) :
+			Vector3f((box.min.x + box.max.x) * 0.5f, (box.min.y + box.max.y) * 0.5f, (box.min.z + box.max.z) * 0.5f);
+		build[i].index = i;
+	}
+	nodes_.reserve(2 * count / BVH_LEAF_SIZE + 1);
+	BuildNode(build.data(), 0, count, 0);
+	for (int i = 0; i < count; i++)
+		items_[i] = build[i].index;
+}
+
+void Bvh::BuildNode(BvhBuildItem* build, int first, int count, int depth)
+{
+	int index = (int)nodes_.size();
+	nodes_.push_back(BvhNode());
+	BvhBuildItem *begin = build + first, *end = begin + count;
+	BoundingBox bounds = empty_box(), centroid_bounds = empty_box();
+	for (BvhBuildItem *item = begin; item < end; item++) {
+		grow(&bounds, item->box);
+		grow(&centroid_bounds, item->centroid);
+	}
+	nodes_[index].bounds = bounds;
+	nodes_[index].first = first;
+	nodes_[index].count = count;
+	if (count <= BVH_LEAF_SIZE)
+		return;
+
+	int axis = 0;
+	float extent[3] = { centroid_bounds.max.x - centroid_bounds.min.x, centroid_bounds.max.y - centroid_bounds.min.y,
+		centroid_bounds.max.z - centroid_bounds.min.z };
+	if (extent[1] > extent[axis])
+		axis = 1;
+	if (extent[2] > extent[axis])
+		axis = 2;
+	float lo = component(centroid_bounds.min, axis);
+	BvhBuildItem *middle = NULL;
+
+	if (extent[axis] > 0 && depth < BVH_SAH_DEPTH) {
+		//bin the centroids, then sweep for the cheapest of the SAH_BINS - 1 planes between bins
+		float scale = SAH_BINS / extent[axis];
+		int bin_count[SAH_BINS] = { 0 };
+		BoundingBox bin_bounds[SAH_BINS];
+		for (int b = 0; b < SAH_BINS; b++)
+			bin_bounds[b] = empty_box();
+		for (BvhBuildItem *item = begin; item < end; item++) {
+			int b = std::min((int)((component(item->centroid, axis) - lo) * scale), SAH_BINS - 1);
+			item->bin = b;
+			bin_count[b]++;
+			grow(&bin_bounds[b], item->box);
+		}
+		float right_cost[SAH_BINS];
+		BoundingBox right = empty_box();
+		int right_count = 0;
+		for (int b = SAH_BINS - 1; b > 0; b--) {
+			grow(&right, bin_bounds[b]);
+			right_count += bin_count[b];
+			right_cost[b] = surface_area(right) * right_count;
+		}
+		float best_cost = std::numeric_limits<float>::infinity();
+		int best_split = -1;
+		BoundingBox left = empty_box();
+		int left_count = 0;
+		for (int b = 1; b < SAH_BINS; b++) {
+			grow(&left, bin_bounds[b - 1]);
+			left_count += bin_count[b - 1];
+			float cost = surface_area(left) * left_count + right_cost[b];
+			if (left_count > 0 && left_count < count && cost < best_cost) {
+				best_cost = cost;
+				best_split = b;
+			}
+		}
+		//one traversal step costs about as much as one item test
+		float leaf_cost = surface_area(bounds) * count;
+		if (count <= SAH_MAX_LEAF && (best_split < 0 || leaf_cost <= surface_area(bounds) + best_cost))
+			return;
+		if (best_split > 0) {
+			middle = std::partition(begin, end, [&](const BvhBuildItem& item) { return item.bin < best_split; });
+		}
+	}
+	if (middle == NULL || middle == begin || middle == end) {
+		//all centroids in one place, or too deep: halve by count
+		middle = begin + count / 2;
+		std::nth_element(begin, middle, end, [&](const BvhBuildItem& a, const BvhBuildItem& b) {
+			return component(a.centroid, axis) < component(b.centroid, axis);
+		});
+	}
+
+	int left_count = (int)(middle - begin);
+	nodes_[index].count = 0;
+	BuildNode(build, first, left_count, depth + 1);
+	nodes_[index].first = (int)nodes_.size();
+	BuildNode(build, first + left_count, count - left_count, depth + 1);
+}
+
+void Bvh::Refit(const BoundingBox* boxes)
+{
+	//children always come after their parent, so a backward pass sees them first
+	for (int i = (int)nodes_.size() - 1; i >= 0; i--) {
+		BvhNode& node = nodes_[i];
+		node.bounds = empty_box();
+		if (node.count > 0) {
+			for (int j = node.first; j < node.first + node.count; j++)
+				grow(&node.bounds, boxes[items_[j]]);
+		}
+		else {
+			grow(&node.bounds, nodes_[i + 1].bounds);
+			grow(&node.bounds, nodes_[node.first].bounds);
+		}
+	}
+}
+
+void Bvh::Cull(const Frustum& frustum, const BoundingBox* boxes, vector<int>* visible) const
+{
+	visible->clear();
+	if (nodes_.empty())
+		return;
+	//stack of (node, inside), nodes inside the whole frustum need no more tests
+	struct Entry { int node; bool inside; };
+	Entry stack[BVH_STACK_SIZE];
+	int top = 0;
+	stack[top++] = { 0, false };
+	while (top > 0) {
+		Entry entry = stack[--top];
+		const BvhNode& node = nodes_[entry.node];
+		bool inside = entry.inside;
+		if (!inside) {
+			int test = classify_box(frustum, node.bounds);
+			if (test < 0)
+				continue;
+			inside = test > 0;
+		}
+		if (node.count > 0) {
+			for (int i = node.first; i < node.first + node.count; i++) {
+				const BoundingBox& box = boxes[items_[i]];
+				if (inside ? !box_empty(box) : box_in_frustum(frustum, box))
+					visible->push_back(items_[i]);
+			}
+			continue;
+		}
+		assert(top + 2 <= BVH_STACK_SIZE);
+		stack[top++] = { node.first, inside };
+		stack[top++] = { entry.node + 1, inside };
+	}
+}
+
+float Bvh::cost() const
+{
+	if (nodes_.empty())
+		return 0.0f;
+	double total = 0;
+	for (size_t i = 0; i < nodes_.size(); i++) {
+		const BvhNode& node = nodes_[i];
+		total += (double)surface_area(node.bounds) * (node.count > 0 ? node.count : 1);
+	}
+	double root = (double)surface_area(nodes_[0].bounds) * items_.size();
+	return root > 0 ? (float)(total / root) : 0.0f;
+}
@@ -0,0 +1,122 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <assert.h>
+#include <vector>
+#include <algorithm>
+#include "bounds.h"
+
+using std::vector;
+
+//items per leaf the builder aims for, larger groups are split while the surface area heuristic allows
+static const int BVH_LEAF_SIZE = 4;
+//deeper than this the builder splits at the median, which bounds the traversal stacks
+static const int BVH_SAH_DEPTH = 64;
+static const int BVH_STACK_SIZE = BVH_SAH_DEPTH + 32;
+
+/*
+*  node of the flattened tree, stored depth first: the left child directly follows its parent,
+*  the right child is at index first; leaves have count > 0 items starting at first in items()
+*/
+struct BvhNode
+{
+	BoundingBox bounds;
+	int first;
+	int count;
+};
+
+//what the builder sorts into the leaves
+struct BvhBuildItem
+{
+	BoundingBox box;
+	Vector3f centroid;
+	int index;
+	int bin;	//of the last binning pass over the node holding the item
+};
+
+/*
+*  bounding volume hierarchy over boxes given by index, built top down with binned SAH splits
+*  Refit keeps the tree and only grows or shrinks the node boxes, which is cheap but loosens the
+*  tree as items move; cost() tells how much, so the owner can decide when to Build again
+*/
+class Bvh
+{
+public:
+	Bvh();
+	~Bvh();
+
+	void Build(const BoundingBox* boxes, int count);
+	//boxes of the same items as the last Build, at new places
+	void Refit(const BoundingBox* boxes);
+
+	//items whose box is not entirely outside one plane of frustum, in no particular order
+	void Cull(const Frustum& frustum, const BoundingBox* boxes, vector<int>* visible) const;
+	/*
+	*  boxes along the ray origin + t * direction for 0 <= t < max_t, nearest entry first; hit is
+	*  called with the item and its entry t and returns the t of a hit (or max_t for none), after
+	*  which boxes farther away are skipped; returns the nearest t found
+	*/
+	template <typename HitFunc>
+	float Raycast(const Vector3f& origin, const Vector3f& direction, float max_t, const BoundingBox* boxes, HitFunc hit) const;
+
+	//surface area heuristic cost of the tree, relative to a single leaf box holding every item
+	float cost() const;
+	int node_num() const { return (int)nodes_.size(); }
+	const BvhNode& node(int i) const { return nodes_[i]; }
+	const vector<int>& items() const { return items_; }
+
+private:
+	void BuildNode(BvhBuildItem* build, int first, int count, int depth);
+
+	vector<BvhNode> nodes_;
+	vector<int> items_;
+};
+
+//entry t of the ray into box within [0, max_t], or a negative value when it misses; inv_direction is 1 / direction
+float ray_box_entry(const Vector3f& origin, const Vector3f& inv_direction, float max_t, const BoundingBox& box);
+
+template <typename HitFunc>
+float Bvh::Raycast(const Vector3f& origin, const Vector3f& direction, float max_t, const BoundingBox* boxes, HitFunc hit) const
+{
+	if (nodes_.empty())
+		return max_t;
+	Vector3f inv_direction(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+	if (ray_box_entry(origin, inv_direction, max_t, nodes_[0].bounds) < 0)
+		return max_t;
+
+	//stack of (node, entry t), the nearer child is visited first
+	struct Entry { int node; float t; };
+	Entry stack[BVH_STACK_SIZE];
+	int top = 0;
+	stack[top++] = { 0, 0.0f };
+	while (top > 0) {
+		Entry entry = stack[--top];
+		if (entry.t >= max_t)
+			continue;
+		const BvhNode& node = nodes_[entry.node];
+		if (node.count > 0) {
+			for (int i = node.first; i < node.first + node.count; i++) {
+				float t = ray_box_entry(origin, inv_direction, max_t, boxes[items_[i]]);
+				if (t >= 0)
+					max_t = std::min(max_t, hit(items_[i], t));
+			}
+			continue;
+		}
+		int left = entry.node + 1, right = node.first;
+		float t_left = ray_box_entry(origin, inv_direction, max_t, nodes_[left].bounds);
+		float t_right = ray_box_entry(origin, inv_direction, max_t, nodes_[right].bounds);
+		if (t_left >= 0 && t_right >= 0 && t_left < t_right) {
+			std::swap(left, right);
+			std::swap(t_left, t_right);
+		}
+		//the farther child goes on the stack first
+		assert(top + 2 <= BVH_STACK_SIZE);
+		if (t_left >= 0)
+			stack[top++] = { left, t_left };
+		if (t_right >= 0)
+			stack[top++] = { right, t_right };
+	}
+	return max_t;
+}
+
+#endif
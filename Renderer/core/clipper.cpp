@@ -0,0 +1,103 @@
+#include "clipper.h"
+#include <assert.h>
+#include <algorithm>
+#include "rasterizer.h"
+
+ClipGuardBand clip_guard_band(const Viewport& viewport)
+{
+	//a pixel less than the rasterizer allows, so rounding of the divide cannot leave it
+	ClipGuardBand guard;
+	guard.x = 1.0f + 2.0f * (RASTER_GUARD_BAND - 1) / viewport.width;
+	guard.y = 1.0f + 2.0f * (RASTER_GUARD_BAND - 1) / viewport.height;
+	return guard;
+}
+
+void compute_clip_codes(const PostTransformBuffer& vertices, const ClipGuardBand& guard, ClipCode* codes)
+{
+	const float *cx = vertices.clip(0), *cy = vertices.clip(1), *cz = vertices.clip(2), *cw = vertices.clip(3);
+	for (int i = 0; i < vertices.count(); i++) {
+		float x = cx[i], y = cy[i], z = cz[i], w = cw[i];
+		float gx = guard.x * w, gy = guard.y * w;
+		codes[i] = (ClipCode)((z < -w ? CLIP_NEAR : 0) | (z > w ? CLIP_FAR : 0)
+			| (x < -w ? CLIP_LEFT : 0) | (x > w ? CLIP_RIGHT : 0)
+			| (y < -w ? CLIP_BOTTOM : 0) | (y > w ? CLIP_TOP : 0)
+			| (x < -gx ? CLIP_GUARD_LEFT : 0) | (x > gx ? CLIP_GUARD_RIGHT : 0)
+			| (y < -gy ? CLIP_GUARD_BOTTOM : 0) | (y > gy ? CLIP_GUARD_TOP : 0));
+	}
+}
+
+//signed distance to plane, inside when >= 0
+static inline float plane_distance(const ClipVertex& v, ClipCode plane, const ClipGuardBand& guard)
+{
+	switch (plane) {
+	case CLIP_NEAR:         return v.z + v.w;
+	case CLIP_FAR:          return v.w - v.z;
+	case CLIP_GUARD_LEFT:   return v.x + guard.x * v.w;
+	case CLIP_GUARD_RIGHT:  return guard.x * v.w - v.x;
+	case CLIP_GUARD_BOTTOM: return v.y + guard.y * v.w;
+	case CLIP_GUARD_TOP:    return guard.y * v.w - v.y;
+	default: assert(0); return 0;
+	}
+}
+
+//point of edge (inside, outside) on the plane; always interpolated from the inside end, so the
+//two triangles sharing an edge get the same point
+static inline ClipVertex intersect(const ClipVertex& inside, const ClipVertex& outside, float d_inside, float d_outside)
+{
+	float t = d_inside / (d_inside - d_outside);
+	ClipVertex v;
+	v.x = inside.x + (outside.x - inside.x) * t;
+	v.y = inside.y + (outside.y - inside.y) * t;
+	v.z = inside.z + (outside.z - inside.z) * t;
+	v.w = inside.w + (outside.w - inside.w) * t;
+	for (int k = 0; k < 3; k++)
+		v.weights[k] = inside.weights[k] + (outside.weights[k] - inside.weights[k]) * t;
+	return v;
+}
+
+int clip_triangle(const ClipVertex triangle[3], ClipCode planes, const ClipGuardBand& guard, ClipVertex output[CLIP_MAX_VERTICES])
+{
+	assert((planes & ~CLIP_NEEDED) == 0);
+	ClipVertex scratch[CLIP_MAX_VERTICES];
+	//ping-pong so that the last plane writes into output
+	int plane_count = 0;
+	for (ClipCode plane = CLIP_NEAR; plane <= CLIP_GUARD_TOP; plane <<= 1)
+		plane_count += (planes & plane) != 0;
+	ClipVertex *src = plane_count % 2 == 0 ? output : scratch, *dst = plane_count % 2 == 0 ? scratch : output;
+	std::copy(triangle, triangle + 3, src);
+	int count = 3;
+
+	for (ClipCode plane = CLIP_NEAR; plane <= CLIP_GUARD_TOP && count > 0; plane <<= 1) {
+		if ((planes & plane) == 0)
+			continue;
+		int next = 0;
+		float d_prev = plane_distance(src[count - 1], plane, guard);
+		for (int i = 0; i < count; i++) {
+			const ClipVertex& prev = src[(i + count - 1) % count];
+			const ClipVertex& cur = src[i];
+			float d_cur = plane_distance(cur, plane, guard);
+			if ((d_prev >= 0) != (d_cur >= 0))
+				dst[next++] = d_prev >= 0 ? intersect(prev, cur, d_prev, d_cur) : intersect(cur, prev, d_cur, d_prev);
+			if (d_cur >= 0)
+				dst[next++] = cur;
+			d_prev = d_cur;
+		}
+		assert(next <= CLIP_MAX_VERTICES);
+		count = next;
+		std::swap(src, dst);
+	}
+	//a polygon that vanished early never reached output
+	return count >= 3 && src == output ? count : 0;
+}
+
+Vector3f project_clip_vertex(const ClipVertex& vertex, const Viewport& viewport)
+{
+	float inv_w = 1.0f / vertex.w;
+	float half_width = viewport.width * 0.5f, half_height = viewport.height * 0.5f;
+	Vector3f screen;
+	screen.x = vertex.x * inv_w * half_width + half_width;
+	screen.y = vertex.y * inv_w * half_height + half_height;
+	//the divide can land a hair outside [0, 1] on the near and far planes
+	screen.z = std::min(std::max(vertex.z * inv_w * 0.5f + 0.5f, 0.0f), 1.0f);
+	return screen;
+}
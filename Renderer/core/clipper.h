@@ -0,0 +1,63 @@
+#ifndef CLIPPER_H
+#define CLIPPER_H
+
+#include "geometry.h"
+#include "vertex_processor.h"
+
+/*
+*  clip-space stage between the vertex stage and triangle setup
+*  every vertex gets an outcode; a triangle with all vertices outside one frustum plane is
+*  rejected, one inside the near and far planes and the guard band goes to setup unchanged, and
+*  only the rest is clipped (Sutherland-Hodgman) against the planes it actually crosses
+*  the side planes of the screen are never clipped against, setup and the bins already cut the
+*  pixels outside, so the guard band is only hit by triangles running far off screen
+*/
+enum ClipPlane
+{
+	CLIP_NEAR = 1 << 0,			//z >= -w
+	CLIP_FAR = 1 << 1,			//z <= w
+	CLIP_LEFT = 1 << 2,			//x >= -w, rejection only
+	CLIP_RIGHT = 1 << 3,
+	CLIP_BOTTOM = 1 << 4,
+	CLIP_TOP = 1 << 5,
+	CLIP_GUARD_LEFT = 1 << 6,	//x >= -guard.x * w
+	CLIP_GUARD_RIGHT = 1 << 7,
+	CLIP_GUARD_BOTTOM = 1 << 8,
+	CLIP_GUARD_TOP = 1 << 9,
+};
+typedef unsigned short ClipCode;
+
+//planes that need clipping, as opposed to the ones that only reject
+static const ClipCode CLIP_NEEDED = CLIP_NEAR | CLIP_FAR | CLIP_GUARD_LEFT | CLIP_GUARD_RIGHT | CLIP_GUARD_BOTTOM | CLIP_GUARD_TOP;
+//a triangle grows by at most one vertex per plane
+static const int CLIP_MAX_VERTICES = 3 + 6;
+
+//guard band of a viewport in clip space: |x| <= x * w and |y| <= y * w stay inside RASTER_GUARD_BAND
+struct ClipGuardBand
+{
+	float x, y;
+};
+
+ClipGuardBand clip_guard_band(const Viewport& viewport);
+
+//vertex of a clipped polygon: clip position and barycentric weights in the source triangle
+struct ClipVertex
+{
+	float x, y, z, w;
+	float weights[3];
+};
+
+//outcode of every vertex of the vertex stage output
+void compute_clip_codes(const PostTransformBuffer& vertices, const ClipGuardBand& guard, ClipCode* codes);
+
+/*
+*  clip triangle against the planes in planes (a subset of CLIP_NEEDED, usually the union of the
+*  vertex outcodes); output gets the convex polygon, returns its vertex count, 0 when nothing is left
+*  a vertex inside every plane is copied unchanged, so its weights stay exactly 0 or 1
+*/
+int clip_triangle(const ClipVertex triangle[3], ClipCode planes, const ClipGuardBand& guard, ClipVertex output[CLIP_MAX_VERTICES]);
+
+//perspective divide and viewport map of a clipped vertex, the same arithmetic as transform_vertices
+Vector3f project_clip_vertex(const ClipVertex& vertex, const Viewport& viewport);
+
+#endif
@@ -0,0 +1,196 @@
+#include "deferred.h"
+#include <assert.h>
+#include <math.h>
+#include <algorithm>
+#include <limits>
+#include "renderer.h"
+#include "gbuffer.h"
+#include "bounds.h"
+#include "thread_pool.h"
+#include "profiler.h"
+#include "pipeline.h"
+#include "shader.h"
+
+bool light_bounds(const PointLight& light, const Matrix4& view_projection, int width, int height, LightBounds* bounds)
+{
+	PixelRect frame = { 0, 0, width - 1, height - 1 };
+	bounds->rect = frame;
+	bounds->min_z = 0.0f;
+	bounds->max_z = 1.0f;
+	if (!(light.radius < std::numeric_limits<float>::infinity()))
+		return true;
+
+	//the box around the sphere, projected: a convex box in front of the eye stays within its projected corners
+	float r = light.radius;
+	BoundingBox box;
+	box.min = Vector3f(light.position.x - r, light.position.y - r, light.position.z - r);
+	box.max = Vector3f(light.position.x + r, light.position.y + r, light.position.z + r);
+	float inf = std::numeric_limits<float>::infinity();
+	float min_x = inf, min_y = inf, min_z = inf, max_x = -inf, max_y = -inf, max_z = -inf;
+	for (int i = 0; i < 8; i++) {
+		Vector4f corner = view_projection * Vector4f(i & 1 ? box.max.x : box.min.x, i & 2 ? box.max.y : box.min.y, i & 4 ? box.max.z : box.min.z, 1.0f);
+		//reaches behind the eye, where projecting bounds nothing: whole frame if it is in view at all
+		if (!(corner.w > 0))
+			return box_in_frustum(frustum_from_matrix(view_projection), box);
+		float inv_w = 1.0f / corner.w;
+		float x = (corner.x * inv_w * 0.5f + 0.5f) * width;
+		float y = (corner.y * inv_w * 0.5f + 0.5f) * height;
+		float z = corner.z * inv_w * 0.5f + 0.5f;
+		min_x = std::min(min_x, x);
+		min_y = std::min(min_y, y);
+		min_z = std::min(min_z, z);
+		max_x = std::max(max_x, x);
+		max_y = std::max(max_y, y);
+		max_z = std::max(max_z, z);
+	}
+	if (max_x < 0 || max_y < 0 || min_x >= width || min_y >= height || max_z < 0 || min_z > 1)
+		return false;
+	bounds->rect.min_x = (int)floorf(std::max(min_x, 0.0f));
+	bounds->rect.min_y = (int)floorf(std::max(min_y, 0.0f));
+	bounds->rect.max_x = (int)floorf(std::min(max_x, width - 1.0f));
+	bounds->rect.max_y = (int)floorf(std::min(max_y, height - 1.0f));
+	bounds->min_z = std::max(min_z, 0.0f);
+	bounds->max_z = std::min(max_z, 1.0f);
+	return true;
+}
+
+DeferredLighting::DeferredLighting(int width, int height)
+{
+	assert(width > 0 && height > 0);
+	width_ = width;
+	height_ = height;
+	tiles_x_ = (width + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+	tiles_y_ = (height + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+	tile_lights_ = vector<vector<int>>(tiles_x_ * tiles_y_);
+}
+
+void DeferredLighting::Shade(const GBuffer& gbuffer, const PointLight* lights, int light_num, const Material* materials,
+	const Matrix4& view_projection, const Vector3f& eye, FrameBuffer* framebuffer, ThreadPool* thread_pool, RasterStats* stats)
+{
+	assert(gbuffer.width() == width_ && gbuffer.height() == height_);
+	assert(framebuffer->width() == width_ && framebuffer->height() == height_ && framebuffer->has_depth());
+	assert(light_num == 0 || lights != NULL);
+	//positions are rebuilt from depth through the inverse, a singular view sees no surfaces anyway
+	Matrix4 inverse = view_projection;
+	if (!inverse.Inverse())
+		return;
+
+	{
+		ProfileScope scope(STAGE_SHADE);
+		for (size_t i = 0; i < tile_lights_.size(); i++)
+			tile_lights_[i].clear();
+		bounds_.resize(light_num);
+		for (int i = 0; i < light_num; i++) {
+			const LightBounds& bounds = bounds_[i];
+			if (!light_bounds(lights[i], view_projection, width_, height_, &bounds_[i]))
+				continue;
+			for (int ty = bounds.rect.min_y / LIGHT_TILE_SIZE; ty <= bounds.rect.max_y / LIGHT_TILE_SIZE; ty++) {
+				for (int tx = bounds.rect.min_x / LIGHT_TILE_SIZE; tx <= bounds.rect.max_x / LIGHT_TILE_SIZE; tx++)
+					tile_lights_[ty * tiles_x_ + tx].push_back(i);
+			}
+		}
+	}
+
+	workers_.resize(thread_pool->size());
+	for (size_t i = 0; i < workers_.size(); i++) {
+		workers_[i].lit_pixels = 0;
+		workers_[i].light_samples = 0;
+	}
+	thread_pool->ParallelFor(tile_count(), [&](int tile, int worker) {
+		ProfileScope scope(STAGE_SHADE);
+		ShadeTile(tile, gbuffer, lights, materials, inverse, eye, framebuffer, &workers_[worker]);
+	});
+	for (size_t i = 0; i < workers_.size(); i++) {
+		stats->lit_pixels += workers_[i].lit_pixels;
+		stats->light_samples += workers_[i].light_samples;
+	}
+}
+
+static inline float read_depth(DepthFormat format, const Byte* row, int x)
+{
+	if (format == DEPTH_FLOAT32)
+		return ((const float*)row)[x];
+	return ((const unsigned int*)row)[x] / DEPTH_UNORM24_MAX;
+}
+
+void DeferredLighting::ShadeTile(int tile, const GBuffer& gbuffer, const PointLight* lights, const Material* materials,
+	const Matrix4& inverse, const Vector3f& eye, FrameBuffer* framebuffer, Worker* worker) const
+{
+	int tx = tile % tiles_x_, ty = tile / tiles_x_;
+	int x0 = tx * LIGHT_TILE_SIZE, x1 = std::min(x0 + LIGHT_TILE_SIZE, width_);
+	int y0 = ty * LIGHT_TILE_SIZE, y1 = std::min(y0 + LIGHT_TILE_SIZE, height_);
+	DepthFormat depth_format = framebuffer->depth_format();
+
+	//depth range of the surfaces in the tile, tiles without any are done
+	float min_z = std::numeric_limits<float>::infinity(), max_z = -min_z;
+	for (int y = y0; y < y1; y++) {
+		const Byte* albedo = gbuffer.albedo_row(y);
+		const Byte* depth = framebuffer->depth_row(y);
+		for (int x = x0; x < x1; x++) {
+			if (albedo[x * 4 + 3] == GBUFFER_EMPTY)
+				continue;
+			float z = read_depth(depth_format, depth, x);
+			min_z = std::min(min_z, z);
+			max_z = std::max(max_z, z);
+		}
+	}
+	if (min_z > max_z)
+		return;
+
+	//copies of the lights that reach into that range
+	vector<PointLight>& tile_lights = worker->lights;
+	tile_lights.clear();
+	const vector<int>& candidates = tile_lights_[tile];
+	for (size_t i = 0; i < candidates.size(); i++) {
+		const LightBounds& bounds = bounds_[candidates[i]];
+		if (bounds.max_z >= min_z && bounds.min_z <= max_z)
+			tile_lights.push_back(lights[candidates[i]]);
+	}
+	const PointLight* tile_light_data = tile_lights.empty() ? NULL : tile_lights.data();
+	int tile_light_num = (int)tile_lights.size();
+
+	float m[4][4];
+	for (int row = 0; row < 4; row++) {
+		for (int col = 0; col < 4; col++)
+			m[row][col] = inverse(row, col);
+	}
+	float scale_x = 2.0f / width_, scale_y = 2.0f / height_;
+	int pixel_size = framebuffer->pixel_size();
+	long long lit = 0;
+	for (int y = y0; y < y1; y++) {
+		const Byte* albedo_row = gbuffer.albedo_row(y);
+		const unsigned int* normal_row = gbuffer.normal_row(y);
+		const Byte* depth = framebuffer->depth_row(y);
+		Byte* row = framebuffer->row(y);
+		//inverse * (ndc x, ndc y, ndc z, 1), with the parts that only change per row summed up front
+		float ndc_y = (y + 0.5f) * scale_y - 1.0f;
+		float base[4];
+		for (int r = 0; r < 4; r++)
+			base[r] = m[r][1] * ndc_y + m[r][3];
+
+		for (int x = x0; x < x1; x++) {
+			const Byte* albedo = albedo_row + x * 4;
+			if (albedo[3] == GBUFFER_EMPTY)
+				continue;
+			float ndc_x = (x + 0.5f) * scale_x - 1.0f;
+			float ndc_z = read_depth(depth_format, depth, x) * 2.0f - 1.0f;
+			float p[4];
+			for (int r = 0; r < 4; r++)
+				p[r] = base[r] + m[r][0] * ndc_x + m[r][2] * ndc_z;
+			float inv_w = 1.0f / p[3];
+			float position[3] = { p[0] * inv_w, p[1] * inv_w, p[2] * inv_w };
+
+			float normal[3];
+			decode_normal(normal_row[x], normal);
+			float view[3] = { eye.x - position[0], eye.y - position[1], eye.z - position[2] };
+			shader_normalize(view);
+			float surface[3] = { albedo[0] * (1.0f / 255), albedo[1] * (1.0f / 255), albedo[2] * (1.0f / 255) };
+			float color[3];
+			shade_point_lights(position, normal, view, surface, materials[albedo[3]], tile_light_data, tile_light_num, color);
+			store_pixel(framebuffer, row + x * pixel_size, color[0], color[1], color[2], 1.0f);
+			lit++;
+		}
+	}
+	worker->lit_pixels += lit;
+	worker->light_samples += lit * tile_light_num;
+}
@@ -0,0 +1,72 @@
+#ifndef DEFERRED_H
+#define DEFERRED_H
+
+#include <vector>
+#include "geometry.h"
+#include "matrix.h"
+#include "light.h"
+#include "rasterizer.h"
+
+class FrameBuffer;
+class GBuffer;
+class ThreadPool;
+
+using std::vector;
+
+//side of the square screen tiles that keep their own light list
+static const int LIGHT_TILE_SIZE = 32;
+
+//conservative screen area and depth range of the sphere a light reaches
+struct LightBounds
+{
+	PixelRect rect;		//clipped to the framebuffer
+	float min_z, max_z;	//framebuffer depth in [0, 1]
+};
+
+//bounds of light on a width x height framebuffer seen through view_projection, false when it reaches nothing in view
+bool light_bounds(const PointLight& light, const Matrix4& view_projection, int width, int height, LightBounds* bounds);
+
+/*
+*  lighting pass of the deferred path: lights are binned into LIGHT_TILE_SIZE tiles by their
+*  screen bounds, then every tile drops the lights outside the depth range of its surfaces and
+*  shades each surface pixel once with the rest; tiles are spread over the thread pool
+*/
+class DeferredLighting
+{
+public:
+	DeferredLighting(int width, int height);
+
+	/*
+	*  light the surfaces of gbuffer into the framebuffer with the same size, whose depth plane
+	*  holds their depth; view_projection is the one they were drawn with and eye the world space
+	*  camera position, see shade_point_lights; empty pixels keep their color
+	*/
+	void Shade(const GBuffer& gbuffer, const PointLight* lights, int light_num, const Material* materials,
+		const Matrix4& view_projection, const Vector3f& eye, FrameBuffer* framebuffer, ThreadPool* thread_pool, RasterStats* stats);
+
+	int tile_count() const { return tiles_x_ * tiles_y_; }
+	//lights whose screen bounds cover tile in the last Shade, before the depth test
+	const vector<int>& tile_lights(int tile) const { return tile_lights_[tile]; }
+
+private:
+	//per worker, the lights of the tile being shaded and what it counted
+	struct Worker
+	{
+		vector<PointLight> lights;
+		long long lit_pixels;
+		long long light_samples;
+	};
+
+	void ShadeTile(int tile, const GBuffer& gbuffer, const PointLight* lights, const Material* materials,
+		const Matrix4& inverse, const Vector3f& eye, FrameBuffer* framebuffer, Worker* worker) const;
+
+	int width_;
+	int height_;
+	int tiles_x_;
+	int tiles_y_;
+	vector<LightBounds> bounds_;	//of every light in the last Shade
+	vector<vector<int>> tile_lights_;
+	vector<Worker> workers_;
+};
+
+#endif
@@ -0,0 +1,27 @@
+#include "gbuffer.h"
+#include <string.h>
+
+static const int GBUFFER_ALIGNMENT = 64;
+
+GBuffer::GBuffer(int width, int height)
+{
+	assert(width > 0 && height > 0);
+	width_ = width;
+	height_ = height;
+	pitch_ = (width * 4 + GBUFFER_ALIGNMENT - 1) / GBUFFER_ALIGNMENT * GBUFFER_ALIGNMENT;
+	normals_ = (Byte*)AlignedMalloc((size_t)pitch_ * height, GBUFFER_ALIGNMENT);
+	albedo_ = (Byte*)AlignedMalloc((size_t)pitch_ * height, GBUFFER_ALIGNMENT);
+	Clear();
+}
+
+GBuffer::~GBuffer()
+{
+	AlignedFree(normals_);
+	AlignedFree(albedo_);
+}
+
+void GBuffer::Clear()
+{
+	//white albedo and GBUFFER_EMPTY in every byte
+	memset(albedo_, GBUFFER_EMPTY, (size_t)pitch_ * height_);
+}
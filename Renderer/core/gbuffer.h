@@ -0,0 +1,103 @@
+#ifndef GBUFFER_H
+#define GBUFFER_H
+
+#include <assert.h>
+#include <stddef.h>
+#include <math.h>
+#include "utils.h"
+
+typedef unsigned char Byte;
+
+//material id of pixels no surface was written to
+static const Byte GBUFFER_EMPTY = 255;
+
+//surface of one pixel as the geometry pass of the deferred path hands it over
+struct GBufferSample
+{
+	float normal[3];	//world space, unit length
+	float albedo[3];	//rgb in [0, 1]
+	int material;		//index into the materials of the scene
+};
+
+//unit normal folded onto an octahedron, its two coordinates in 16-bit fixed point
+inline unsigned int encode_normal(const float n[3])
+{
+	float l1 = fabsf(n[0]) + fabsf(n[1]) + fabsf(n[2]);
+	float inv = l1 > 0 ? 1.0f / l1 : 0.0f;
+	float u = n[0] * inv, v = n[1] * inv;
+	if (n[2] < 0) {
+		//lower half mirrored over the diagonals into the corners
+		float folded_u = (1.0f - fabsf(v)) * (u >= 0 ? 1.0f : -1.0f);
+		float folded_v = (1.0f - fabsf(u)) * (v >= 0 ? 1.0f : -1.0f);
+		u = folded_u;
+		v = folded_v;
+	}
+	unsigned int qu = (unsigned int)((u * 0.5f + 0.5f) * 65535.0f + 0.5f);
+	unsigned int qv = (unsigned int)((v * 0.5f + 0.5f) * 65535.0f + 0.5f);
+	return qu | (qv << 16);
+}
+
+//unit normal of encode_normal; a zero normal comes back as +z
+inline void decode_normal(unsigned int value, float n[3])
+{
+	float u = (value & 0xFFFF) * (2.0f / 65535.0f) - 1.0f;
+	float v = (value >> 16) * (2.0f / 65535.0f) - 1.0f;
+	float z = 1.0f - fabsf(u) - fabsf(v);
+	if (z < 0) {
+		float unfolded_u = (1.0f - fabsf(v)) * (u >= 0 ? 1.0f : -1.0f);
+		float unfolded_v = (1.0f - fabsf(u)) * (v >= 0 ? 1.0f : -1.0f);
+		u = unfolded_u;
+		v = unfolded_v;
+	}
+	float inv = 1.0f / sqrtf(u * u + v * v + z * z);
+	n[0] = u * inv;
+	n[1] = v * inv;
+	n[2] = z * inv;
+}
+
+/*
+*  surface planes of the deferred path, the same size and row order as the framebuffer whose depth
+*  plane they go with: 4 bytes of encoded normal and 4 bytes of rgb albedo plus material id per
+*  pixel, 64-byte aligned rows
+*  Clear only marks every pixel empty, normal and albedo of empty pixels are never read
+*/
+class GBuffer
+{
+public:
+	GBuffer(int width, int height);
+	~GBuffer();
+
+	GBuffer(const GBuffer&) = delete;
+	GBuffer& operator=(const GBuffer&) = delete;
+
+	void Clear();
+	void Store(int x, int y, const GBufferSample& sample)
+	{
+		assert(x >= 0 && x < width_ && sample.material >= 0 && sample.material < GBUFFER_EMPTY);
+		normal_row(y)[x] = encode_normal(sample.normal);
+		Byte* albedo = albedo_row(y) + x * 4;
+		albedo[0] = FloatToByte(sample.albedo[0]);
+		albedo[1] = FloatToByte(sample.albedo[1]);
+		albedo[2] = FloatToByte(sample.albedo[2]);
+		albedo[3] = (Byte)sample.material;
+	}
+	//material id of pixel (x, y), GBUFFER_EMPTY when nothing was stored since Clear
+	int material(int x, int y) const { assert(x >= 0 && x < width_); return albedo_row(y)[x * 4 + 3]; }
+
+	//width() encoded normals of row y, see decode_normal
+	unsigned int* normal_row(int y) const { assert(y >= 0 && y < height_); return (unsigned int*)(normals_ + (size_t)y * pitch_); }
+	//width() pixels of row y as r, g, b, material id
+	Byte* albedo_row(int y) const { assert(y >= 0 && y < height_); return albedo_ + (size_t)y * pitch_; }
+
+	int width() const { return width_; }
+	int height() const { return height_; }
+
+private:
+	int width_;
+	int height_;
+	int pitch_;			//bytes per row of either plane
+	Byte* normals_;
+	Byte* albedo_;
+};
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef GEOMETRY_H
 #define GEOMETRY_H
 
+#include <math.h>
 #include <algorithm>
 
 template <typename T>
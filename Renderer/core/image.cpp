@@ -1,18 +1,16 @@
 #include "image.h"
 #include <assert.h>
+#include <string.h>
 #include <algorithm>
+#include <chrono>
 #include "utils.h"
+#include "resample.h"
 
 Image::Image(int width, int height, int channels)
 {
 	assert(width > 0 && height > 0 && channels >= 1 && channels <= 4);
-	width_ = width;
-	height_ = height;
-	channels_ = channels;
-
-	int data_size = width * height * channels;
-	data_ = new Byte[data_size];
-	memset(data_, 0, data_size);
+	Allocate(width, height, channels);
+	memset(data_, 0, data_size());
 }
 
 Image::Image(int width, int height, int channels, Byte* data)
@@ -22,39 +20,93 @@ Image::Image(int width, int height, int channels, Byte* data)
 	height_ = height;
 	channels_ = channels;
 	data_ = data;
+	storage_ = std::shared_ptr<Byte>(data, std::default_delete<Byte[]>());
 }
 
 Image::Image(const Image& image)
+{
+	Allocate(image.width_, image.height_, image.channels_);
+	memcpy(data_, image.data_, data_size());
+}
+
+Image::Image(Image&& image)
 {
 	width_ = image.width_;
 	height_ = image.height_;
 	channels_ = image.channels_;
+	data_ = image.data_;
+	storage_ = std::move(image.storage_);
 
-	int data_size = width_ * height_ * channels_;
-	data_ = new Byte[data_size];
-	memcpy(data_, image.data_, data_size);
+	image.width_ = image.height_ = image.channels_ = 0;
+	image.data_ = NULL;
 }
 
 Image::~Image()
 {
-	delete[] data_;
 }
 
 Image& Image::operator=(const Image& image)
 {
+	if (this == &image)
+		return *this;
+
+	//reuse our own pixels when nobody else sees them and the size matches
+	if (shared() || data_size() != image.data_size() || data_ == NULL)
+		Allocate(image.width_, image.height_, image.channels_);
 	width_ = image.width_;
 	height_ = image.height_;
 	channels_ = image.channels_;
+	memcpy(data_, image.data_, data_size());
 
-	delete[] data_; //release resourcePtr before change it
+	return *this;
+}
 
-	int data_size = width_ * height_ * channels_;
-	data_ = new Byte[data_size];
-	memcpy(data_, image.data_, data_size);
+Image& Image::operator=(Image&& image)
+{
+	if (this == &image)
+		return *this;
 
+	width_ = image.width_;
+	height_ = image.height_;
+	channels_ = image.channels_;
+	data_ = image.data_;
+	storage_ = std::move(image.storage_);
+
+	image.width_ = image.height_ = image.channels_ = 0;
+	image.data_ = NULL;
 	return *this;
 }
 
+Image::Image(const Image& image, ShareTag)
+{
+	width_ = image.width_;
+	height_ = image.height_;
+	channels_ = image.channels_;
+	data_ = image.data_;
+	storage_ = image.storage_;
+}
+
+Image Image::Share() const
+{
+	return Image(*this, ShareTag());
+}
+
+void Image::Allocate(int width, int height, int channels)
+{
+	width_ = width;
+	height_ = height;
+	channels_ = channels;
+	data_ = new Byte[data_size()];
+	storage_ = std::shared_ptr<Byte>(data_, std::default_delete<Byte[]>());
+}
+
+void Image::set_data(Byte * data)
+{
+	assert(data != NULL);
+	data_ = data;
+	storage_ = std::shared_ptr<Byte>(data, std::default_delete<Byte[]>());
+}
+
 Byte* Image::GetPixel(int x, int y) const
 {
 	int index = y * width_ * channels_ + x * channels_;
@@ -68,66 +120,84 @@ Byte* Image::GetPixel(int x, int y) const
 /*
 *  tga format
 */
-void Image::LoadFromTGA(const char *filePath)
+bool Image::LoadFromTGA(const char *filePath, ImageLoadStats *stats)
 {
-	Byte header[TGA_HEADER_SIZE];
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 	int width, height, depth, channels;
 	int idlength, imgtype, imgdesc;
-	FILE *file;
+	MappedFile file;
 
-	file = fopen(filePath, "rb");
-	assert(file != NULL);
-	ReadBytes(file, header, TGA_HEADER_SIZE);
+	if (!file.Open(filePath) || file.size() < TGA_HEADER_SIZE)
+		return false;
+	const Byte *header = file.data();
 
 	width = header[12] | (header[13] << 8);
 	height = header[14] | (header[15] << 8);
-	assert(width > 0 && height > 0);
 	depth = header[16];
-	assert(depth == 8 || depth == 24 || depth == 32);
+	if (width <= 0 || height <= 0 || (depth != 8 && depth != 24 && depth != 32))
+		return false;
 	channels = depth / 8;
-	Image loadIMG(width, height, channels);
 
+	//the image id field sits between the header and the pixels
 	idlength = header[0];
-	assert(idlength == 0);
+	if (file.size() < TGA_HEADER_SIZE + (size_t)idlength)
+		return false;
+	const Byte *pixels = header + TGA_HEADER_SIZE + idlength;
+	size_t pixels_size = file.size() - TGA_HEADER_SIZE - idlength;
 	imgtype = header[2];
+	imgdesc = header[17];
+	if (imgtype != 2 && imgtype != 3 && imgtype != 10 && imgtype != 11)
+		return false;
+	//uncompressed pixels must all be there, run-length encoded ones are checked while decoding
+	if ((imgtype == 2 || imgtype == 3) && (size_t)width * height * channels > pixels_size)
+		return false;
+
+	//decode straight into the final buffer
+	Allocate(width, height, channels);
+
+	bool flip_vertical = (imgdesc & 0x20) != 0;
 	if (imgtype == 2 || imgtype == 3) {           /* uncompressed */
-		ReadBytes(file, loadIMG.data(), loadIMG.data_size());
+		size_t row_size = (size_t)width * channels;
+		//top-left files are flipped while copying
+		for (int row = 0; row < height; row++) {
+			int dst_row = flip_vertical ? height - 1 - row : row;
+			memcpy(data_ + dst_row * row_size, pixels + row * row_size, row_size);
+		}
+		flip_vertical = false;
 	}
-	else if (imgtype == 10 || imgtype == 11) {  /* run-length encoded */
-		LoadTGA(file, &loadIMG);
+	else {                                        /* run-length encoded */
+		if (!LoadTGA(pixels, pixels_size, this))
+			return false;
 	}
-	else {
-		assert(0);
-	}
-	fclose(file);
 
-	imgdesc = header[17];
-	if (imgdesc & 0x20) {
-		loadIMG.FlipVertical();
+	if (flip_vertical) {
+		FlipVertical();
 	}
 	if (imgdesc & 0x10) {
-		loadIMG.FlipHorizontal();
+		FlipHorizontal();
+	}
+
+	if (stats != NULL) {
+		stats->file_size = file.size();
+		stats->decoded_size = data_size();
+		stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 	}
-	
-	(*this) = loadIMG;
+	return true;
 }
 
-void Image::LoadFromFile(const char *filePath)
+bool Image::LoadFromFile(const char *filePath, ImageLoadStats *stats)
 {
 	const char *ext = GetExtension(filePath);
-	if (strcmp(ext, "tga") == 0) {
-		LoadFromTGA(filePath);
-	}
-	else {
-		assert(0);
-	}
+	if (strcmp(ext, "tga") == 0)
+		return LoadFromTGA(filePath, stats);
+	return false;
 }
 
 void Image::SaveAsFile(const char *filePath) const
 {
 	const char *ext = GetExtension(filePath);
 	if (strcmp(ext, "tga") == 0) {
-		SaveTGA(this, filePath);
+		SaveTGA(view(), filePath);
 	}
 	else {
 		assert(0);
@@ -177,43 +247,12 @@ void Image::FlipVertical() const
 	}
 }
 
-void Image::Resize(int width, int height) 
+void Image::Resize(int width, int height, ResampleFilter filter, ThreadPool* pool)
 {
 	assert(width > 0 && height > 0);
 	Image target(width, height, channels_);
-	float scale_row = (float)height_ / (float)height;
-	float scale_col = (float)width_ / (float)width;
-
-	for (int dst_row = 0; dst_row < height; dst_row++) {
-		for (int dst_col = 0; dst_col < width; dst_col++) {
-			float mapped_r = (float)dst_row * scale_row;
-			float mapped_c = (float)dst_col * scale_col;
-			int src_r0 = (int)mapped_r;
-			int src_c0 = (int)mapped_c;
-			int src_r1 = std::min(src_r0 + 1, height_ - 1);
-			int src_c1 = std::min(src_c0 + 1, width_ - 1);
-			float delta_r = mapped_r - (float)src_r0;
-			float delta_c = mapped_c - (float)src_c0;
-
-			Byte *pixel_00 = GetPixel(src_c0, src_r0);
-			Byte *pixel_01 = GetPixel(src_c1, src_r0);
-			Byte *pixel_10 = GetPixel(src_c0, src_r1);
-			Byte *pixel_11 = GetPixel(src_c1, src_r1);
-			Byte *pixel = target.GetPixel(dst_col, dst_row);
-			for (int k = 0; k < channels_; k++) {
-				float v00 = pixel_00[k];  /* row 0, col 0 */
-				float v01 = pixel_01[k];  /* row 0, col 1 */
-				float v10 = pixel_10[k];  /* row 1, col 0 */
-				float v11 = pixel_11[k];  /* row 1, col 1 */
-				float v0 = Lerp(v00, v01, delta_c);  /* row 0 */
-				float v1 = Lerp(v10, v11, delta_c);  /* row 1 */
-				float value = Lerp(v0, v1, delta_r);
-				pixel[k] = (Byte)(value + 0.5f);
-			}
-		}
-	}
-	
-	(*this) = target;
+	resample_image(view(), target.view(), filter, pool);
+	(*this) = std::move(target);
 }
 
 void Image::Reset() const 
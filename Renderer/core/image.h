@@ -1,26 +1,78 @@
 #ifndef IMAGE_H
 #define IMAGE_H
 
+#include <stddef.h>
+#include <memory>
+
+class ThreadPool;
+
 typedef unsigned char Byte;
 
 static const int TGA_HEADER_SIZE = 18;
 
+//reconstruction filter of Resize, by growing support: 1, 2, 4 and 6 source pixels across at scale 1
+typedef enum { FILTER_BOX = 0, FILTER_BILINEAR, FILTER_BICUBIC, FILTER_LANCZOS3, FILTER_NUM } ResampleFilter;
+
+//cost of one LoadFromFile
+struct ImageLoadStats
+{
+	size_t file_size;		//bytes read from disk
+	size_t decoded_size;	//bytes of pixel data produced
+	double seconds;
+
+	double megabytes_per_second() const { return seconds > 0 ? file_size / (1024.0 * 1024.0) / seconds : 0; }
+};
+
+//non-owning window onto pixels kept elsewhere, rows pitch bytes apart, row 0 at the bottom
+struct ImageView
+{
+	int width;
+	int height;
+	int channels;
+	int pitch;
+	Byte *data;
+
+	ImageView() : width(0), height(0), channels(0), pitch(0), data(NULL) {}
+	ImageView(int _width, int _height, int _channels, Byte *_data, int _pitch = 0)
+		: width(_width), height(_height), channels(_channels), pitch(_pitch ? _pitch : _width * _channels), data(_data) {}
+
+	Byte *row(int y) const { return data + (size_t)y * pitch; }
+	Byte *GetPixel(int x, int y) const { return row(y) + x * channels; }
+	bool empty() const { return data == NULL; }
+};
+
+/*
+*  pixels live in reference-counted storage: copies are deep, moves and Share() only pass the
+*  storage on, so a loaded texture can reach the renderer and the display without any copy
+*/
 class Image
 {
  public:
 	 Image(int width = 1, int height = 1, int channels = 4);
+	 //takes ownership of data, which must come from new[]
 	 Image(int width, int height, int channels, Byte* data);
 	 Image(const Image& image);
+	 //image is left empty (0 x 0, no data)
+	 Image(Image&& image);
 	 ~Image();
 
 	 Image& operator=(const Image& image);
+	 Image& operator=(Image&& image);
+
+	 //another image on the same pixels, changes through either are seen by both
+	 Image Share() const;
+	 //whether other images share the pixels
+	 bool shared() const { return storage_.use_count() > 1; }
+	 ImageView view() const { return ImageView(width_, height_, channels_, data_); }
 
-	 void LoadFromFile(const char *filePath);
+	 //stats, when given, receives the size and time of the load; returns false when the file cannot be read
+	 bool LoadFromFile(const char *filePath, ImageLoadStats *stats = NULL);
 	 void SaveAsFile(const char *filePath) const ;
 
 	 void FlipHorizontal() const; //flip left and right
 	 void FlipVertical() const;	//flip up and down
-	 void Resize(int width, int height);
+	 //rows are spread over pool when one is given
+	 void Resize(int width, int height, ResampleFilter filter = FILTER_BILINEAR, ThreadPool* pool = NULL);
 	 void Reset() const;
 
 	 Byte *GetPixel(int x, int y) const;
@@ -34,16 +86,23 @@ class Image
 	//void set_width(int width) { width_ = width; }
 	//void set_height(int height) { height_ = height; }
 	//void set_channels(int channels) { channels_ = channels; }
-	void set_data(Byte * data) { delete[] data_; data_ = data; }
+	//replace the pixels (same size, from new[]), images sharing the old pixels keep them
+	void set_data(Byte * data);
 
 
 private:
-	void LoadFromTGA(const char *filePath);
+	struct ShareTag {};
+	Image(const Image& image, ShareTag);
+
+	bool LoadFromTGA(const char *filePath, ImageLoadStats *stats);
+	//fresh, unshared and uninitialized storage
+	void Allocate(int width, int height, int channels);
 
 	int width_;
 	int height_;
 	int channels_;
-	Byte *data_;
+	Byte *data_;	//storage_.get(), cached
+	std::shared_ptr<Byte> storage_;
 };
 
 #endif
@@ -0,0 +1,22 @@
+#ifndef LIGHT_H
+#define LIGHT_H
+
+#include "geometry.h"
+
+//point light in world space, its light fades to zero at radius, see shade_point_lights
+struct PointLight
+{
+	Vector3f position;
+	float color[3];		//rgb intensity
+	float radius;		//infinity for a light that reaches everything
+};
+
+//blinn-phong terms shared by all surfaces of a material, the surfaces bring their own color
+struct Material
+{
+	float ambient;
+	float specular;		//strength of the white highlight
+	float shininess;
+};
+
+#endif
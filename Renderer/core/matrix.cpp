@@ -1,132 +1,287 @@
 #include "matrix.h"
+#include <math.h>
+#include <string.h>
+#include "simd.h"
 
 //declare constructor
-Matrix::Matrix(int row, int col)
+Matrix4::Matrix4()
 {
-	rows_ = row;
-	cols_ = col;
-	data_ = vector<vector<float>>(row, vector<float>(col, 0.0f)); //(size, element);
+	memset(data_, 0, sizeof(data_));
 }
 
-//copy constructor
-Matrix::Matrix(const Matrix& mat)
+Matrix4::Matrix4(const Vector4f& vec0, const Vector4f& vec1, const Vector4f& vec2, const Vector4f& vec3)
 {
-	for (int i = 0; i < mat.row(); i++) {
-		for (int j = 0; j < mat.col(); j++)
-			data_[i][j] = mat.data_[i][j];
+	const Vector4f *columns[Dimension] = { &vec0, &vec1, &vec2, &vec3 };
+	for (int i = 0; i < Dimension; i++) {
+		data_[i][0] = columns[i]->x;
+		data_[i][1] = columns[i]->y;
+		data_[i][2] = columns[i]->z;
+		data_[i][3] = columns[i]->w;
 	}
 }
 
-Matrix::Matrix(const Vector4f& vec0, const Vector4f& vec1, const Vector4f& vec2, const Vector4f& vec3)
+/*
+*  every product below is evaluated as ((c0 * x + c1 * y) + c2 * z) + c3 * w with separate
+*  multiplies and adds, so the sse and the scalar paths give identical results
+*/
+#if SIMD_X86
+static inline __m128 transform_sse(const __m128 columns[4], __m128 vec)
 {
-	rows_ = Dimension;
-	cols_ = Dimension;
-	data_ = vector<vector<float>>(Dimension, vector<float>(Dimension, 0.0)); //(size, element);
-	data_[0][0] = vec0.x; data_[0][1] = vec1.x; data_[0][2] = vec2.x; data_[0][3] = vec3.x;
-	data_[1][0] = vec0.y; data_[1][1] = vec1.y; data_[1][2] = vec2.y; data_[1][3] = vec3.y;
-	data_[2][0] = vec0.z; data_[2][1] = vec1.z; data_[2][2] = vec2.z; data_[2][3] = vec3.z;
-	data_[3][0] = vec0.w; data_[3][1] = vec1.w; data_[3][2] = vec2.w; data_[3][3] = vec3.w;
+	__m128 x = _mm_shuffle_ps(vec, vec, _MM_SHUFFLE(0, 0, 0, 0));
+	__m128 y = _mm_shuffle_ps(vec, vec, _MM_SHUFFLE(1, 1, 1, 1));
+	__m128 z = _mm_shuffle_ps(vec, vec, _MM_SHUFFLE(2, 2, 2, 2));
+	__m128 w = _mm_shuffle_ps(vec, vec, _MM_SHUFFLE(3, 3, 3, 3));
+	__m128 result = _mm_add_ps(_mm_mul_ps(columns[0], x), _mm_mul_ps(columns[1], y));
+	result = _mm_add_ps(result, _mm_mul_ps(columns[2], z));
+	return _mm_add_ps(result, _mm_mul_ps(columns[3], w));
 }
 
-//assign operator overload
-Matrix& Matrix::operator =(const Matrix& mat)
+static inline void load_columns(const float data[Dimension][Dimension], __m128 columns[4])
 {
-	assert(rows_ == mat.row() && cols_ == mat.col());
-	for (int i = 0; i < rows_; i++)
-		for (int j = 0; j < cols_; j++)
-			data_[i][j] = mat.data_[i][j];
-
-	return *this;
+	for (int i = 0; i < Dimension; i++) {
+		columns[i] = _mm_load_ps(data[i]);
+	}
 }
-
-Matrix Matrix::operator *(const Matrix& mat) const
+#else
+static inline void transform_scalar(const float data[Dimension][Dimension], const float vec[4], float result[4])
 {
-	assert(cols_ == mat.row());
+	for (int row = 0; row < Dimension; row++) {
+		result[row] = data[0][row] * vec[0] + data[1][row] * vec[1] + data[2][row] * vec[2] + data[3][row] * vec[3];
+	}
+}
+#endif
 
-	Matrix result(rows_, mat.col());
-	for (int i = 0; i < rows_; i++) {
-		for (int j = 0; j < mat.col(); j++) {
-			result.data_[i][j] = 0;
-			for (int k = 0; k < cols_; k++)
-				result.data_[i][j] += data_[i][k] * mat.data_[k][j];
-		}
+Matrix4 Matrix4::operator *(const Matrix4& mat) const
+{
+	Matrix4 result;
+#if SIMD_X86
+	__m128 columns[4];
+	load_columns(data_, columns);
+	for (int i = 0; i < Dimension; i++) {
+		_mm_store_ps(result.data_[i], transform_sse(columns, _mm_load_ps(mat.data_[i])));
 	}
+#else
+	for (int i = 0; i < Dimension; i++) {
+		transform_scalar(data_, mat.data_[i], result.data_[i]);
+	}
+#endif
 	return result;
 }
 
-Matrix Matrix::operator *(float t) const
+Matrix4 Matrix4::operator *(float t) const
 {
-	Matrix result(rows_, cols_);
-	for (int i = 0; i < rows_; i++) {
-		for (int j = 0; j < cols_; j++) {
+	Matrix4 result;
+	for (int i = 0; i < Dimension; i++) {
+		for (int j = 0; j < Dimension; j++) {
 			result.data_[i][j] = data_[i][j] * t;
 		}
 	}
 	return result;
 }
 
-Matrix operator *(float t, const Matrix& mat)
+Vector4f Matrix4::operator *(const Vector4f& vec) const
 {
-	Matrix result(mat.row(), mat.col());
-	for (int i = 0; i < mat.row(); i++) {
-		for (int j = 0; j < mat.col(); j++)
-			result.data_[i][j] = mat.data_[i][j] * t;
-	}
+	Vector4f result;
+	Transform(&vec, &result, 1);
 	return result;
 }
 
-Vector4f Matrix::operator *(const Vector4f& vec) const
+void Matrix4::Transform(const Vector4f* src, Vector4f* dst, int count) const
 {
-	Vector4f result;
-	result.x = data_[0][0] * vec.x + data_[0][1] * vec.y + data_[0][2] * vec.z + data_[0][3] * vec.w;
-	result.y = data_[1][0] * vec.x + data_[1][1] * vec.y + data_[1][2] * vec.z + data_[1][3] * vec.w;
-	result.z = data_[2][0] * vec.x + data_[2][1] * vec.y + data_[2][2] * vec.z + data_[2][3] * vec.w;
-	result.w = data_[3][0] * vec.x + data_[3][1] * vec.y + data_[3][2] * vec.z + data_[3][3] * vec.w;
+	assert(count >= 0);
+#if SIMD_X86
+	__m128 columns[4];
+	load_columns(data_, columns);
+	for (int i = 0; i < count; i++) {
+		_mm_storeu_ps(&dst[i].x, transform_sse(columns, _mm_loadu_ps(&src[i].x)));
+	}
+#else
+	for (int i = 0; i < count; i++) {
+		float vec[4] = { src[i].x, src[i].y, src[i].z, src[i].w };
+		transform_scalar(data_, vec, &dst[i].x);
+	}
+#endif
+}
 
-	return result;
+void Matrix4::Transform(const Vector3f* src, Vector4f* dst, int count) const
+{
+	assert(count >= 0);
+#if SIMD_X86
+	__m128 columns[4];
+	load_columns(data_, columns);
+	for (int i = 0; i < count; i++) {
+		__m128 vec = _mm_set_ps(1.0f, src[i].z, src[i].y, src[i].x);
+		_mm_storeu_ps(&dst[i].x, transform_sse(columns, vec));
+	}
+#else
+	for (int i = 0; i < count; i++) {
+		float vec[4] = { src[i].x, src[i].y, src[i].z, 1.0f };
+		transform_scalar(data_, vec, &dst[i].x);
+	}
+#endif
 }
 
-Matrix Matrix::Transpose()
+Matrix4 Matrix4::Transpose() const
 {
-	Matrix result;
-	for (int i = 0; i < result.row(); i++)
-		for (int j = 0; j < result.col(); j++)
+	Matrix4 result;
+	for (int i = 0; i < Dimension; i++)
+		for (int j = 0; j < Dimension; j++)
 			result.data_[j][i] = data_[i][j];
 
 	return result;
 }
 
-float Matrix::Det() const
+/*
+*  2x2 minors of the upper two rows (s) and the lower two rows (c), shared by the determinant
+*  and the inverse (laplace expansion along the first two rows)
+*/
+struct Minors
+{
+	float s[6], c[6];
+};
+
+static Minors compute_minors(const Matrix4& m)
+{
+	Minors minors;
+	minors.s[0] = m(0, 0) * m(1, 1) - m(1, 0) * m(0, 1);
+	minors.s[1] = m(0, 0) * m(1, 2) - m(1, 0) * m(0, 2);
+	minors.s[2] = m(0, 0) * m(1, 3) - m(1, 0) * m(0, 3);
+	minors.s[3] = m(0, 1) * m(1, 2) - m(1, 1) * m(0, 2);
+	minors.s[4] = m(0, 1) * m(1, 3) - m(1, 1) * m(0, 3);
+	minors.s[5] = m(0, 2) * m(1, 3) - m(1, 2) * m(0, 3);
+
+	minors.c[0] = m(2, 0) * m(3, 1) - m(3, 0) * m(2, 1);
+	minors.c[1] = m(2, 0) * m(3, 2) - m(3, 0) * m(2, 2);
+	minors.c[2] = m(2, 0) * m(3, 3) - m(3, 0) * m(2, 3);
+	minors.c[3] = m(2, 1) * m(3, 2) - m(3, 1) * m(2, 2);
+	minors.c[4] = m(2, 1) * m(3, 3) - m(3, 1) * m(2, 3);
+	minors.c[5] = m(2, 2) * m(3, 3) - m(3, 2) * m(2, 3);
+	return minors;
+}
+
+static float minors_det(const Minors& m)
 {
-	float det = data_[0][0] * (data_[1][1] * data_[2][2] - data_[1][2] * data_[2][1]) - data_[0][1] * (data_[1][0] * data_[2][2] - data_[1][2] * data_[2][0])
-		+ data_[0][2] * (data_[1][0] * data_[2][1] - data_[1][1] * data_[2][0]);
-	return det;
+	return m.s[0] * m.c[5] - m.s[1] * m.c[4] + m.s[2] * m.c[3] + m.s[3] * m.c[2] - m.s[4] * m.c[1] + m.s[5] * m.c[0];
 }
 
-bool Matrix::Inverse()
+float Matrix4::Det() const
 {
-	float det = this->Det();
+	return minors_det(compute_minors(*this));
+}
+
+bool Matrix4::Inverse()
+{
+	Minors minors = compute_minors(*this);
+	float det = minors_det(minors);
 	if (det == 0)
 		return false;
 
-	Matrix adjoint; //adjoint matrix
-	adjoint.data_[0][0] = data_[1][1] * data_[2][2] - data_[1][2] * data_[2][1];
-	adjoint.data_[1][0] = -(data_[1][0] * data_[2][2] - data_[1][2] * data_[2][0]);
-	adjoint.data_[2][0] = data_[1][0] * data_[2][1] - data_[1][1] * data_[2][0];
+	const float *s = minors.s;
+	const float *c = minors.c;
+	const Matrix4& m = *this;
+	Matrix4 adjoint; //adjoint matrix
 
-	adjoint.data_[0][1] = -(data_[0][1] * data_[2][2] - data_[0][2] * data_[2][1]);
-	adjoint.data_[1][1] = data_[0][0] * data_[2][2] - data_[0][2] * data_[2][0];
-	adjoint.data_[2][1] = -(data_[0][0] * data_[2][1] - data_[0][1] * data_[2][0]);
+	adjoint(0, 0) = m(1, 1) * c[5] - m(1, 2) * c[4] + m(1, 3) * c[3];
+	adjoint(0, 1) = -m(0, 1) * c[5] + m(0, 2) * c[4] - m(0, 3) * c[3];
+	adjoint(0, 2) = m(3, 1) * s[5] - m(3, 2) * s[4] + m(3, 3) * s[3];
+	adjoint(0, 3) = -m(2, 1) * s[5] + m(2, 2) * s[4] - m(2, 3) * s[3];
 
-	adjoint.data_[0][2] = data_[0][1] * data_[1][2] - data_[0][2] * data_[1][1];
-	adjoint.data_[1][2] = -(data_[0][0] * data_[1][2] - data_[0][2] * data_[1][0]);
-	adjoint.data_[2][2] = data_[0][0] * data_[1][1] - data_[0][1] * data_[1][0];
+	adjoint(1, 0) = -m(1, 0) * c[5] + m(1, 2) * c[2] - m(1, 3) * c[1];
+	adjoint(1, 1) = m(0, 0) * c[5] - m(0, 2) * c[2] + m(0, 3) * c[1];
+	adjoint(1, 2) = -m(3, 0) * s[5] + m(3, 2) * s[2] - m(3, 3) * s[1];
+	adjoint(1, 3) = m(2, 0) * s[5] - m(2, 2) * s[2] + m(2, 3) * s[1];
 
-	det = 1.0f / det;
+	adjoint(2, 0) = m(1, 0) * c[4] - m(1, 1) * c[2] + m(1, 3) * c[0];
+	adjoint(2, 1) = -m(0, 0) * c[4] + m(0, 1) * c[2] - m(0, 3) * c[0];
+	adjoint(2, 2) = m(3, 0) * s[4] - m(3, 1) * s[2] + m(3, 3) * s[0];
+	adjoint(2, 3) = -m(2, 0) * s[4] + m(2, 1) * s[2] - m(2, 3) * s[0];
 
-	for (int i = 0; i < 3; i++)
-		for (int j = 0; j < 3; j++)
-			data_[i][j] = adjoint.data_[i][j] * det;
+	adjoint(3, 0) = -m(1, 0) * c[3] + m(1, 1) * c[1] - m(1, 2) * c[0];
+	adjoint(3, 1) = m(0, 0) * c[3] - m(0, 1) * c[1] + m(0, 2) * c[0];
+	adjoint(3, 2) = -m(3, 0) * s[3] + m(3, 1) * s[1] - m(3, 2) * s[0];
+	adjoint(3, 3) = m(2, 0) * s[3] - m(2, 1) * s[1] + m(2, 2) * s[0];
 
+	*this = adjoint * (1.0f / det);
 	return true;
-}
\ No newline at end of file
+}
+
+Matrix4 Matrix4::Identity()
+{
+	Matrix4 result;
+	for (int i = 0; i < Dimension; i++) {
+		result.data_[i][i] = 1.0f;
+	}
+	return result;
+}
+
+Matrix4 Matrix4::ScaleMatrix(float xScale, float yScale, float zScale)
+{
+	Matrix4 result = Identity();
+	result(0, 0) = xScale;
+	result(1, 1) = yScale;
+	result(2, 2) = zScale;
+	return result;
+}
+
+Matrix4 Matrix4::RotateMatrix(const Vector3f& axis, float radians)
+{
+	Vector3f n = axis;
+	n.normalize();
+	float c = cosf(radians);
+	float s = sinf(radians);
+	float t = 1 - c;
+
+	//rodrigues' rotation formula
+	Matrix4 result = Identity();
+	result(0, 0) = t * n.x * n.x + c;
+	result(0, 1) = t * n.x * n.y - s * n.z;
+	result(0, 2) = t * n.x * n.z + s * n.y;
+	result(1, 0) = t * n.x * n.y + s * n.z;
+	result(1, 1) = t * n.y * n.y + c;
+	result(1, 2) = t * n.y * n.z - s * n.x;
+	result(2, 0) = t * n.x * n.z - s * n.y;
+	result(2, 1) = t * n.y * n.z + s * n.x;
+	result(2, 2) = t * n.z * n.z + c;
+	return result;
+}
+
+Matrix4 Matrix4::TranslateMatrix(float x, float y, float z)
+{
+	Matrix4 result = Identity();
+	result(0, 3) = x;
+	result(1, 3) = y;
+	result(2, 3) = z;
+	return result;
+}
+
+Matrix4 Matrix4::LookAtMatrix(const Vector3f& eye, const Vector3f& target, const Vector3f& up)
+{
+	Vector3f forward = target - eye;
+	forward.normalize();
+	Vector3f right = forward.cross(up);
+	right.normalize();
+	Vector3f camera_up = right.cross(forward);
+
+	Matrix4 result = Identity();
+	result(0, 0) = right.x;		result(0, 1) = right.y;		result(0, 2) = right.z;
+	result(1, 0) = camera_up.x;	result(1, 1) = camera_up.y;	result(1, 2) = camera_up.z;
+	result(2, 0) = -forward.x;	result(2, 1) = -forward.y;	result(2, 2) = -forward.z;
+	result(0, 3) = -right.dot(eye);
+	result(1, 3) = -camera_up.dot(eye);
+	result(2, 3) = forward.dot(eye);
+	return result;
+}
+
+Matrix4 Matrix4::PerspectiveMatrix(float fovy, float aspect, float near_plane, float far_plane)
+{
+	assert(fovy > 0 && aspect > 0 && near_plane > 0 && far_plane > near_plane);
+	float focal = 1.0f / tanf(fovy * 0.5f);
+
+	Matrix4 result;
+	result(0, 0) = focal / aspect;
+	result(1, 1) = focal;
+	result(2, 2) = (far_plane + near_plane) / (near_plane - far_plane);
+	result(2, 3) = 2 * far_plane * near_plane / (near_plane - far_plane);
+	result(3, 2) = -1;
+	return result;
+}
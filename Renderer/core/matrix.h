@@ -1,97 +1,74 @@
 #ifndef MATRIX_H
 #define MATRIX_H
 
-#include <vector>
 #include <assert.h>
 
 #include "geometry.h"
 
-using std::vector;
-
 //default as 4x4 Matrix
 const int Dimension = 4;
 
-class Matrix
+/*
+*  4x4 matrix applied to column vectors (v' = M * v), stored column by column so that every
+*  product is a sum of scaled columns and maps directly onto 4-wide simd registers
+*  fixed size and 16-byte aligned, nothing is ever allocated
+*/
+class alignas(16) Matrix4
 {
-private:
-	int rows_, cols_;
-	vector<vector<float>> data_;
-
 public:
-	//declare constructor
-	Matrix(int row = Dimension, int col = Dimension);
-	//copy constructor
-	Matrix(const Matrix& mat);
+	//zero matrix
+	Matrix4();
 	//stored as column vector，eg. A(vec0, vec1, vec2, vec3)
-	Matrix(const Vector4f& vec0, const Vector4f& vec1, const Vector4f& vec2, const Vector4f& vec3);
+	Matrix4(const Vector4f& vec0, const Vector4f& vec1, const Vector4f& vec2, const Vector4f& vec3);
 
-	//assign operator overload
-	Matrix& operator =(const Matrix& mat);
+	float& operator ()(int row, int col) { assert(row >= 0 && row < Dimension && col >= 0 && col < Dimension); return data_[col][row]; }
+	float operator ()(int row, int col) const { assert(row >= 0 && row < Dimension && col >= 0 && col < Dimension); return data_[col][row]; }
 
-	vector<float>& operator [](int i) { assert(i >= 0 && i < rows_); return data_[i]; }
-
-	Matrix operator *(const Matrix& mat) const;
-	Matrix operator *(float t) const;
-	friend Matrix operator *(float t, const Matrix& mat);
+	Matrix4 operator *(const Matrix4& mat) const;
+	Matrix4 operator *(float t) const;
+	friend Matrix4 operator *(float t, const Matrix4& mat) { return mat * t; }
 	//right multiply Matrix by column vector
 	Vector4f operator *(const Vector4f& vec) const;
 
-	//return rows of matrix
-	int row() const { return rows_; } 
-	//return columns of matrix
-	int col() const { return cols_; } 
+	//dst[i] = M * src[i], src and dst may be the same array
+	void Transform(const Vector4f* src, Vector4f* dst, int count) const;
+	//points with w = 1
+	void Transform(const Vector3f* src, Vector4f* dst, int count) const;
+
+	//column i as a vector
+	Vector4f column(int i) const { assert(i >= 0 && i < Dimension); return Vector4f(data_[i][0], data_[i][1], data_[i][2], data_[i][3]); }
+	//16 floats, column major
+	const float* data() const { return &data_[0][0]; }
 
 	//transpose
-	Matrix Transpose();
+	Matrix4 Transpose() const;
 	//determinant
 	float Det() const;
-	//inverse
+	//inverse, leaves the matrix unchanged and returns false when it is singular
 	bool Inverse();
 
 	//identity Matrix
-	static Matrix Identity(int n)
-	{
-		Matrix result(n, n);
-		for (int i = 0; i < n; i++){
-			for (int j = 0; j < n; j++){
-				result[i][j] = (i == j ? 1.0f : 0.0f);
-			}
-		}
-		return result;
-	}
-
+	static Matrix4 Identity();
 	//zero Matrix
-	static Matrix ZeroMatrix(int n)
-	{
-		Matrix result(n, n);
-		for (int i = 0; i < n; i++) {
-			for (int j = 0; j < n; j++) {
-				result[i][j] = 0.0;
-			}
-		}
-		return result;
-	}
-
+	static Matrix4 ZeroMatrix() { return Matrix4(); }
 	//Scale Transformation Matrix
-	static Matrix ScaleMatrix(float xScale, float yScale, float zScale)
-	{
-		Matrix result = Identity(Dimension);
-		result[0][0] = xScale;
-		result[1][1] = yScale;
-		result[2][2] = zScale;
-		return result;
-	}
-
-	//Rotate Transformation Matrix
-	static Matrix RotateMatrix()
-	{
-
-	}
+	static Matrix4 ScaleMatrix(float xScale, float yScale, float zScale);
+	//Rotate Transformation Matrix, counterclockwise by radians around axis (need not be normalized)
+	static Matrix4 RotateMatrix(const Vector3f& axis, float radians);
+	//Translate Transformation Matrix
+	static Matrix4 TranslateMatrix(float x, float y, float z);
+
+	/*
+	*  view and projection, right handed: the camera looks down -z, clip space follows opengl with
+	*  -w <= x, y, z <= w
+	*/
+	//world to camera, up need not be orthogonal to the view direction
+	static Matrix4 LookAtMatrix(const Vector3f& eye, const Vector3f& target, const Vector3f& up);
+	//fovy in radians, near and far are positive distances
+	static Matrix4 PerspectiveMatrix(float fovy, float aspect, float near_plane, float far_plane);
 
-	static Matrix TranslateMatrix()
-	{
-
-	}
+private:
+	float data_[Dimension][Dimension];	//data_[col][row]
 };
 
 #endif
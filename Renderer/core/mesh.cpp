@@ -0,0 +1,644 @@
+#include "mesh.h"
+#include <assert.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <stdint.h>
+#include <algorithm>
+#include <limits>
+#include <string>
+#include "utils.h"
+#include "mesh_optimizer.h"
+
+//one float per vertex each: position x, y, z, texcoord u, v, normal x, y, z
+static const int MESH_STREAMS = 8;
+//offsets of streams and indices in a binary file, enough for aligned vector loads
+static const uint64_t MESH_FILE_ALIGNMENT = 64;
+static const char MESH_FILE_MAGIC[4] = { 'M', 'E', 'S', 'H' };
+//bump on any change of the layout below or of what obj caches hold (2: vertex cache order);
+//a byte-swapped version also fails the check
+static const uint32_t MESH_FILE_VERSION = 2;
+
+//binary .mesh file: this header, then the streams and the index buffer at the given offsets
+struct MeshFileHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t header_size;
+	int32_t vertex_count;
+	int32_t face_count;
+	uint32_t reserved;
+	uint64_t stream_offset[MESH_STREAMS];
+	uint64_t index_offset;		//3 int32 per face
+	uint64_t file_size;
+	float bounds_min[3];
+	float bounds_max[3];
+	uint64_t source_size;		//of the file the mesh was loaded from, 0 when written by SaveBinary
+	int64_t source_time;
+};
+
+static_assert(sizeof(Face) == 3 * sizeof(int32_t), "Face must match the binary index buffer");
+
+static inline uint64_t align_offset(uint64_t offset)
+{
+	return (offset + MESH_FILE_ALIGNMENT - 1) & ~(MESH_FILE_ALIGNMENT - 1);
+}
+
+Face::Face(int index1, int index2, int index3)
+{
+	vertex_indics[0] = index1;
+	vertex_indics[1] = index2;
+	vertex_indics[2] = index3;
+}
+
+Mesh::Mesh()
+{
+	mapped_ = NULL;
+	Clear();
+}
+
+Mesh::~Mesh()
+{
+	delete mapped_;
+}
+
+void Mesh::Clear()
+{
+	delete mapped_;
+	mapped_ = NULL;
+	for (int i = 0; i < 3; i++) {
+		positions_[i].clear();
+		normals_[i].clear();
+	}
+	for (int i = 0; i < 2; i++)
+		texCoords_[i].clear();
+	faces_.clear();
+	UpdateViews();
+	ComputeBounds();
+}
+
+void Mesh::UpdateViews()
+{
+	assert(mapped_ == NULL);
+	for (int i = 0; i < 3; i++) {
+		positionData_[i] = positions_[i].data();
+		normalData_[i] = normals_[i].data();
+	}
+	for (int i = 0; i < 2; i++)
+		texCoordData_[i] = texCoords_[i].data();
+	faceData_ = faces_.data();
+	vertexNum_ = (int)positions_[0].size();
+	faceNum_ = (int)faces_.size();
+}
+
+void Mesh::Detach()
+{
+	if (mapped_ == NULL)
+		return;
+	for (int i = 0; i < 3; i++) {
+		positions_[i].assign(positionData_[i], positionData_[i] + vertexNum_);
+		normals_[i].assign(normalData_[i], normalData_[i] + vertexNum_);
+	}
+	for (int i = 0; i < 2; i++)
+		texCoords_[i].assign(texCoordData_[i], texCoordData_[i] + vertexNum_);
+	faces_.assign(faceData_, faceData_ + faceNum_);
+	delete mapped_;
+	mapped_ = NULL;
+	UpdateViews();
+}
+
+void Mesh::ComputeBounds()
+{
+	float inf = std::numeric_limits<float>::infinity();
+	float lo[3] = { inf, inf, inf }, hi[3] = { -inf, -inf, -inf };
+	for (int c = 0; c < 3; c++) {
+		const float *values = positionData_[c];
+		for (int i = 0; i < vertexNum_; i++) {
+			lo[c] = std::min(lo[c], values[i]);
+			hi[c] = std::max(hi[c], values[i]);
+		}
+	}
+	boundsMin_ = Vector3f(lo[0], lo[1], lo[2]);
+	boundsMax_ = Vector3f(hi[0], hi[1], hi[2]);
+}
+
+int Mesh::AddVertex(const Vertex& vertex)
+{
+	Detach();
+	positions_[0].push_back(vertex.position_.x);
+	positions_[1].push_back(vertex.position_.y);
+	positions_[2].push_back(vertex.position_.z);
+	texCoords_[0].push_back(vertex.texCoord_.x);
+	texCoords_[1].push_back(vertex.texCoord_.y);
+	normals_[0].push_back(vertex.normal_.x);
+	normals_[1].push_back(vertex.normal_.y);
+	normals_[2].push_back(vertex.normal_.z);
+	UpdateViews();
+	boundsMin_ = Vector3f(std::min(boundsMin_.x, vertex.position_.x), std::min(boundsMin_.y, vertex.position_.y), std::min(boundsMin_.z, vertex.position_.z));
+	boundsMax_ = Vector3f(std::max(boundsMax_.x, vertex.position_.x), std::max(boundsMax_.y, vertex.position_.y), std::max(boundsMax_.z, vertex.position_.z));
+	return vertex_num() - 1;
+}
+
+void Mesh::AddFace(int index1, int index2, int index3)
+{
+	assert(index1 >= 0 && index1 < vertex_num());
+	assert(index2 >= 0 && index2 < vertex_num());
+	assert(index3 >= 0 && index3 < vertex_num());
+	Detach();
+	faces_.push_back(Face(index1, index2, index3));
+	UpdateViews();
+}
+
+void Mesh::Reorder(const vector<int>& face_order, const vector<int>& vertex_remap)
+{
+	assert((int)face_order.size() == face_num() && (int)vertex_remap.size() == vertex_num());
+	vector<Face> faces;
+	faces.reserve(face_num());
+	for (int i = 0; i < face_num(); i++) {
+		const int *indices = faceData_[face_order[i]].indics();
+		faces.push_back(Face(vertex_remap[indices[0]], vertex_remap[indices[1]], vertex_remap[indices[2]]));
+	}
+	vector<float> streams[MESH_STREAMS];
+	const float *sources[MESH_STREAMS] = { positionData_[0], positionData_[1], positionData_[2],
+		texCoordData_[0], texCoordData_[1], normalData_[0], normalData_[1], normalData_[2] };
+	for (int c = 0; c < MESH_STREAMS; c++) {
+		streams[c].resize(vertex_num());
+		for (int i = 0; i < vertex_num(); i++)
+			streams[c][vertex_remap[i]] = sources[c][i];
+	}
+
+	//the old data may be mapped, so it is only let go of once everything is copied
+	delete mapped_;
+	mapped_ = NULL;
+	faces_.swap(faces);
+	for (int c = 0; c < 3; c++) {
+		positions_[c].swap(streams[c]);
+		normals_[c].swap(streams[5 + c]);
+	}
+	for (int c = 0; c < 2; c++)
+		texCoords_[c].swap(streams[3 + c]);
+	UpdateViews();
+}
+
+Vertex Mesh::vertex(int i) const
+{
+	assert(i >= 0 && i < vertex_num());
+	Vertex vertex;
+	vertex.position_ = Point3d(positionData_[0][i], positionData_[1][i], positionData_[2][i]);
+	vertex.texCoord_ = Vector2f(texCoordData_[0][i], texCoordData_[1][i]);
+	vertex.normal_ = Vector3f(normalData_[0][i], normalData_[1][i], normalData_[2][i]);
+	return vertex;
+}
+
+VertexStreams Mesh::streams() const
+{
+	VertexStreams streams;
+	for (int i = 0; i < 3; i++) {
+		streams.position[i] = positionData_[i];
+		streams.normal[i] = normalData_[i];
+	}
+	for (int i = 0; i < 2; i++)
+		streams.texcoord[i] = texCoordData_[i];
+	streams.count = vertex_num();
+	return streams;
+}
+
+//area-weighted normal of triangle (p0, p1, p2), added to sum
+static inline void add_face_normal(const float p0[3], const float p1[3], const float p2[3], float *sum)
+{
+	float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+	float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+	sum[0] += e1[1] * e2[2] - e1[2] * e2[1];
+	sum[1] += e1[2] * e2[0] - e1[0] * e2[2];
+	sum[2] += e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+static inline void normalize(float *v)
+{
+	float length = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+	float inv = length > 0 ? 1.0f / length : 0.0f;
+	v[0] *= inv;
+	v[1] *= inv;
+	v[2] *= inv;
+}
+
+void Mesh::ComputeNormals()
+{
+	Detach();
+	int count = vertex_num();
+	vector<float> sums((size_t)count * 3, 0.0f);
+	for (size_t f = 0; f < faces_.size(); f++) {
+		const int *indices = faces_[f].indics();
+		float p[3][3];
+		for (int j = 0; j < 3; j++) {
+			for (int c = 0; c < 3; c++)
+				p[j][c] = positions_[c][indices[j]];
+		}
+		float normal[3] = { 0, 0, 0 };
+		add_face_normal(p[0], p[1], p[2], normal);
+		for (int j = 0; j < 3; j++) {
+			for (int c = 0; c < 3; c++)
+				sums[(size_t)indices[j] * 3 + c] += normal[c];
+		}
+	}
+	for (int i = 0; i < count; i++) {
+		normalize(&sums[(size_t)i * 3]);
+		for (int c = 0; c < 3; c++)
+			normals_[c][i] = sums[(size_t)i * 3 + c];
+	}
+}
+
+bool Mesh::LoadFromFile(const char *filePath, MeshLoadStats *stats)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	const char *ext = GetExtension(filePath);
+	bool loaded = false, optimized = false;
+	size_t file_size = 0;
+	MeshOptimizeStats optimize = {};
+	if (strcmp(ext, "mesh") == 0) {
+		loaded = LoadBinary(filePath, false, 0, 0);
+	}
+	else if (strcmp(ext, "obj") == 0 || strcmp(ext, "OBJ") == 0) {
+		unsigned long long source_size;
+		long long source_time;
+		if (!GetFileStamp(filePath, &source_size, &source_time))
+			return false;
+		std::string cache_path = std::string(filePath) + ".mesh";
+		loaded = LoadBinary(cache_path.c_str(), true, source_size, source_time);
+		if (!loaded) {
+			loaded = LoadFromOBJ(filePath);
+			file_size = (size_t)source_size;
+			//the cache stores the reordered mesh, so mapped loads need no optimization;
+			//a cache that cannot be written only costs the next load a parse
+			if (loaded) {
+				optimize_vertex_cache(this, &optimize);
+				optimized = true;
+				WriteBinary(cache_path.c_str(), source_size, source_time);
+			}
+		}
+	}
+	if (!loaded)
+		return false;
+
+	if (stats != NULL) {
+		stats->file_size = mapped_ != NULL ? mapped_->size() : file_size;
+		stats->vertices = vertex_num();
+		stats->faces = face_num();
+		stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		stats->cached = mapped_ != NULL;
+		stats->optimized = optimized;
+		stats->optimize = optimize;
+	}
+	return true;
+}
+
+bool Mesh::SaveBinary(const char *filePath) const
+{
+	return WriteBinary(filePath, 0, 0);
+}
+
+bool Mesh::LoadBinary(const char *filePath, bool check_source, unsigned long long source_size, long long source_time)
+{
+	MappedFile *file = new MappedFile();
+	MeshFileHeader header;
+	bool valid = file->Open(filePath) && file->size() >= sizeof(header);
+	if (valid) {
+		memcpy(&header, file->data(), sizeof(header));
+		valid = memcmp(header.magic, MESH_FILE_MAGIC, 4) == 0 && header.version == MESH_FILE_VERSION
+			&& header.header_size == sizeof(header) && header.file_size == file->size()
+			&& header.vertex_count >= 0 && header.face_count >= 0;
+	}
+	if (valid && check_source)
+		valid = header.source_size == source_size && header.source_time == source_time;
+	//every array has to lie inside the file, aligned
+	for (int i = 0; valid && i <= MESH_STREAMS; i++) {
+		uint64_t offset = i < MESH_STREAMS ? header.stream_offset[i] : header.index_offset;
+		uint64_t bytes = i < MESH_STREAMS ? (uint64_t)header.vertex_count * sizeof(float) : (uint64_t)header.face_count * sizeof(Face);
+		valid = offset % MESH_FILE_ALIGNMENT == 0 && offset >= sizeof(header) && offset <= header.file_size && bytes <= header.file_size - offset;
+	}
+	//every index has to name a vertex, draws read positions through them unchecked
+	if (valid) {
+		const int *indices = (const int*)(file->data() + header.index_offset);
+		for (int64_t i = 0; valid && i < (int64_t)header.face_count * 3; i++)
+			valid = indices[i] >= 0 && indices[i] < header.vertex_count;
+	}
+	if (!valid) {
+		delete file;
+		return false;
+	}
+
+	Clear();
+	mapped_ = file;
+	const Byte *data = file->data();
+	for (int i = 0; i < 3; i++) {
+		positionData_[i] = (const float*)(data + header.stream_offset[i]);
+		normalData_[i] = (const float*)(data + header.stream_offset[5 + i]);
+	}
+	for (int i = 0; i < 2; i++)
+		texCoordData_[i] = (const float*)(data + header.stream_offset[3 + i]);
+	faceData_ = (const Face*)(data + header.index_offset);
+	vertexNum_ = header.vertex_count;
+	faceNum_ = header.face_count;
+	boundsMin_ = Vector3f(header.bounds_min[0], header.bounds_min[1], header.bounds_min[2]);
+	boundsMax_ = Vector3f(header.bounds_max[0], header.bounds_max[1], header.bounds_max[2]);
+	return true;
+}
+
+bool Mesh::WriteBinary(const char *filePath, unsigned long long source_size, long long source_time) const
+{
+	MeshFileHeader header;
+	memset(&header, 0, sizeof(header));
+	header.version = MESH_FILE_VERSION;
+	header.header_size = sizeof(header);
+	header.vertex_count = vertex_num();
+	header.face_count = face_num();
+	header.source_size = source_size;
+	header.source_time = source_time;
+	const Vector3f *bounds[2] = { &boundsMin_, &boundsMax_ };
+	float *header_bounds[2] = { header.bounds_min, header.bounds_max };
+	for (int i = 0; i < 2; i++) {
+		header_bounds[i][0] = bounds[i]->x;
+		header_bounds[i][1] = bounds[i]->y;
+		header_bounds[i][2] = bounds[i]->z;
+	}
+
+	const void *arrays[MESH_STREAMS + 1] = { positionData_[0], positionData_[1], positionData_[2],
+		texCoordData_[0], texCoordData_[1], normalData_[0], normalData_[1], normalData_[2], faceData_ };
+	uint64_t sizes[MESH_STREAMS + 1];
+	uint64_t offset = align_offset(sizeof(header));
+	for (int i = 0; i <= MESH_STREAMS; i++) {
+		sizes[i] = i < MESH_STREAMS ? (uint64_t)vertex_num() * sizeof(float) : (uint64_t)face_num() * sizeof(Face);
+		if (i < MESH_STREAMS)
+			header.stream_offset[i] = offset;
+		else
+			header.index_offset = offset;
+		offset = align_offset(offset + sizes[i]);
+	}
+	header.file_size = offset;
+
+	//written aside and renamed over the target, so that whoever still maps the old file keeps reading it
+	std::string temp_path = std::string(filePath) + ".tmp";
+	FILE *file = fopen(temp_path.c_str(), "wb");
+	if (file == NULL)
+		return false;
+	//the magic goes in last, so a file cut short is never taken for a valid one
+	static const Byte zeros[MESH_FILE_ALIGNMENT] = { 0 };
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+	uint64_t position = sizeof(header);
+	for (int i = 0; written && i <= MESH_STREAMS; i++) {
+		uint64_t start = i < MESH_STREAMS ? header.stream_offset[i] : header.index_offset;
+		written = fwrite(zeros, 1, (size_t)(start - position), file) == start - position
+			&& (sizes[i] == 0 || fwrite(arrays[i], (size_t)sizes[i], 1, file) == 1);
+		position = start + sizes[i];
+	}
+	written = written && fwrite(zeros, 1, (size_t)(header.file_size - position), file) == header.file_size - position;
+	memcpy(header.magic, MESH_FILE_MAGIC, 4);
+	written = written && fflush(file) == 0 && fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+	written = fclose(file) == 0 && written;
+	written = written && RenameFile(temp_path.c_str(), filePath);
+	if (!written)
+		remove(temp_path.c_str());
+	return written;
+}
+
+/*
+*  obj parsing, straight from the mapped file
+*/
+static inline bool is_blank(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline bool is_digit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+static inline const char *skip_blanks(const char *p, const char *end)
+{
+	while (p < end && is_blank(*p))
+		p++;
+	return p;
+}
+
+static inline const char *next_line(const char *p, const char *end)
+{
+	const char *newline = (const char*)memchr(p, '\n', end - p);
+	return newline ? newline + 1 : end;
+}
+
+//decimal float with optional sign, fraction and exponent; returns NULL when there is no number
+static const char *parse_float(const char *p, const char *end, float *value)
+{
+	static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) {
+		negative = *p == '-';
+		p++;
+	}
+
+	//up to 19 significant digits fit the mantissa, further digits only move the exponent
+	unsigned long long mantissa = 0;
+	int digits = 0, exponent = 0;
+	bool any = false;
+	for (; p < end && is_digit(*p); p++) {
+		any = true;
+		if (digits < 19) {
+			mantissa = mantissa * 10 + (*p - '0');
+			digits += mantissa != 0;
+		}
+		else {
+			exponent++;
+		}
+	}
+	if (p < end && *p == '.') {
+		for (p++; p < end && is_digit(*p); p++) {
+			any = true;
+			if (digits < 19) {
+				mantissa = mantissa * 10 + (*p - '0');
+				digits += mantissa != 0;
+				exponent--;
+			}
+		}
+	}
+	if (!any)
+		return NULL;
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		const char *q = p + 1;
+		bool exponent_negative = false;
+		if (q < end && (*q == '-' || *q == '+')) {
+			exponent_negative = *q == '-';
+			q++;
+		}
+		if (q < end && is_digit(*q)) {
+			int e = 0;
+			for (; q < end && is_digit(*q); q++)
+				e = std::min(e * 10 + (*q - '0'), 1000);
+			exponent += exponent_negative ? -e : e;
+			p = q;
+		}
+	}
+
+	double result = (double)mantissa;
+	for (; exponent > 22; exponent -= 22)
+		result *= powers[22];
+	for (; exponent < -22; exponent += 22)
+		result /= powers[22];
+	result = exponent >= 0 ? result * powers[exponent] : result / powers[-exponent];
+	*value = (float)(negative ? -result : result);
+	return p;
+}
+
+//1-based obj index, negative counts back from the last element; returns NULL when there is none
+static inline const char *parse_index(const char *p, const char *end, int count, int *index)
+{
+	bool negative = p < end && *p == '-';
+	if (negative)
+		p++;
+	if (p >= end || !is_digit(*p))
+		return NULL;
+	long long value = 0;
+	for (; p < end && is_digit(*p); p++)
+		value = std::min(value * 10 + (*p - '0'), (long long)1 << 40);
+	value = negative ? count - value : value - 1;
+	*index = value >= 0 && value < count ? (int)value : -1;
+	return p;
+}
+
+//up to n floats of a "v", "vt" or "vn" line, missing ones stay as given
+static inline void parse_floats(const char *p, const char *end, int n, float *values)
+{
+	for (int i = 0; i < n; i++) {
+		p = skip_blanks(p, end);
+		const char *next = parse_float(p, end, &values[i]);
+		if (next == NULL)
+			return;
+		p = next;
+	}
+}
+
+bool Mesh::LoadFromOBJ(const char *filePath)
+{
+	MappedFile file;
+	if (!file.Open(filePath))
+		return false;
+	Clear();
+
+	const char *p = (const char*)file.data();
+	const char *end = p + file.size();
+	vector<float> positions, texcoords, normals;	//as listed in the file
+	//tuples are looked up by their position index: first_vertex[position] starts a chain through
+	//next_vertex of the vertices made from that position, which is a single entry almost always
+	vector<int> first_vertex, next_vertex;
+	vector<int> vertex_texcoord, vertex_normal, vertex_position;
+	vector<int> polygon;
+	bool missing_normals = false;
+
+	while (p < end) {
+		p = skip_blanks(p, end);
+		const char *line_end = next_line(p, end);
+		if (p + 1 < line_end && p[0] == 'v' && is_blank(p[1])) {
+			float v[3] = { 0, 0, 0 };
+			parse_floats(p + 2, line_end, 3, v);
+			positions.insert(positions.end(), v, v + 3);
+			first_vertex.push_back(-1);
+		}
+		else if (p + 2 < line_end && p[0] == 'v' && p[1] == 't' && is_blank(p[2])) {
+			float v[2] = { 0, 0 };
+			parse_floats(p + 3, line_end, 2, v);
+			texcoords.insert(texcoords.end(), v, v + 2);
+		}
+		else if (p + 2 < line_end && p[0] == 'v' && p[1] == 'n' && is_blank(p[2])) {
+			float v[3] = { 0, 0, 0 };
+			parse_floats(p + 3, line_end, 3, v);
+			normals.insert(normals.end(), v, v + 3);
+		}
+		else if (p + 1 < line_end && p[0] == 'f' && is_blank(p[1])) {
+			int position_count = (int)positions.size() / 3;
+			int texcoord_count = (int)texcoords.size() / 2;
+			int normal_count = (int)normals.size() / 3;
+			polygon.clear();
+			bool valid = true;
+			const char *q = skip_blanks(p + 2, line_end);
+			while (q < line_end && *q != '\n' && *q != '#') {
+				//p, p/t, p//n or p/t/n
+				int position = -1, texcoord = -1, normal = -1;
+				q = parse_index(q, line_end, position_count, &position);
+				if (q == NULL || position < 0) {
+					valid = false;
+					break;
+				}
+				if (q < line_end && *q == '/') {
+					q++;
+					if (q < line_end && *q != '/') {
+						q = parse_index(q, line_end, texcoord_count, &texcoord);
+						if (q == NULL)
+							break;
+					}
+					if (q < line_end && *q == '/') {
+						q = parse_index(q + 1, line_end, normal_count, &normal);
+						if (q == NULL)
+							break;
+					}
+				}
+
+				int vertex = first_vertex[position];
+				while (vertex >= 0 && (vertex_texcoord[vertex] != texcoord || vertex_normal[vertex] != normal))
+					vertex = next_vertex[vertex];
+				if (vertex < 0) {
+					vertex = (int)positions_[0].size();
+					next_vertex.push_back(first_vertex[position]);
+					first_vertex[position] = vertex;
+					vertex_position.push_back(position);
+					vertex_texcoord.push_back(texcoord);
+					vertex_normal.push_back(normal);
+					for (int c = 0; c < 3; c++)
+						positions_[c].push_back(positions[(size_t)position * 3 + c]);
+					for (int c = 0; c < 2; c++)
+						texCoords_[c].push_back(texcoord >= 0 ? texcoords[(size_t)texcoord * 2 + c] : 0.0f);
+					for (int c = 0; c < 3; c++)
+						normals_[c].push_back(normal >= 0 ? normals[(size_t)normal * 3 + c] : 0.0f);
+					missing_normals = missing_normals || normal < 0;
+				}
+				polygon.push_back(vertex);
+				q = skip_blanks(q, line_end);
+			}
+			if (q == NULL)
+				valid = false;
+			//fan around the first corner
+			for (size_t i = 2; valid && i < polygon.size(); i++)
+				faces_.push_back(Face(polygon[0], polygon[i - 1], polygon[i]));
+		}
+		p = line_end;
+	}
+
+	if (missing_normals) {
+		//sum per file position rather than per vertex, so vertices split by texcoords agree
+		vector<float> sums(positions.size(), 0.0f);
+		for (size_t f = 0; f < faces_.size(); f++) {
+			const int *indices = faces_[f].indics();
+			int p0 = vertex_position[indices[0]], p1 = vertex_position[indices[1]], p2 = vertex_position[indices[2]];
+			float normal[3] = { 0, 0, 0 };
+			add_face_normal(&positions[(size_t)p0 * 3], &positions[(size_t)p1 * 3], &positions[(size_t)p2 * 3], normal);
+			for (int c = 0; c < 3; c++) {
+				sums[(size_t)p0 * 3 + c] += normal[c];
+				sums[(size_t)p1 * 3 + c] += normal[c];
+				sums[(size_t)p2 * 3 + c] += normal[c];
+			}
+		}
+		for (size_t i = 0; i < vertex_position.size(); i++) {
+			if (vertex_normal[i] >= 0)
+				continue;
+			float *sum = &sums[(size_t)vertex_position[i] * 3];
+			float normal[3] = { sum[0], sum[1], sum[2] };
+			normalize(normal);
+			for (int c = 0; c < 3; c++)
+				normals_[c][i] = normal[c];
+		}
+	}
+
+	UpdateViews();
+	ComputeBounds();
+	return true;
+}
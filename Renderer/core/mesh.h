@@ -1,11 +1,16 @@
 #ifndef MESH_H
 #define MESH_H
 
+#include <stddef.h>
 #include <vector>
 #include "geometry.h"
+#include "vertex_processor.h"
+#include "mesh_optimizer.h"
 
 using std::vector;
 
+class MappedFile;
+
 class Vertex
 {
 public:
@@ -24,33 +29,112 @@ private:
 	int vertex_indics[2];
 };
 
-//default as triangle face
+//cost of one LoadFromFile
+struct MeshLoadStats
+{
+	size_t file_size;	//bytes read from disk
+	int vertices;		//after deduplication
+	int faces;			//triangles
+	double seconds;
+	bool cached;		//mapped from a binary .mesh file instead of parsed
+	bool optimized;		//parsed and reordered for the vertex cache, see optimize
+	MeshOptimizeStats optimize;
+
+	double megabytes_per_second() const { return seconds > 0 ? file_size / (1024.0 * 1024.0) / seconds : 0; }
+};
+
+//default as triangle face, laid out as the 3 indices of the binary index buffer
 class Face
 {
 public:
 	Face(int index1, int index2, int index3);
-	~Face();
 
 	int* indics() { return &vertex_indics[0]; }
+	const int* indics() const { return &vertex_indics[0]; }
 
 private:
 	int vertex_indics[3];
-	Vector3f normal_;
 };
 
+/*
+*  vertices are kept as one array per component so that the vertex stage can load them in blocks
+*  the arrays are either owned or read straight from a mapped binary .mesh file; the first change
+*  to a mapped mesh copies it
+*/
 class Mesh
 {
 public:
 	Mesh();
 	~Mesh();
 
-	int vertex_num() const;
-	int face_num() const;
+	Mesh(const Mesh&) = delete;
+	Mesh& operator=(const Mesh&) = delete;
+
+	/*
+	*  wavefront obj: polygons become triangle fans and every distinct (position, texcoord, normal)
+	*  tuple becomes one vertex; vertices without a normal get the area-weighted normal of the faces
+	*  around their position, so uv seams stay smooth
+	*  the parsed mesh is reordered by optimize_vertex_cache once and cached as <filePath>.mesh,
+	*  which later loads map instead while the size and time of the obj still match; .mesh files
+	*  are mapped directly
+	*  returns false when the file cannot be read
+	*/
+	bool LoadFromFile(const char *filePath, MeshLoadStats *stats = NULL);
+	//write the binary .mesh format, returns false when the file cannot be written
+	bool SaveBinary(const char *filePath) const;
+	void Clear();
+	//replace every normal by the area-weighted sum of the face normals around the vertex
+	void ComputeNormals();
+
+	/*
+	*  face i becomes old face face_order[i] and vertex v becomes vertex vertex_remap[v], both
+	*  permutations; the faces are renumbered to match
+	*/
+	void Reorder(const vector<int>& face_order, const vector<int>& vertex_remap);
+
+	//returns index of the new vertex
+	int AddVertex(const Vertex& vertex);
+	void AddFace(int index1, int index2, int index3);
+
+	Vertex vertex(int i) const;
+	const Face& face(int i) const { return faceData_[i]; }
+	//view of the attribute arrays, valid until the next change of the mesh
+	VertexStreams streams() const;
+
+	int vertex_num() const { return vertexNum_; }
+	int face_num() const { return faceNum_; }
+	bool mapped() const { return mapped_ != NULL; }
+	//axis-aligned bounds of all vertices, min > max while there are none
+	const Vector3f& bounds_min() const { return boundsMin_; }
+	const Vector3f& bounds_max() const { return boundsMax_; }
 
 private:
-	std::vector<Vertex> vertics_;
+	bool LoadFromOBJ(const char *filePath);
+	//with check_source the header has to name a source file of source_size bytes written at source_time
+	bool LoadBinary(const char *filePath, bool check_source, unsigned long long source_size, long long source_time);
+	bool WriteBinary(const char *filePath, unsigned long long source_size, long long source_time) const;
+	//copy mapped data into the vectors before a change
+	void Detach();
+	//point the data views at the vectors again
+	void UpdateViews();
+	void ComputeBounds();
+
+	vector<float> positions_[3];
+	vector<float> texCoords_[2];
+	vector<float> normals_[3];
 	//std::vector<Edge> edges_;
 	std::vector<Face> faces_;
+
+	//what the accessors read: the vectors above, or the mapped file
+	const float *positionData_[3];
+	const float *texCoordData_[2];
+	const float *normalData_[3];
+	const Face *faceData_;
+	int vertexNum_;
+	int faceNum_;
+	Vector3f boundsMin_;
+	Vector3f boundsMax_;
+	MappedFile *mapped_;
 };
 
 #endif
@@ -0,0 +1,198 @@
+#include "mesh_optimizer.h"
+#include <assert.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include "mesh.h"
+
+using std::vector;
+
+float mesh_acmr(const Mesh& mesh, int cache_size)
+{
+	assert(cache_size > 0);
+	if (mesh.face_num() == 0)
+		return 0.0f;
+	//stamp[v] is the miss count when v entered the cache, it is cached while fewer than cache_size misses followed
+	vector<long long> stamp(mesh.vertex_num(), -(long long)cache_size - 1);
+	long long misses = 0;
+	for (int i = 0; i < mesh.face_num(); i++) {
+		const int *indices = mesh.face(i).indics();
+		for (int j = 0; j < 3; j++) {
+			if (misses - stamp[indices[j]] > cache_size) {
+				stamp[indices[j]] = misses;
+				misses++;
+			}
+		}
+	}
+	return (float)misses / mesh.face_num();
+}
+
+/*
+*  forsyth's vertex scores: vertices of the last triangle get a fixed score so that the next one
+*  does not simply reuse the same edge, the rest of the lru cache decays with the position,
+*  and vertices with few triangles left get a boost so that no lonely triangles are left behind
+*/
+static const int FORSYTH_CACHE_SIZE = 32;
+static const int FORSYTH_MAX_VALENCE = 64;
+
+struct ForsythScores
+{
+	float cache[FORSYTH_CACHE_SIZE];
+	float valence[FORSYTH_MAX_VALENCE];
+
+	ForsythScores()
+	{
+		for (int i = 0; i < FORSYTH_CACHE_SIZE; i++)
+			cache[i] = i < 3 ? 0.75f : powf(1.0f - (i - 3) / (float)(FORSYTH_CACHE_SIZE - 3), 1.5f);
+		valence[0] = 0.0f;
+		for (int i = 1; i < FORSYTH_MAX_VALENCE; i++)
+			valence[i] = 2.0f / sqrtf((float)i);
+	}
+
+	//live: triangles of the vertex not yet emitted, position: in the cache or -1
+	float vertex(int position, int live) const
+	{
+		if (live == 0)
+			return -1.0f;
+		float score = position >= 0 ? cache[position] : 0.0f;
+		return score + valence[std::min(live, FORSYTH_MAX_VALENCE - 1)];
+	}
+};
+
+//greedy forsyth order of the faces of mesh
+static void forsyth_order(const Mesh& mesh, vector<int>* order)
+{
+	static const ForsythScores scores;
+	int vertex_count = mesh.vertex_num(), face_count = mesh.face_num();
+
+	//triangles around every vertex, the live ones first
+	vector<int> live(vertex_count, 0), first(vertex_count + 1, 0);
+	for (int i = 0; i < face_count; i++) {
+		const int *indices = mesh.face(i).indics();
+		for (int j = 0; j < 3; j++)
+			live[indices[j]]++;
+	}
+	for (int v = 0; v < vertex_count; v++)
+		first[v + 1] = first[v] + live[v];
+	vector<int> adjacency(first[vertex_count]);
+	{
+		vector<int> fill(first.begin(), first.end() - 1);
+		for (int i = 0; i < face_count; i++) {
+			const int *indices = mesh.face(i).indics();
+			for (int j = 0; j < 3; j++)
+				adjacency[fill[indices[j]]++] = i;
+		}
+	}
+
+	vector<float> vertex_score(vertex_count), face_score(face_count, 0.0f);
+	vector<int> cache_position(vertex_count, -1);
+	vector<char> emitted(face_count, 0);
+	for (int v = 0; v < vertex_count; v++)
+		vertex_score[v] = scores.vertex(-1, live[v]);
+	int best = -1;
+	float best_score = -1.0f;
+	for (int i = 0; i < face_count; i++) {
+		const int *indices = mesh.face(i).indics();
+		face_score[i] = vertex_score[indices[0]] + vertex_score[indices[1]] + vertex_score[indices[2]];
+		if (face_score[i] > best_score) {
+			best_score = face_score[i];
+			best = i;
+		}
+	}
+
+	//the cache grows by up to 3 before the vertices past its end are dropped
+	int cache[FORSYTH_CACHE_SIZE + 3], next_cache[FORSYTH_CACHE_SIZE + 3];
+	int cache_count = 0;
+	int cursor = 0;		//faces before it are all emitted
+	vector<int> added(vertex_count, -1);	//step a vertex was last put in front of the cache
+	int step = 0;
+	order->clear();
+	order->reserve(face_count);
+	while ((int)order->size() < face_count) {
+		if (best < 0) {
+			//nothing in the cache has triangles left, go on with the first face not emitted
+			while (emitted[cursor])
+				cursor++;
+			best = cursor;
+		}
+		order->push_back(best);
+		emitted[best] = 1;
+		const int *indices = mesh.face(best).indics();
+
+		int next_count = 0;
+		for (int j = 0; j < 3; j++) {
+			int v = indices[j];
+			//move the face out of the live part of the list
+			int *begin = &adjacency[first[v]], *end = begin + live[v];
+			*std::find(begin, end, best) = end[-1];
+			end[-1] = best;
+			live[v]--;
+			if (added[v] != step) {
+				added[v] = step;
+				next_cache[next_count++] = v;
+			}
+		}
+		for (int i = 0; i < cache_count; i++) {
+			int v = cache[i];
+			if (added[v] != step)
+				next_cache[next_count++] = v;
+		}
+		step++;
+
+		//rescore every vertex that is or was in the cache, and the faces around them
+		for (int i = 0; i < next_count; i++) {
+			int v = next_cache[i];
+			cache_position[v] = i < FORSYTH_CACHE_SIZE ? i : -1;
+			vertex_score[v] = scores.vertex(cache_position[v], live[v]);
+		}
+		best = -1;
+		best_score = -1.0f;
+		for (int i = 0; i < next_count; i++) {
+			int v = next_cache[i];
+			for (int k = first[v]; k < first[v] + live[v]; k++) {
+				int face = adjacency[k];
+				const int *around = mesh.face(face).indics();
+				face_score[face] = vertex_score[around[0]] + vertex_score[around[1]] + vertex_score[around[2]];
+				if (face_score[face] > best_score) {
+					best_score = face_score[face];
+					best = face;
+				}
+			}
+		}
+
+		cache_count = std::min(next_count, FORSYTH_CACHE_SIZE);
+		std::copy(next_cache, next_cache + cache_count, cache);
+	}
+}
+
+void optimize_vertex_cache(Mesh* mesh, MeshOptimizeStats* stats)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	float acmr_before = stats != NULL ? mesh_acmr(*mesh) : 0.0f;
+
+	vector<int> face_order;
+	forsyth_order(*mesh, &face_order);
+
+	//vertices numbered by first use in the new order, unused ones after them
+	vector<int> remap(mesh->vertex_num(), -1);
+	int next = 0;
+	for (size_t i = 0; i < face_order.size(); i++) {
+		const int *indices = mesh->face(face_order[i]).indics();
+		for (int j = 0; j < 3; j++) {
+			if (remap[indices[j]] < 0)
+				remap[indices[j]] = next++;
+		}
+	}
+	for (size_t v = 0; v < remap.size(); v++) {
+		if (remap[v] < 0)
+			remap[v] = next++;
+	}
+	mesh->Reorder(face_order, remap);
+
+	if (stats != NULL) {
+		stats->acmr_before = acmr_before;
+		stats->acmr_after = mesh_acmr(*mesh);
+		stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+}
@@ -0,0 +1,33 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <stddef.h>
+
+class Mesh;
+
+//entries of the simulated post-transform cache, a common hardware size
+static const int VERTEX_CACHE_SIZE = 16;
+
+//result of one optimize_vertex_cache
+struct MeshOptimizeStats
+{
+	float acmr_before;
+	float acmr_after;
+	double seconds;
+};
+
+/*
+*  average cache miss ratio: vertices transformed per triangle when faces are drawn in order
+*  through a FIFO cache of cache_size entries; 3 is the worst, about 0.5 the best for closed meshes
+*/
+float mesh_acmr(const Mesh& mesh, int cache_size = VERTEX_CACHE_SIZE);
+
+/*
+*  reorder faces so that consecutive triangles share vertices (Forsyth's linear-speed greedy
+*  optimizer over a simulated LRU cache), then renumber vertices in order of first use so that the
+*  index gathers of the triangle setup walk memory forward
+*  vertices no face uses are kept at the end; the mesh looks the same, only the order changes
+*/
+void optimize_vertex_cache(Mesh* mesh, MeshOptimizeStats* stats = NULL);
+
+#endif
@@ -0,0 +1,25 @@
+#include "model.h"
+#include <assert.h>
+#include "mesh.h"
+
+Model::Model(const Mesh* mesh, const Matrix4& transform, Color color)
+	: mesh_(mesh), color_(color), material_(0)
+{
+	assert(mesh != NULL);
+	set_transform(transform);
+}
+
+Model::~Model()
+{
+}
+
+void Model::set_transform(const Matrix4& transform)
+{
+	transform_ = transform;
+	BoundingBox local;
+	local.min = mesh_->bounds_min();
+	local.max = mesh_->bounds_max();
+	bounds_ = transform_box(local, transform);
+	//around the world box rather than the transformed local sphere, so that both stay consistent
+	sphere_ = box_sphere(bounds_);
+}
@@ -1,20 +1,43 @@
 #ifndef MODEL_H
 #define MODEL_H
 
+#include "matrix.h"
+#include "color.h"
+#include "bounds.h"
+
 class Mesh;
 
+//instance of a mesh in the world; the mesh is shared, not owned
 class Model
 {
 public:
-	Model();
+	Model(const Mesh* mesh, const Matrix4& transform, Color color);
 	~Model();
 
 	//update();
 
+	const Mesh* mesh() const { return mesh_; }
+	//model to world
+	const Matrix4& transform() const { return transform_; }
+	//also moves the bounds
+	void set_transform(const Matrix4& transform);
+	Color color() const { return color_; }
+	//index into the materials of the scene, 0 by default
+	int material() const { return material_; }
+	void set_material(int material) { material_ = material; }
+
+	//world space bounds of the mesh under transform
+	const BoundingBox& bounds() const { return bounds_; }
+	const BoundingSphere& sphere() const { return sphere_; }
+
 private:
-	Mesh* mesh_;
+	const Mesh* mesh_;
 	//Skeleton*
-
+	Matrix4 transform_;
+	Color color_;
+	int material_;
+	BoundingBox bounds_;
+	BoundingSphere sphere_;
 };
 
 #endif
@@ -0,0 +1,494 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <assert.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#include "renderer.h"
+#include "rasterizer.h"
+#include "vertex_processor.h"
+#include "clipper.h"
+#include "thread_pool.h"
+#include "profiler.h"
+#include "mesh.h"
+#include "gbuffer.h"
+#include "utils.h"
+
+using std::vector;
+
+/*
+*  templates shared by the fixed function path of Renderer and the programmable ShaderPipeline:
+*  the tile walk of one triangle, the bin loop over the thread pool and the primitive assembly of
+*  a mesh; every caller instantiates them with its own pixel kernel, so nothing in the inner loops
+*  goes through a function pointer
+*/
+
+static inline void store_pixel(FrameBuffer* framebuffer, Byte* pixel, float r, float g, float b, float a)
+{
+	switch (framebuffer->format()) {
+	case FORMAT_RGBA8:
+		pixel[0] = FloatToByte(r);
+		pixel[1] = FloatToByte(g);
+		pixel[2] = FloatToByte(b);
+		pixel[3] = FloatToByte(a);
+		break;
+	case FORMAT_BGRA8:
+		pixel[0] = FloatToByte(b);
+		pixel[1] = FloatToByte(g);
+		pixel[2] = FloatToByte(r);
+		pixel[3] = FloatToByte(a);
+		break;
+	default: {
+		float* value = (float*)pixel;
+		value[0] = r;
+		value[1] = g;
+		value[2] = b;
+		value[3] = a;
+		break;
+	}
+	}
+}
+
+static inline unsigned int QuantizeDepth(float z)
+{
+	z = z < 0 ? 0 : (z > 1 ? 1 : z);
+	return (unsigned int)(z * DEPTH_UNORM24_MAX + 0.5f);
+}
+
+/*
+*  walk the TILE_SIZE tiles of the triangle inside rect: tiles outside an edge or behind the
+*  hierarchical z are skipped, the others go to shade_tile(tile, origin, covered, depth_test),
+*  which returns whether it wrote a pixel (see ShadeTileFunc); returns whether any tile did
+*/
+template <typename ShadeTile>
+bool rasterize_tiles(const TriangleGeometry& setup, const PixelRect& rect, FrameBuffer* framebuffer, RasterStats* stats, ShadeTile shade_tile)
+{
+	PixelRect area = intersect_rect(setup.bounds, rect);
+	if (area.min_x > area.max_x || area.min_y > area.max_y)
+		return false;
+
+	const EdgeFunction* edges = setup.edges;
+	bool depth = framebuffer->has_depth();
+	bool written = false;
+
+	int tile_x0 = area.min_x & ~(TILE_SIZE - 1);
+	int tile_y0 = area.min_y & ~(TILE_SIZE - 1);
+	for (int ty = tile_y0; ty <= area.max_y; ty += TILE_SIZE) {
+		for (int tx = tile_x0; tx <= area.max_x; tx += TILE_SIZE) {
+			PixelRect tile;
+			tile.min_x = std::max(tx, area.min_x);
+			tile.min_y = std::max(ty, area.min_y);
+			tile.max_x = std::min(tx + TILE_SIZE - 1, area.max_x);
+			tile.max_y = std::min(ty + TILE_SIZE - 1, area.max_y);
+
+			int origin[3];
+			bool rejected = false, accepted = true;
+			for (int i = 0; i < 3; i++) {
+				int min_value, max_value;
+				edge_range(edges[i], tile, &origin[i], &min_value, &max_value);
+				if (max_value < 0) {
+					rejected = true;
+					break;
+				}
+				if (min_value < 0)
+					accepted = false;
+			}
+			if (rejected)
+				continue;
+
+			if (!depth) {
+				written = true;
+				stats->tiles++;
+				stats->fragments += (tile.max_x - tile.min_x + 1) * (tile.max_y - tile.min_y + 1);
+				shade_tile(tile, origin, accepted, false);
+				continue;
+			}
+
+			//depth range of the triangle over the tile: plane at the tile corners, bounded by the vertices
+			float span_x = setup.depth.dx * (tile.max_x - tile.min_x);
+			float span_y = setup.depth.dy * (tile.max_y - tile.min_y);
+			float z_origin = setup.depth.dx * tile.min_x + setup.depth.dy * tile.min_y + setup.depth.c;
+			float z_min = std::max(z_origin + std::min(span_x, 0.0f) + std::min(span_y, 0.0f), setup.min_z);
+			float z_max = std::min(z_origin + std::max(span_x, 0.0f) + std::max(span_y, 0.0f), setup.max_z);
+
+			int cell_x = tx / TILE_SIZE, cell_y = ty / TILE_SIZE;
+			if (z_min - HIZ_EPSILON >= framebuffer->hiz_tile_max(cell_x, cell_y)) {
+				stats->hiz_tiles++;
+				stats->hiz_fragments += accepted ? (tile.max_x - tile.min_x + 1) * (tile.max_y - tile.min_y + 1)
+					: count_covered(edges, tile, origin);
+				continue;
+			}
+			//in front of everything in the tile: skip the per-pixel compare
+			bool depth_test = !(z_max + HIZ_EPSILON < framebuffer->hiz_tile_min(cell_x, cell_y));
+			stats->tiles++;
+			stats->fragments += (tile.max_x - tile.min_x + 1) * (tile.max_y - tile.min_y + 1);
+			if (shade_tile(tile, origin, accepted, depth_test)) {
+				framebuffer->UpdateHiZTile(cell_x, cell_y);
+				written = true;
+			}
+		}
+	}
+	return written;
+}
+
+template <typename Geometry, typename Rasterize>
+void Renderer::RasterizeBins(Geometry geometry, Rasterize rasterize)
+{
+	for (size_t i = 0; i < worker_stats_.size(); i++)
+		memset(&worker_stats_[i], 0, sizeof(RasterStats));
+
+	//bins do not overlap, so every pixel (and every hierarchical z cell) is written by exactly one worker
+	thread_pool_->ParallelFor(bins_->bin_count(), [this, &geometry, &rasterize](int bin, int worker) {
+		const vector<int>& indices = bins_->triangles(bin);
+		if (indices.empty())
+			return;
+		ProfileScope scope(STAGE_RASTER);
+		PixelRect rect = bins_->bin_rect(bin);
+		int bx = rect.min_x / BIN_SIZE, by = rect.min_y / BIN_SIZE;
+		bool depth = framebuffer_->has_depth();
+		RasterStats* stats = &worker_stats_[worker];
+		RasterStats before = *stats;
+		for (size_t i = 0; i < indices.size(); i++) {
+			const TriangleGeometry& setup = geometry(indices[i]);
+			//whole triangle behind everything already drawn in this bin
+			if (depth && setup.min_z - HIZ_EPSILON >= framebuffer_->hiz_bin_max(bx, by)) {
+				PixelRect overlap = intersect_rect(setup.bounds, rect);
+				long long overlap_area = (long long)(overlap.max_x - overlap.min_x + 1) * (overlap.max_y - overlap.min_y + 1);
+				stats->hiz_triangles++;
+				stats->hiz_fragments += std::min((long long)setup.area, overlap_area);
+				continue;
+			}
+			stats->triangles++;
+			if (rasterize(indices[i], rect, stats) && depth)
+				framebuffer_->UpdateHiZBin(bx, by);
+		}
+		profile_count(COUNTER_TRIANGLES, stats->triangles - before.triangles);
+		profile_count(COUNTER_TILES, stats->tiles - before.tiles);
+		profile_count(COUNTER_FRAGMENTS, stats->fragments - before.fragments);
+	});
+
+	for (size_t i = 0; i < worker_stats_.size(); i++) {
+		stats_.triangles += worker_stats_[i].triangles;
+		stats_.tiles += worker_stats_[i].tiles;
+		stats_.fragments += worker_stats_[i].fragments;
+		stats_.hiz_triangles += worker_stats_[i].hiz_triangles;
+		stats_.hiz_tiles += worker_stats_[i].hiz_tiles;
+		stats_.hiz_fragments += worker_stats_[i].hiz_fragments;
+	}
+}
+
+//corner of an assembled triangle
+struct AssembledVertex
+{
+	Vector3f screen;	//framebuffer x, y in pixels, depth z in [0, 1]
+	float inv_w;		//1 / clip w
+	int corner;			//face corner it is, or -1 for a vertex made by the clipper
+	float weights[3];	//of the three face corners
+};
+
+template <typename Emit>
+void Renderer::AssembleTriangles(const Mesh& mesh, const Viewport& viewport, Emit emit)
+{
+	ClipGuardBand guard = clip_guard_band(viewport);
+	//twice the signed screen area of front faces is positive, this flips it for the cull test
+	float cull_sign = cull_mode_ == CULL_BACK ? 1.0f : -1.0f;
+	bool cull = cull_mode_ != CULL_NONE;
+	long long clipped = 0, backfaces = 0;
+	const float* inv_w = transformed_->screen(3);
+	for (int i = 0; i < mesh.face_num(); i++) {
+		const int *indices = mesh.face(i).indics();
+		ClipCode c0 = clip_codes_[indices[0]], c1 = clip_codes_[indices[1]], c2 = clip_codes_[indices[2]];
+		//all outside one plane
+		if (c0 & c1 & c2)
+			continue;
+		ClipCode planes = (c0 | c1 | c2) & CLIP_NEEDED;
+		if (planes == 0) {
+			AssembledVertex v[3];
+			for (int j = 0; j < 3; j++) {
+				v[j].screen = transformed_->screen_position(indices[j]);
+				v[j].inv_w = inv_w[indices[j]];
+				v[j].corner = j;
+				for (int k = 0; k < 3; k++)
+					v[j].weights[k] = j == k ? 1.0f : 0.0f;
+			}
+			const Vector3f &s0 = v[0].screen, &s1 = v[1].screen, &s2 = v[2].screen;
+			if (cull && cull_sign * ((s1.x - s0.x) * (s2.y - s0.y) - (s1.y - s0.y) * (s2.x - s0.x)) < 0) {
+				backfaces++;
+				continue;
+			}
+			emit(i, v[0], v[1], v[2]);
+			continue;
+		}
+
+		clipped++;
+		ClipVertex triangle[3];
+		for (int j = 0; j < 3; j++) {
+			ClipVertex& v = triangle[j];
+			v.x = transformed_->clip(0)[indices[j]];
+			v.y = transformed_->clip(1)[indices[j]];
+			v.z = transformed_->clip(2)[indices[j]];
+			v.w = transformed_->clip(3)[indices[j]];
+			for (int k = 0; k < 3; k++)
+				v.weights[k] = j == k ? 1.0f : 0.0f;
+		}
+		ClipVertex polygon[CLIP_MAX_VERTICES];
+		int count = clip_triangle(triangle, planes, guard, polygon);
+		AssembledVertex assembled[CLIP_MAX_VERTICES];
+		for (int k = 0; k < count; k++) {
+			//vertices that were not moved keep the exact position of the vertex stage, so no cracks open to their neighbours
+			AssembledVertex& v = assembled[k];
+			v.corner = -1;
+			for (int j = 0; j < 3; j++) {
+				v.weights[j] = polygon[k].weights[j];
+				if (polygon[k].weights[j] == 1.0f)
+					v.corner = j;
+			}
+			if (v.corner >= 0) {
+				v.screen = transformed_->screen_position(indices[v.corner]);
+				v.inv_w = inv_w[indices[v.corner]];
+			}
+			else {
+				v.screen = project_clip_vertex(polygon[k], viewport);
+				v.inv_w = 1.0f / polygon[k].w;
+			}
+		}
+		//the clipped polygon is convex and planar, its area decides for every triangle of the fan
+		float area = 0;
+		for (int k = 0; k < count; k++) {
+			const Vector3f& a = assembled[k].screen;
+			const Vector3f& b = assembled[(k + 1) % count].screen;
+			area += a.x * b.y - a.y * b.x;
+		}
+		if (cull && count > 0 && cull_sign * area < 0) {
+			backfaces++;
+			continue;
+		}
+		for (int k = 2; k < count; k++)
+			emit(i, assembled[0], assembled[k - 1], assembled[k]);
+	}
+	stats_.clipped += clipped;
+	stats_.backfaces += backfaces;
+	profile_count(COUNTER_CLIPPED, clipped);
+	profile_count(COUNTER_BACKFACES, backfaces);
+}
+
+/*
+*  programmable pipeline for one shader type, see shader.h: the vertex stage runs Shader::Vertex
+*  on every vertex, faces are clipped and culled like Renderer::DrawMesh, and every triangle
+*  carries one screen-space plane per varying (divided by w, so that dividing by the interpolated
+*  1 / w makes them perspective correct); the tile kernel calls Shader::Fragment for every pixel
+*  that passes the depth test, or Shader::Surface when drawing into a GBuffer
+*  keeps its buffers from draw to draw, one pipeline per renderer and shader type
+*/
+template <typename Shader>
+class ShaderPipeline
+{
+public:
+	typedef typename Shader::Varyings Varyings;
+	static_assert(sizeof(Varyings) >= sizeof(float) && sizeof(Varyings) % sizeof(float) == 0 && std::is_trivially_copyable<Varyings>::value,
+		"varyings are plain structs of floats");
+	static const int VARYING_NUM = (int)(sizeof(Varyings) / sizeof(float));
+
+	explicit ShaderPipeline(Renderer* renderer) : renderer_(renderer) {}
+
+	ShaderPipeline(const ShaderPipeline&) = delete;
+	ShaderPipeline& operator=(const ShaderPipeline&) = delete;
+
+	//shade all faces of mesh right away, after the triangles queued on the renderer so far
+	void DrawMesh(const Mesh& mesh, const Shader& shader);
+	//store the surfaces of all faces of mesh in gbuffer instead of shading them; depth is tested
+	//against and written to the framebuffer like DrawMesh, whose colors stay untouched
+	void DrawMesh(const Mesh& mesh, const Shader& shader, GBuffer* gbuffer);
+
+private:
+	struct Triangle
+	{
+		TriangleGeometry geometry;
+		AttributePlane inv_w;
+		AttributePlane varyings[VARYING_NUM];	//varying / w
+	};
+
+	//store(row, x, y, varyings) writes every pixel that passes the depth test, row is row y of the framebuffer
+	template <typename Store>
+	void Draw(const Mesh& mesh, const Shader& shader, Store store);
+	void SetupTriangle(int face, const AssembledVertex* const vertices[3]);
+	template <typename Store>
+	static bool ShadeTile(const Triangle& triangle, const PixelRect& tile, const int origin[3], bool covered, bool depth_test, FrameBuffer* framebuffer, const Store& store);
+
+	Renderer* renderer_;
+	const Mesh* mesh_;				//of the current DrawMesh
+	vector<Varyings> varyings_;		//vertex stage output
+	vector<Triangle> triangles_;
+};
+
+template <typename Shader>
+void ShaderPipeline<Shader>::DrawMesh(const Mesh& mesh, const Shader& shader)
+{
+	FrameBuffer* framebuffer = renderer_->framebuffer_;
+	int pixel_size = framebuffer->pixel_size();
+	Draw(mesh, shader, [&shader, framebuffer, pixel_size](Byte* row, int x, int, const Varyings& varyings) {
+		Vector4f color = shader.Fragment(varyings);
+		store_pixel(framebuffer, row + x * pixel_size, color.x, color.y, color.z, color.w);
+	});
+}
+
+template <typename Shader>
+void ShaderPipeline<Shader>::DrawMesh(const Mesh& mesh, const Shader& shader, GBuffer* gbuffer)
+{
+	assert(gbuffer->width() == renderer_->framebuffer_->width() && gbuffer->height() == renderer_->framebuffer_->height());
+	Draw(mesh, shader, [&shader, gbuffer](Byte*, int x, int y, const Varyings& varyings) {
+		GBufferSample sample;
+		shader.Surface(varyings, &sample);
+		gbuffer->Store(x, y, sample);
+	});
+}
+
+template <typename Shader>
+template <typename Store>
+void ShaderPipeline<Shader>::Draw(const Mesh& mesh, const Shader& shader, Store store)
+{
+	Renderer* renderer = renderer_;
+	renderer->Flush();
+	FrameBuffer* framebuffer = renderer->framebuffer_;
+	Viewport viewport = { framebuffer->width(), framebuffer->height() };
+	VertexStreams input = mesh.streams();
+	{
+		ProfileScope scope(STAGE_VERTEX);
+		PostTransformBuffer* transformed = renderer->transformed_;
+		transformed->Resize(input.count);
+		varyings_.resize(input.count);
+		float *clip[4], *screen[4];
+		for (int k = 0; k < 4; k++) {
+			clip[k] = transformed->clip(k);
+			screen[k] = transformed->screen(k);
+		}
+		for (int i = 0; i < input.count; i++) {
+			Vector4f position = shader.Vertex(input, i, &varyings_[i]);
+			ClipVertex v;
+			v.x = clip[0][i] = position.x;
+			v.y = clip[1][i] = position.y;
+			v.z = clip[2][i] = position.z;
+			v.w = clip[3][i] = position.w;
+			//the mapping of the clipper, so that vertices it makes line up with these; only used when w > 0
+			Vector3f projected = project_clip_vertex(v, viewport);
+			screen[0][i] = projected.x;
+			screen[1][i] = projected.y;
+			screen[2][i] = projected.z;
+			screen[3][i] = 1.0f / position.w;
+		}
+		renderer->clip_codes_.resize(input.count);
+		compute_clip_codes(*transformed, clip_guard_band(viewport), renderer->clip_codes_.data());
+	}
+
+	mesh_ = &mesh;
+	triangles_.clear();
+	renderer->AssembleTriangles(mesh, viewport, [this](int face, const AssembledVertex& v0, const AssembledVertex& v1, const AssembledVertex& v2) {
+		const AssembledVertex* vertices[3] = { &v0, &v1, &v2 };
+		SetupTriangle(face, vertices);
+	});
+	if (triangles_.empty())
+		return;
+
+	{
+		ProfileScope scope(STAGE_BIN);
+		renderer->bins_->Clear();
+		for (int i = 0; i < (int)triangles_.size(); i++)
+			renderer->bins_->Insert(i, triangles_[i].geometry);
+	}
+	renderer->RasterizeBins([this](int i) -> const TriangleGeometry& { return triangles_[i].geometry; },
+		[this, &store, framebuffer](int i, const PixelRect& rect, RasterStats* stats) {
+		const Triangle& triangle = triangles_[i];
+		return rasterize_tiles(triangle.geometry, rect, framebuffer, stats, [&](const PixelRect& tile, const int origin[3], bool covered, bool depth_test) {
+			return ShadeTile(triangle, tile, origin, covered, depth_test, framebuffer, store);
+		});
+	});
+}
+
+template <typename Shader>
+void ShaderPipeline<Shader>::SetupTriangle(int face, const AssembledVertex* const vertices[3])
+{
+	Triangle triangle;
+	SnappedVertices snapped;
+	if (!setup_geometry(vertices[0]->screen, vertices[1]->screen, vertices[2]->screen, renderer_->framebuffer_, &triangle.geometry, &snapped))
+		return;
+
+	//varyings of vertices made by the clipper are blended from the face corners, in clip space
+	const int *indices = mesh_->face(face).indics();
+	const float *corners[3];
+	for (int j = 0; j < 3; j++)
+		corners[j] = (const float*)&varyings_[indices[j]];
+	const float *values[3];
+	float blended[3][VARYING_NUM];
+	for (int j = 0; j < 3; j++) {
+		const AssembledVertex& v = *vertices[j];
+		if (v.corner >= 0) {
+			values[j] = corners[v.corner];
+			continue;
+		}
+		for (int k = 0; k < VARYING_NUM; k++)
+			blended[j][k] = v.weights[0] * corners[0][k] + v.weights[1] * corners[1][k] + v.weights[2] * corners[2][k];
+		values[j] = blended[j];
+	}
+
+	float inv_w[3] = { vertices[0]->inv_w, vertices[1]->inv_w, vertices[2]->inv_w };
+	triangle.inv_w = attribute_plane(snapped, inv_w);
+	for (int k = 0; k < VARYING_NUM; k++) {
+		float scaled[3] = { values[0][k] * inv_w[0], values[1][k] * inv_w[1], values[2][k] * inv_w[2] };
+		triangle.varyings[k] = attribute_plane(snapped, scaled);
+	}
+	triangles_.push_back(triangle);
+}
+
+template <typename Shader>
+template <typename Store>
+bool ShaderPipeline<Shader>::ShadeTile(const Triangle& triangle, const PixelRect& tile, const int origin[3], bool covered, bool depth_test, FrameBuffer* framebuffer, const Store& store)
+{
+	const TriangleGeometry& setup = triangle.geometry;
+	const EdgeFunction* edges = setup.edges;
+	DepthFormat depth_format = framebuffer->depth_format();
+	bool written = false;
+	for (int y = tile.min_y; y <= tile.max_y; y++) {
+		int dy = y - tile.min_y;
+		int w0 = origin[0] + dy * edges[0].b, w1 = origin[1] + dy * edges[1].b, w2 = origin[2] + dy * edges[2].b;
+		Byte* row = framebuffer->row(y);
+		Byte* depth_row = depth_format != DEPTH_NONE ? framebuffer->depth_row(y) : NULL;
+		//same rounding as the fixed function kernels, so both paths agree on depth
+		float depth_base = setup.depth.dy * (float)y + setup.depth.c;
+		float inv_w_base = triangle.inv_w.dy * (float)y + triangle.inv_w.c;
+		float base[VARYING_NUM];
+		for (int k = 0; k < VARYING_NUM; k++)
+			base[k] = triangle.varyings[k].dy * (float)y + triangle.varyings[k].c;
+
+		for (int x = tile.min_x; x <= tile.max_x; x++, w0 += edges[0].a, w1 += edges[1].a, w2 += edges[2].a) {
+			if (!covered && (w0 | w1 | w2) < 0)
+				continue;
+			float xf = (float)x;
+			if (depth_format == DEPTH_FLOAT32) {
+				float z = setup.depth.dx * xf + depth_base;
+				float* stored = (float*)depth_row + x;
+				if (depth_test && !(z < *stored))
+					continue;
+				*stored = z;
+			}
+			else if (depth_format == DEPTH_UNORM24) {
+				unsigned int z = QuantizeDepth(setup.depth.dx * xf + depth_base);
+				unsigned int* stored = (unsigned int*)depth_row + x;
+				if (depth_test && !(z < *stored))
+					continue;
+				*stored = z;
+			}
+			float w = 1.0f / (triangle.inv_w.dx * xf + inv_w_base);
+			Varyings varyings;
+			float* values = (float*)&varyings;
+			for (int k = 0; k < VARYING_NUM; k++)
+				values[k] = (triangle.varyings[k].dx * xf + base[k]) * w;
+			store(row, x, y, varyings);
+			written = true;
+		}
+	}
+	return written;
+}
+
+#endif
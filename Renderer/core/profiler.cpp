@@ -0,0 +1,275 @@
+#include "profiler.h"
+#include <assert.h>
+#include <string.h>
+#include <chrono>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+using std::vector;
+
+//buffered trace events per thread, later ones are dropped until the next write_trace
+static const size_t TRACE_EVENT_LIMIT = 1 << 20;
+
+struct TraceEvent
+{
+	double start;		//microseconds
+	double duration;
+	int stage;			//STAGE_NUM for a whole frame
+	long long counters[COUNTER_NUM];	//frames only, summed over threads
+};
+
+//written only by its own thread, read by profiler_end_frame while no parallel work runs
+struct ThreadProfile
+{
+	int id;
+	double stage_time[STAGE_NUM];		//current frame, microseconds
+	long long counters[COUNTER_NUM];	//current frame
+	long long totals[COUNTER_NUM];		//since profiler_enable
+	vector<TraceEvent> events;
+};
+
+struct ProfilerState
+{
+	std::mutex mutex;	//guards threads
+	vector<std::unique_ptr<ThreadProfile>> threads;
+	std::atomic<bool> enabled;
+	std::atomic<bool> tracing;
+	std::chrono::steady_clock::time_point epoch;
+	double frame_start;
+	int frames;			//frames recorded since profiler_enable
+	float history[STAGE_NUM + 1][PROFILE_HISTORY];	//milliseconds, the frame total last
+
+	ProfilerState() : enabled(false), tracing(false), epoch(std::chrono::steady_clock::now()), frame_start(-1), frames(0) {}
+};
+
+static ProfilerState& state()
+{
+	static ProfilerState profiler;
+	return profiler;
+}
+
+//profile of the calling thread, registered on first use
+static ThreadProfile *thread_profile()
+{
+	static thread_local ThreadProfile *profile = NULL;
+	if (profile == NULL) {
+		ProfilerState& s = state();
+		std::lock_guard<std::mutex> lock(s.mutex);
+		s.threads.emplace_back(new ThreadProfile());
+		profile = s.threads.back().get();
+		memset(profile->stage_time, 0, sizeof(profile->stage_time));
+		memset(profile->counters, 0, sizeof(profile->counters));
+		memset(profile->totals, 0, sizeof(profile->totals));
+		profile->id = (int)s.threads.size() - 1;
+	}
+	return profile;
+}
+
+void profiler_enable(bool enabled)
+{
+	ProfilerState& s = state();
+	if (enabled && !s.enabled) {
+		std::lock_guard<std::mutex> lock(s.mutex);
+		for (size_t i = 0; i < s.threads.size(); i++) {
+			ThreadProfile *profile = s.threads[i].get();
+			memset(profile->stage_time, 0, sizeof(profile->stage_time));
+			memset(profile->counters, 0, sizeof(profile->counters));
+			memset(profile->totals, 0, sizeof(profile->totals));
+		}
+		s.frames = 0;
+		s.frame_start = -1;
+	}
+	s.enabled = enabled;
+}
+
+bool profiler_enabled()
+{
+	return state().enabled.load(std::memory_order_relaxed);
+}
+
+double profiler_time()
+{
+	return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - state().epoch).count();
+}
+
+ProfileScope::~ProfileScope()
+{
+	if (start_ < 0)
+		return;
+	double end = profiler_time();
+	ThreadProfile *profile = thread_profile();
+	profile->stage_time[stage_] += end - start_;
+	if (state().tracing.load(std::memory_order_relaxed) && profile->events.size() < TRACE_EVENT_LIMIT) {
+		TraceEvent event = { start_, end - start_, stage_, { 0 } };
+		profile->events.push_back(event);
+	}
+}
+
+void profile_count(ProfileCounter counter, long long value)
+{
+	assert(counter >= 0 && counter < COUNTER_NUM);
+	if (profiler_enabled())
+		thread_profile()->counters[counter] += value;
+}
+
+void profiler_begin_frame()
+{
+	if (profiler_enabled())
+		state().frame_start = profiler_time();
+}
+
+void profiler_end_frame()
+{
+	ProfilerState& s = state();
+	if (!profiler_enabled() || s.frame_start < 0)
+		return;
+	double end = profiler_time();
+	double stage_time[STAGE_NUM] = { 0 };
+	long long counters[COUNTER_NUM] = { 0 };
+	{
+		std::lock_guard<std::mutex> lock(s.mutex);
+		for (size_t i = 0; i < s.threads.size(); i++) {
+			ThreadProfile *profile = s.threads[i].get();
+			for (int stage = 0; stage < STAGE_NUM; stage++) {
+				stage_time[stage] += profile->stage_time[stage];
+				profile->stage_time[stage] = 0;
+			}
+			for (int counter = 0; counter < COUNTER_NUM; counter++) {
+				counters[counter] += profile->counters[counter];
+				profile->totals[counter] += profile->counters[counter];
+				profile->counters[counter] = 0;
+			}
+		}
+	}
+
+	int slot = s.frames % PROFILE_HISTORY;
+	for (int stage = 0; stage < STAGE_NUM; stage++)
+		s.history[stage][slot] = (float)(stage_time[stage] / 1000.0);
+	s.history[STAGE_NUM][slot] = (float)((end - s.frame_start) / 1000.0);
+	s.frames++;
+
+	ThreadProfile *profile = thread_profile();
+	if (s.tracing && profile->events.size() < TRACE_EVENT_LIMIT) {
+		TraceEvent event = { s.frame_start, end - s.frame_start, STAGE_NUM, { 0 } };
+		memcpy(event.counters, counters, sizeof(counters));
+		profile->events.push_back(event);
+	}
+	s.frame_start = -1;
+}
+
+double profiler_percentile(ProfileStage stage, double percentile)
+{
+	assert(stage >= 0 && stage <= STAGE_NUM);
+	ProfilerState& s = state();
+	int count = std::min(s.frames, PROFILE_HISTORY);
+	if (count == 0)
+		return 0.0;
+	float samples[PROFILE_HISTORY];
+	memcpy(samples, s.history[stage], count * sizeof(float));
+	std::sort(samples, samples + count);
+	percentile = std::min(std::max(percentile, 0.0), 100.0);
+	return samples[(int)(percentile / 100.0 * (count - 1) + 0.5)];
+}
+
+int profiler_frame_count()
+{
+	return state().frames;
+}
+
+void profiler_print_report(FILE *file)
+{
+	ProfilerState& s = state();
+	fprintf(file, "profile of %d frames, percentiles over the last %d\n", s.frames, std::min(s.frames, PROFILE_HISTORY));
+	fprintf(file, "%-10s %10s %10s\n", "stage", "p50 ms", "p99 ms");
+	fprintf(file, "%-10s %10.3f %10.3f\n", "frame", profiler_percentile(STAGE_NUM, 50), profiler_percentile(STAGE_NUM, 99));
+	for (int stage = 0; stage < STAGE_NUM; stage++) {
+		fprintf(file, "%-10s %10.3f %10.3f\n", profile_stage_name((ProfileStage)stage),
+			profiler_percentile((ProfileStage)stage, 50), profiler_percentile((ProfileStage)stage, 99));
+	}
+
+	std::lock_guard<std::mutex> lock(s.mutex);
+	fprintf(file, "%-10s", "thread");
+	for (int counter = 0; counter < COUNTER_NUM; counter++)
+		fprintf(file, " %14s", profile_counter_name((ProfileCounter)counter));
+	fprintf(file, "\n");
+	for (size_t i = 0; i < s.threads.size(); i++) {
+		fprintf(file, "%-10d", s.threads[i]->id);
+		for (int counter = 0; counter < COUNTER_NUM; counter++)
+			fprintf(file, " %14lld", s.threads[i]->totals[counter]);
+		fprintf(file, "\n");
+	}
+}
+
+void profiler_start_trace()
+{
+	ProfilerState& s = state();
+	{
+		std::lock_guard<std::mutex> lock(s.mutex);
+		for (size_t i = 0; i < s.threads.size(); i++)
+			s.threads[i]->events.clear();
+	}
+	s.tracing = true;
+}
+
+bool profiler_write_trace(const char *filePath)
+{
+	ProfilerState& s = state();
+	s.tracing = false;
+	FILE *file = fopen(filePath, "wb");
+	if (file == NULL)
+		return false;
+
+	std::lock_guard<std::mutex> lock(s.mutex);
+	fprintf(file, "{\"traceEvents\":[\n");
+	bool first = true;
+	for (size_t i = 0; i < s.threads.size(); i++) {
+		ThreadProfile *profile = s.threads[i].get();
+		fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+			first ? "" : ",\n", profile->id, profile->id);
+		first = false;
+		for (size_t j = 0; j < profile->events.size(); j++) {
+			const TraceEvent& event = profile->events[j];
+			const char *name = event.stage == STAGE_NUM ? "frame" : profile_stage_name((ProfileStage)event.stage);
+			fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}",
+				name, event.start, event.duration, profile->id);
+			if (event.stage == STAGE_NUM) {
+				fprintf(file, ",\n{\"name\":\"counters\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"args\":{", event.start);
+				for (int counter = 0; counter < COUNTER_NUM; counter++)
+					fprintf(file, "%s\"%s\":%lld", counter ? "," : "", profile_counter_name((ProfileCounter)counter), event.counters[counter]);
+				fprintf(file, "}}");
+			}
+		}
+		profile->events.clear();
+	}
+	fprintf(file, "\n]}\n");
+	return fclose(file) == 0;
+}
+
+const char *profile_stage_name(ProfileStage stage)
+{
+	switch (stage) {
+	case STAGE_VERTEX:  return "vertex";
+	case STAGE_BIN:     return "bin";
+	case STAGE_RASTER:  return "raster";
+	case STAGE_SHADE:   return "shade";
+	case STAGE_BLIT:    return "blit";
+	case STAGE_PRESENT: return "present";
+	default:            return "unknown";
+	}
+}
+
+const char *profile_counter_name(ProfileCounter counter)
+{
+	switch (counter) {
+	case COUNTER_TRIANGLES:     return "triangles";
+	case COUNTER_TILES:         return "tiles";
+	case COUNTER_FRAGMENTS:     return "fragments";
+	case COUNTER_CLIPPED:       return "clipped";
+	case COUNTER_BACKFACES:     return "backfaces";
+	case COUNTER_CULLED_MODELS: return "culled_models";
+	default:                    return "unknown";
+	}
+}
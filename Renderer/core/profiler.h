@@ -0,0 +1,61 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdio.h>
+
+//pipeline stages timed by ProfileScope; SHADE is for shading passes that run apart from rasterization
+typedef enum { STAGE_VERTEX = 0, STAGE_BIN, STAGE_RASTER, STAGE_SHADE, STAGE_BLIT, STAGE_PRESENT, STAGE_NUM } ProfileStage;
+//per-thread counters, see RasterStats for what the rasterizer counts
+typedef enum { COUNTER_TRIANGLES = 0, COUNTER_TILES, COUNTER_FRAGMENTS, COUNTER_CLIPPED, COUNTER_BACKFACES, COUNTER_CULLED_MODELS, COUNTER_NUM } ProfileCounter;
+
+//frames kept for the percentiles
+static const int PROFILE_HISTORY = 256;
+
+/*
+*  frame profiler: stage timers and counters are kept per thread and collected by
+*  profiler_end_frame into a rolling history of the last PROFILE_HISTORY frames
+*  stage times of a frame are summed over all threads, so parallel stages report cpu time
+*  off by default; a disabled ProfileScope reads no clock, an enabled one reads it twice
+*  while tracing every scope is also stored as an event for write_trace
+*/
+void profiler_enable(bool enabled);
+bool profiler_enabled();
+//microseconds on a steady clock
+double profiler_time();
+
+//frame boundaries, called on the main thread while no parallel work runs
+void profiler_begin_frame();
+void profiler_end_frame();
+
+//add value to counter of the calling thread
+void profile_count(ProfileCounter counter, long long value);
+
+//time of stage (or of the whole frame, stage == STAGE_NUM) at percentile in [0, 100] over the history, in milliseconds
+double profiler_percentile(ProfileStage stage, double percentile);
+int profiler_frame_count();
+//stage percentiles and per-thread counter totals since profiler_enable
+void profiler_print_report(FILE *file);
+
+//events are buffered from start_trace until write_trace, which writes chrome://tracing json
+void profiler_start_trace();
+bool profiler_write_trace(const char *filePath);
+
+const char *profile_stage_name(ProfileStage stage);
+const char *profile_counter_name(ProfileCounter counter);
+
+//times the enclosing scope as stage
+class ProfileScope
+{
+public:
+	explicit ProfileScope(ProfileStage stage) : stage_(stage), start_(profiler_enabled() ? profiler_time() : -1.0) {}
+	~ProfileScope();
+
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+	ProfileStage stage_;
+	double start_;	//negative when the profiler was off
+};
+
+#endif
@@ -0,0 +1,765 @@
+#include "rasterizer.h"
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include "renderer.h"
+#include "color.h"
+#include "utils.h"
+#include "simd.h"
+#include "pipeline.h"
+
+static inline long long FloorShift(long long value, int bits)
+{
+	//arithmetic shift rounds towards negative infinity
+	return value >> bits;
+}
+
+static inline long long SnapToFixed(float value)
+{
+	return (long long)floorf(value * SUBPIXEL_ONE + 0.5f);
+}
+
+//screen-space plane through three values at the snapped vertex positions
+static AttributePlane compute_plane(const long long fx[3], const long long fy[3], float v0, float v1, float v2)
+{
+	double x0 = (double)fx[0] / SUBPIXEL_ONE, y0 = (double)fy[0] / SUBPIXEL_ONE;
+	double x10 = (double)(fx[1] - fx[0]) / SUBPIXEL_ONE, y10 = (double)(fy[1] - fy[0]) / SUBPIXEL_ONE;
+	double x20 = (double)(fx[2] - fx[0]) / SUBPIXEL_ONE, y20 = (double)(fy[2] - fy[0]) / SUBPIXEL_ONE;
+	double inv_det = 1.0 / (x10 * y20 - x20 * y10);
+	double a10 = (double)v1 - v0, a20 = (double)v2 - v0;
+	double dx = (a10 * y20 - a20 * y10) * inv_det;
+	double dy = (a20 * x10 - a10 * x20) * inv_det;
+
+	//c is relative to the center of pixel (0, 0)
+	AttributePlane plane;
+	plane.dx = (float)dx;
+	plane.dy = (float)dy;
+	plane.c = (float)(v0 + dx * (0.5 - x0) + dy * (0.5 - y0));
+	return plane;
+}
+
+static AttributePlane constant_plane(float value)
+{
+	AttributePlane plane;
+	plane.dx = 0;
+	plane.dy = 0;
+	plane.c = value;
+	return plane;
+}
+
+bool setup_geometry(const Vector3f& v0, const Vector3f& v1, const Vector3f& v2, const FrameBuffer* framebuffer, TriangleGeometry* setup, SnappedVertices* snapped)
+{
+	int width = framebuffer->width(), height = framebuffer->height();
+	assert(width <= RASTER_MAX_SIZE && height <= RASTER_MAX_SIZE);
+
+	const Vector3f* vertices[3] = { &v0, &v1, &v2 };
+	long long *fx = snapped->x, *fy = snapped->y;
+	int *order = snapped->order;
+	for (int i = 0; i < 3; i++) {
+		float x = vertices[i]->x, y = vertices[i]->y;
+		if (!(x >= -RASTER_GUARD_BAND && x <= width + RASTER_GUARD_BAND && y >= -RASTER_GUARD_BAND && y <= height + RASTER_GUARD_BAND))
+			return false;
+		fx[i] = SnapToFixed(x);
+		fy[i] = SnapToFixed(y);
+		order[i] = i;
+	}
+
+	//twice the signed area, counter-clockwise (y up) is positive; reorder clockwise triangles
+	long long area = (fx[1] - fx[0]) * (fy[2] - fy[0]) - (fy[1] - fy[0]) * (fx[2] - fx[0]);
+	if (area == 0)
+		return false;
+	if (area < 0) {
+		area = -area;
+		std::swap(fx[1], fx[2]);
+		std::swap(fy[1], fy[2]);
+		std::swap(vertices[1], vertices[2]);
+		std::swap(order[1], order[2]);
+	}
+	setup->area = (float)area / (2 * SUBPIXEL_ONE * SUBPIXEL_ONE);
+
+	long long min_fx = std::min(fx[0], std::min(fx[1], fx[2]));
+	long long min_fy = std::min(fy[0], std::min(fy[1], fy[2]));
+	long long max_fx = std::max(fx[0], std::max(fx[1], fx[2]));
+	long long max_fy = std::max(fy[0], std::max(fy[1], fy[2]));
+	PixelRect& bounds = setup->bounds;
+	bounds.min_x = std::max(0, (int)FloorShift(min_fx, SUBPIXEL_BITS));
+	bounds.min_y = std::max(0, (int)FloorShift(min_fy, SUBPIXEL_BITS));
+	bounds.max_x = std::min(width - 1, (int)FloorShift(max_fx, SUBPIXEL_BITS));
+	bounds.max_y = std::min(height - 1, (int)FloorShift(max_fy, SUBPIXEL_BITS));
+	if (bounds.min_x > bounds.max_x || bounds.min_y > bounds.max_y)
+		return false;
+
+	for (int i = 0; i < 3; i++) {
+		int j = (i + 1) % 3;
+		long long a = fy[i] - fy[j];
+		long long b = fx[j] - fx[i];
+		//top-left rule: pixel centers exactly on a right or bottom edge belong to the neighbour
+		bool top_left = a > 0 || (a == 0 && b < 0);
+		//e_fixed = 16 * (a * x + b * y) + k at the center of pixel (x, y); fold k into c exactly
+		long long k = a * (SUBPIXEL_ONE / 2 - fx[i]) + b * (SUBPIXEL_ONE / 2 - fy[i]) + (top_left ? 0 : -1);
+		setup->edges[i].a = (int)a;
+		setup->edges[i].b = (int)b;
+		setup->edges[i].c = (int)FloorShift(k, SUBPIXEL_BITS);
+	}
+
+	float z0 = vertices[0]->z, z1 = vertices[1]->z, z2 = vertices[2]->z;
+	setup->depth = compute_plane(fx, fy, z0, z1, z2);
+	setup->min_z = std::min(z0, std::min(z1, z2));
+	setup->max_z = std::max(z0, std::max(z1, z2));
+	return true;
+}
+
+AttributePlane attribute_plane(const SnappedVertices& snapped, const float values[3])
+{
+	return compute_plane(snapped.x, snapped.y, values[snapped.order[0]], values[snapped.order[1]], values[snapped.order[2]]);
+}
+
+bool setup_triangle(const Vector3f& v0, const Vector3f& v1, const Vector3f& v2, Color c0, Color c1, Color c2, const FrameBuffer* framebuffer, TriangleSetup* setup)
+{
+	SnappedVertices snapped;
+	if (!setup_geometry(v0, v1, v2, framebuffer, setup, &snapped))
+		return false;
+
+	const Color* colors[3] = { &c0, &c1, &c2 };
+	setup->flat = true;
+	for (int i = 1; i < 3; i++) {
+		if (colors[i]->r != c0.r || colors[i]->g != c0.g || colors[i]->b != c0.b || colors[i]->a != c0.a)
+			setup->flat = false;
+	}
+	framebuffer->PackColor(c0, setup->color);
+	for (int k = 0; k < 4; k++) {
+		float values[3] = { (&c0.r)[k], (&c1.r)[k], (&c2.r)[k] };
+		//a constant plane evaluates to exactly the vertex value, so depth-tested flat triangles can use the kernels
+		setup->colors[k] = setup->flat ? constant_plane(values[0]) : attribute_plane(snapped, values);
+	}
+	return true;
+}
+
+//fill pixels [x0, x1] of one row with an already packed color
+static inline void fill_span(Byte* row, int x0, int x1, const Byte* packed, int pixel_size)
+{
+	if (pixel_size == 4) {
+		unsigned int value;
+		memcpy(&value, packed, 4);
+		unsigned int* dst = (unsigned int*)row;
+		for (int x = x0; x <= x1; x++)
+			dst[x] = value;
+	}
+	else {
+		for (int x = x0; x <= x1; x++)
+			memcpy(row + x * pixel_size, packed, pixel_size);
+	}
+}
+
+/*
+*  tile kernels
+*  every lane computes dx * x + (dy * y + c) with separate multiply and add, so all versions round
+*  the same way and write the same bytes
+*/
+static bool shade_span_scalar(const TriangleSetup& setup, int y, int x0, int x1, int w0, int w1, int w2, bool covered, bool depth_test, FrameBuffer* framebuffer)
+{
+	const EdgeFunction* edges = setup.edges;
+	const AttributePlane* planes = setup.colors;
+	Byte* row = framebuffer->row(y);
+	int pixel_size = framebuffer->pixel_size();
+	DepthFormat depth_format = framebuffer->depth_format();
+	Byte* depth_row = depth_format != DEPTH_NONE ? framebuffer->depth_row(y) : NULL;
+	float depth_base = setup.depth.dy * (float)y + setup.depth.c;
+	float base[4];
+	for (int k = 0; k < 4; k++)
+		base[k] = planes[k].dy * (float)y + planes[k].c;
+
+	bool written = false;
+	for (int x = x0; x <= x1; x++, w0 += edges[0].a, w1 += edges[1].a, w2 += edges[2].a) {
+		if (!covered && (w0 | w1 | w2) < 0)
+			continue;
+		float xf = (float)x;
+		if (depth_format == DEPTH_FLOAT32) {
+			float z = setup.depth.dx * xf + depth_base;
+			float* stored = (float*)depth_row + x;
+			if (depth_test && !(z < *stored))
+				continue;
+			*stored = z;
+		}
+		else if (depth_format == DEPTH_UNORM24) {
+			unsigned int z = QuantizeDepth(setup.depth.dx * xf + depth_base);
+			unsigned int* stored = (unsigned int*)depth_row + x;
+			if (depth_test && !(z < *stored))
+				continue;
+			*stored = z;
+		}
+		store_pixel(framebuffer, row + x * pixel_size,
+			planes[0].dx * xf + base[0], planes[1].dx * xf + base[1],
+			planes[2].dx * xf + base[2], planes[3].dx * xf + base[3]);
+		written = true;
+	}
+	return written;
+}
+
+static bool shade_tile_scalar(const TriangleSetup& setup, const PixelRect& tile, const int origin[3], bool covered, bool depth_test, FrameBuffer* framebuffer)
+{
+	const EdgeFunction* edges = setup.edges;
+	int w0 = origin[0], w1 = origin[1], w2 = origin[2];
+	bool written = false;
+	for (int y = tile.min_y; y <= tile.max_y; y++) {
+		written |= shade_span_scalar(setup, y, tile.min_x, tile.max_x, w0, w1, w2, covered, depth_test, framebuffer);
+		w0 += edges[0].b;
+		w1 += edges[1].b;
+		w2 += edges[2].b;
+	}
+	return written;
+}
+
+#if SIMD_X86
+/*
+*  a tile row is at most TILE_SIZE = 8 pixels wide: one AVX2 register or two SSE2 registers;
+*  the x part of every plane is computed once per tile, each row only adds its own dy * y + c
+*/
+static bool shade_tile_sse2(const TriangleSetup& setup, const PixelRect& tile, const int origin[3], bool covered, bool depth_test, FrameBuffer* framebuffer)
+{
+	PixelFormat format = framebuffer->format();
+	if (format == FORMAT_RGBA32F)
+		return shade_tile_scalar(setup, tile, origin, covered, depth_test, framebuffer);
+
+	const EdgeFunction* edges = setup.edges;
+	const AttributePlane* planes = setup.colors;
+	DepthFormat depth_format = framebuffer->depth_format();
+	//pixels past the last full group of 4 stay scalar: a 4-wide store there could touch the neighbouring bin
+	int groups = (tile.max_x - tile.min_x + 1) / 4;
+	int tail_x = tile.min_x + groups * 4;
+
+	__m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), scale = _mm_set1_ps(255.0f), half = _mm_set1_ps(0.5f);
+	__m128 depth_scale = _mm_set1_ps(DEPTH_UNORM24_MAX);
+	__m128i red_shift = _mm_cvtsi32_si128(format == FORMAT_BGRA8 ? 16 : 0);
+	__m128i blue_shift = _mm_cvtsi32_si128(format == FORMAT_BGRA8 ? 0 : 16);
+	__m128 x_part[2][5];	//r, g, b, a, z
+	__m128i e_row[2][3], e_step[3];
+	for (int g = 0; g < groups; g++) {
+		int x = tile.min_x + g * 4;
+		__m128 xf = _mm_cvtepi32_ps(_mm_setr_epi32(x, x + 1, x + 2, x + 3));
+		for (int k = 0; k < 4; k++)
+			x_part[g][k] = _mm_mul_ps(_mm_set1_ps(planes[k].dx), xf);
+		x_part[g][4] = _mm_mul_ps(_mm_set1_ps(setup.depth.dx), xf);
+		for (int i = 0; i < 3; i++) {
+			int w = origin[i] + g * 4 * edges[i].a;
+			e_row[g][i] = _mm_setr_epi32(w, w + edges[i].a, w + 2 * edges[i].a, w + 3 * edges[i].a);
+		}
+	}
+	for (int i = 0; i < 3; i++)
+		e_step[i] = _mm_set1_epi32(edges[i].b);
+
+	bool written = false;
+	for (int y = tile.min_y; y <= tile.max_y; y++) {
+		Byte* row = framebuffer->row(y);
+		__m128 base[4];
+		for (int k = 0; k < 4; k++)
+			base[k] = _mm_set1_ps(planes[k].dy * (float)y + planes[k].c);
+		__m128 depth_base = _mm_set1_ps(setup.depth.dy * (float)y + setup.depth.c);
+
+		for (int g = 0; g < groups; g++) {
+			int x = tile.min_x + g * 4;
+			__m128i mask = covered ? _mm_set1_epi32(-1)
+				: _mm_cmpgt_epi32(_mm_or_si128(_mm_or_si128(e_row[g][0], e_row[g][1]), e_row[g][2]), _mm_set1_epi32(-1));
+			for (int i = 0; i < 3; i++)
+				e_row[g][i] = _mm_add_epi32(e_row[g][i], e_step[i]);
+			if (_mm_movemask_epi8(mask) == 0)
+				continue;
+
+			if (depth_format != DEPTH_NONE) {
+				__m128i* depth_dst = (__m128i*)(framebuffer->depth_row(y) + x * 4);
+				__m128i stored = _mm_loadu_si128(depth_dst);
+				__m128 z = _mm_add_ps(x_part[g][4], depth_base);
+				__m128i value;
+				if (depth_format == DEPTH_FLOAT32) {
+					value = _mm_castps_si128(z);
+					if (depth_test)
+						mask = _mm_and_si128(mask, _mm_castps_si128(_mm_cmplt_ps(z, _mm_castsi128_ps(stored))));
+				}
+				else {
+					__m128 clamped = _mm_min_ps(_mm_max_ps(z, zero), one);
+					value = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(clamped, depth_scale), half));
+					if (depth_test)
+						mask = _mm_and_si128(mask, _mm_cmplt_epi32(value, stored));
+				}
+				if (_mm_movemask_epi8(mask) == 0)
+					continue;
+				_mm_storeu_si128(depth_dst, _mm_or_si128(_mm_and_si128(mask, value), _mm_andnot_si128(mask, stored)));
+			}
+
+			__m128i channel[4];
+			for (int k = 0; k < 4; k++) {
+				__m128 value = _mm_add_ps(x_part[g][k], base[k]);
+				value = _mm_min_ps(_mm_max_ps(value, zero), one);
+				channel[k] = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(value, scale), half));
+			}
+			__m128i packed = _mm_or_si128(
+				_mm_or_si128(_mm_sll_epi32(channel[0], red_shift), _mm_slli_epi32(channel[1], 8)),
+				_mm_or_si128(_mm_sll_epi32(channel[2], blue_shift), _mm_slli_epi32(channel[3], 24)));
+
+			__m128i* dst = (__m128i*)(row + x * 4);
+			__m128i old = _mm_loadu_si128(dst);
+			_mm_storeu_si128(dst, _mm_or_si128(_mm_and_si128(mask, packed), _mm_andnot_si128(mask, old)));
+			written = true;
+		}
+
+		if (tail_x <= tile.max_x) {
+			int n = tail_x - tile.min_x, dy = y - tile.min_y;
+			written |= shade_span_scalar(setup, y, tail_x, tile.max_x,
+				origin[0] + n * edges[0].a + dy * edges[0].b,
+				origin[1] + n * edges[1].a + dy * edges[1].b,
+				origin[2] + n * edges[2].a + dy * edges[2].b, covered, depth_test, framebuffer);
+		}
+	}
+	return written;
+}
+
+SIMD_TARGET_AVX2
+static bool shade_tile_avx2(const TriangleSetup& setup, const PixelRect& tile, const int origin[3], bool covered, bool depth_test, FrameBuffer* framebuffer)
+{
+	const EdgeFunction* edges = setup.edges;
+	const AttributePlane* planes = setup.colors;
+	PixelFormat format = framebuffer->format();
+	DepthFormat depth_format = framebuffer->depth_format();
+	int pixel_size = framebuffer->pixel_size();
+
+	__m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	//lanes past max_x are masked off, masked loads and stores leave their memory untouched
+	__m256i valid = _mm256_cmpgt_epi32(_mm256_set1_epi32(tile.max_x - tile.min_x + 1), lane);
+	__m256 xf = _mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(tile.min_x), lane));
+	__m256 x_part[4];
+	for (int k = 0; k < 4; k++)
+		x_part[k] = _mm256_mul_ps(_mm256_set1_ps(planes[k].dx), xf);
+	__m256 depth_x_part = _mm256_mul_ps(_mm256_set1_ps(setup.depth.dx), xf);
+	__m256i e_row[3], e_step[3];
+	for (int i = 0; i < 3; i++) {
+		e_row[i] = _mm256_add_epi32(_mm256_set1_epi32(origin[i]), _mm256_mullo_epi32(lane, _mm256_set1_epi32(edges[i].a)));
+		e_step[i] = _mm256_set1_epi32(edges[i].b);
+	}
+	__m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f), scale = _mm256_set1_ps(255.0f), half = _mm256_set1_ps(0.5f);
+	__m256 depth_scale = _mm256_set1_ps(DEPTH_UNORM24_MAX);
+	__m128i red_shift = _mm_cvtsi32_si128(format == FORMAT_BGRA8 ? 16 : 0);
+	__m128i blue_shift = _mm_cvtsi32_si128(format == FORMAT_BGRA8 ? 0 : 16);
+
+	bool written = false;
+	for (int y = tile.min_y; y <= tile.max_y; y++) {
+		__m256i mask = covered ? valid
+			: _mm256_and_si256(valid, _mm256_cmpgt_epi32(_mm256_or_si256(_mm256_or_si256(e_row[0], e_row[1]), e_row[2]), _mm256_set1_epi32(-1)));
+		for (int i = 0; i < 3; i++)
+			e_row[i] = _mm256_add_epi32(e_row[i], e_step[i]);
+		if (_mm256_movemask_ps(_mm256_castsi256_ps(mask)) == 0)
+			continue;
+
+		if (depth_format != DEPTH_NONE) {
+			int* depth_dst = (int*)(framebuffer->depth_row(y) + tile.min_x * 4);
+			__m256 z = _mm256_add_ps(depth_x_part, _mm256_set1_ps(setup.depth.dy * (float)y + setup.depth.c));
+			__m256i value;
+			if (depth_format == DEPTH_FLOAT32) {
+				value = _mm256_castps_si256(z);
+				if (depth_test) {
+					__m256 stored = _mm256_maskload_ps((float*)depth_dst, mask);
+					mask = _mm256_and_si256(mask, _mm256_castps_si256(_mm256_cmp_ps(z, stored, _CMP_LT_OQ)));
+				}
+			}
+			else {
+				__m256 clamped = _mm256_min_ps(_mm256_max_ps(z, zero), one);
+				value = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(clamped, depth_scale), half));
+				if (depth_test) {
+					__m256i stored = _mm256_maskload_epi32(depth_dst, mask);
+					mask = _mm256_and_si256(mask, _mm256_cmpgt_epi32(stored, value));
+				}
+			}
+			if (_mm256_movemask_ps(_mm256_castsi256_ps(mask)) == 0)
+				continue;
+			_mm256_maskstore_epi32(depth_dst, mask, value);
+		}
+		written = true;
+
+		Byte* row = framebuffer->row(y) + tile.min_x * pixel_size;
+		__m256 value[4];
+		for (int k = 0; k < 4; k++)
+			value[k] = _mm256_add_ps(x_part[k], _mm256_set1_ps(planes[k].dy * (float)y + planes[k].c));
+
+		if (format == FORMAT_RGBA32F) {
+			int bits = _mm256_movemask_ps(_mm256_castsi256_ps(mask));
+			float channel[4][8];
+			for (int k = 0; k < 4; k++)
+				_mm256_storeu_ps(channel[k], value[k]);
+			for (int i = 0; i < 8; i++) {
+				if (bits & (1 << i)) {
+					float* pixel = (float*)(row + i * pixel_size);
+					pixel[0] = channel[0][i];
+					pixel[1] = channel[1][i];
+					pixel[2] = channel[2][i];
+					pixel[3] = channel[3][i];
+				}
+			}
+			continue;
+		}
+
+		__m256i channel[4];
+		for (int k = 0; k < 4; k++) {
+			__m256 clamped = _mm256_min_ps(_mm256_max_ps(value[k], zero), one);
+			channel[k] = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(clamped, scale), half));
+		}
+		__m256i packed = _mm256_or_si256(
+			_mm256_or_si256(_mm256_sll_epi32(channel[0], red_shift), _mm256_slli_epi32(channel[1], 8)),
+			_mm256_or_si256(_mm256_sll_epi32(channel[2], blue_shift), _mm256_slli_epi32(channel[3], 24)));
+		_mm256_maskstore_epi32((int*)row, mask, packed);
+	}
+	return written;
+}
+#endif
+
+ShadeTileFunc select_shade_tile()
+{
+#if SIMD_X86
+	switch (simd_level()) {
+	case SIMD_AVX2: return shade_tile_avx2;
+	case SIMD_SSE2: return shade_tile_sse2;
+	default: break;
+	}
+#endif
+	return shade_tile_scalar;
+}
+
+int count_covered(const EdgeFunction* edges, const PixelRect& tile, const int origin[3])
+{
+	int count = 0;
+	for (int y = 0; y <= tile.max_y - tile.min_y; y++) {
+		for (int x = 0; x <= tile.max_x - tile.min_x; x++) {
+			int w0 = origin[0] + x * edges[0].a + y * edges[0].b;
+			int w1 = origin[1] + x * edges[1].a + y * edges[1].b;
+			int w2 = origin[2] + x * edges[2].a + y * edges[2].b;
+			count += (w0 | w1 | w2) >= 0;
+		}
+	}
+	return count;
+}
+
+bool rasterize_triangle(const TriangleSetup& setup, const PixelRect& rect, ShadeTileFunc shade_tile, FrameBuffer* framebuffer, RasterStats* stats)
+{
+	const Byte* packed = setup.color;
+	int pixel_size = framebuffer->pixel_size();
+	const EdgeFunction* edges = setup.edges;
+	bool depth = framebuffer->has_depth();
+	return rasterize_tiles(setup, rect, framebuffer, stats, [&](const PixelRect& tile, const int origin[3], bool covered, bool depth_test) {
+		if (depth || !setup.flat)
+			return shade_tile(setup, tile, origin, covered, depth_test, framebuffer);
+
+		if (covered) {
+			for (int y = tile.min_y; y <= tile.max_y; y++)
+				fill_span(framebuffer->row(y), tile.min_x, tile.max_x, packed, pixel_size);
+			return true;
+		}
+
+		//partially covered tile: step the edge functions incrementally
+		int w0_row = origin[0], w1_row = origin[1], w2_row = origin[2];
+		for (int y = tile.min_y; y <= tile.max_y; y++) {
+			Byte* row = framebuffer->row(y);
+			int w0 = w0_row, w1 = w1_row, w2 = w2_row;
+			for (int x = tile.min_x; x <= tile.max_x; x++) {
+				if ((w0 | w1 | w2) >= 0)
+					memcpy(row + x * pixel_size, packed, pixel_size);
+				w0 += edges[0].a;
+				w1 += edges[1].a;
+				w2 += edges[2].a;
+			}
+			w0_row += edges[0].b;
+			w1_row += edges[1].b;
+			w2_row += edges[2].b;
+		}
+		return true;
+	});
+}
+
+/*
+*  lines
+*/
+//Liang-Barsky: shrink line to the box, returns false when nothing is left
+static bool clip_segment(float min_x, float min_y, float max_x, float max_y, LineSegment* line)
+{
+	float dx = line->x1 - line->x0, dy = line->y1 - line->y0;
+	float p[4] = { -dx, dx, -dy, dy };
+	float q[4] = { line->x0 - min_x, max_x - line->x0, line->y0 - min_y, max_y - line->y0 };
+	float t0 = 0, t1 = 1;
+	for (int i = 0; i < 4; i++) {
+		if (p[i] == 0) {
+			if (q[i] < 0)
+				return false;
+			continue;
+		}
+		float t = q[i] / p[i];
+		if (p[i] < 0) {
+			if (t > t1)
+				return false;
+			t0 = std::max(t0, t);
+		}
+		else {
+			if (t < t0)
+				return false;
+			t1 = std::min(t1, t);
+		}
+	}
+	LineSegment clipped = *line;
+	if (t0 > 0) {
+		clipped.x0 = line->x0 + t0 * dx;
+		clipped.y0 = line->y0 + t0 * dy;
+	}
+	if (t1 < 1) {
+		clipped.x1 = line->x0 + t1 * dx;
+		clipped.y1 = line->y0 + t1 * dy;
+	}
+	*line = clipped;
+	return true;
+}
+
+//smallest step k of a Bresenham line (major length du, minor length dv > 0) whose minor offset reaches s
+static inline long long first_step(long long s, long long du, long long dv)
+{
+	//the minor offset after k steps is ceil((2 k dv - du) / (2 du))
+	if (s <= 0)
+		return 0;
+	return (2 * du * s - du + 2 * dv) / (2 * dv);
+}
+
+static void draw_line_aliased(const LineSegment& line, const Byte* packed, const PixelRect& rect, FrameBuffer* framebuffer)
+{
+	int x0 = (int)floorf(line.x0), y0 = (int)floorf(line.y0);
+	int x1 = (int)floorf(line.x1), y1 = (int)floorf(line.y1);
+	//walk along the major axis u, the minor axis v steps by sv
+	bool steep = std::abs(y1 - y0) > std::abs(x1 - x0);
+	int u0 = steep ? y0 : x0, v0 = steep ? x0 : y0;
+	int u1 = steep ? y1 : x1, v1 = steep ? x1 : y1;
+	if (u0 > u1) {
+		std::swap(u0, u1);
+		std::swap(v0, v1);
+	}
+	long long du = u1 - u0, dv = std::abs(v1 - v0);
+	int sv = v1 >= v0 ? 1 : -1;
+	int min_u = steep ? rect.min_y : rect.min_x, max_u = steep ? rect.max_y : rect.max_x;
+	int min_v = steep ? rect.min_x : rect.min_y, max_v = steep ? rect.max_x : rect.max_y;
+
+	//steps inside rect along u, then along v where the minor offset s is monotonic in the step
+	long long first = std::max(0LL, (long long)min_u - u0), last = std::min(du, (long long)max_u - u0);
+	long long min_s = sv > 0 ? min_v - v0 : v0 - max_v;
+	long long max_s = sv > 0 ? max_v - v0 : v0 - min_v;
+	if (max_s < 0 || first > last)
+		return;
+	if (dv == 0) {
+		if (min_s > 0)
+			return;
+	}
+	else {
+		first = std::max(first, first_step(min_s, du, dv));
+		last = std::min(last, first_step(max_s + 1, du, dv) - 1);
+		if (first > last)
+			return;
+	}
+
+	//bresenham state after first steps; the guard band keeps the loop values within int
+	int s = dv == 0 ? 0 : (int)((2 * first * dv + du - 1) / (2 * du));
+	int error = (int)(2 * first * dv - 2 * du * s);
+	int v = v0 + sv * s;
+	int k = (int)first, k_last = (int)last;
+	int step_u = 2 * (int)dv, step_v = 2 * (int)du;
+	int pixel_size = framebuffer->pixel_size();
+	if (steep || step_u * 2 > step_v) {
+		//runs of one or two pixels: plain bresenham, one pixel at a time
+		ptrdiff_t u_stride = steep ? framebuffer->pitch() : pixel_size;
+		ptrdiff_t v_stride = steep ? sv * pixel_size : sv * (ptrdiff_t)framebuffer->pitch();
+		Byte* pixel = steep ? framebuffer->span(v, u0 + k) : framebuffer->span(u0 + k, v);
+		for (; k <= k_last; k++) {
+			memcpy(pixel, packed, pixel_size);
+			pixel += u_stride;
+			error += step_u;
+			if (error > du) {
+				error -= step_v;
+				pixel += v_stride;
+			}
+		}
+		return;
+	}
+	while (k <= k_last) {
+		//pixels until the error passes du share one row
+		int run = dv == 0 ? k_last - k + 1 : ((int)du - error) / step_u + 1;
+		int end = std::min(k + run - 1, k_last);
+		fill_span(framebuffer->row(v), u0 + k, u0 + end, packed, pixel_size);
+		error += step_u * run - step_v;
+		v += sv;
+		k = end + 1;
+	}
+}
+
+//mix packed color into pixel by coverage, alpha scales coverage
+static inline void blend_pixel(Byte* pixel, const Byte* packed, float coverage, PixelFormat format)
+{
+	if (format == FORMAT_RGBA32F) {
+		float* value = (float*)pixel;
+		const float* color = (const float*)packed;
+		float weight = coverage * color[3];
+		for (int i = 0; i < 4; i++)
+			value[i] += (color[i] - value[i]) * weight;
+		return;
+	}
+	//alpha is byte 3 in both 8-bit formats, weight 256 replaces the pixel
+	int weight = (int)(coverage * packed[3] * (256.0f / 255.0f) + 0.5f);
+	for (int i = 0; i < 4; i++)
+		pixel[i] = (Byte)(pixel[i] + ((((int)packed[i] - pixel[i]) * weight) >> 8));
+}
+
+static inline float fraction(float value)
+{
+	return value - floorf(value);
+}
+
+//float to int for clip bounds, values far outside the framebuffer are only compared
+static inline int clamp_to_int(float value)
+{
+	return (int)std::min(std::max(value, -1e9f), 1e9f);
+}
+
+//Wu's algorithm with pixel centers at integers; the loop is clipped to rect, the endpoints only tested
+static void draw_line_wu(const LineSegment& line, const Byte* packed, const PixelRect& rect, FrameBuffer* framebuffer)
+{
+	float x0 = line.x0 - 0.5f, y0 = line.y0 - 0.5f, x1 = line.x1 - 0.5f, y1 = line.y1 - 0.5f;
+	bool steep = fabsf(y1 - y0) > fabsf(x1 - x0);
+	if (steep) {
+		std::swap(x0, y0);
+		std::swap(x1, y1);
+	}
+	if (x0 > x1) {
+		std::swap(x0, x1);
+		std::swap(y0, y1);
+	}
+	float dx = x1 - x0, dy = y1 - y0;
+	float gradient = dx == 0 ? 1.0f : dy / dx;
+	int min_u = steep ? rect.min_y : rect.min_x, max_u = steep ? rect.max_y : rect.max_x;
+	int min_v = steep ? rect.min_x : rect.min_y, max_v = steep ? rect.max_x : rect.max_y;
+	PixelFormat format = framebuffer->format();
+
+	auto plot = [&](int u, int v, float coverage) {
+		if (u < min_u || u > max_u || v < min_v || v > max_v || coverage <= 0)
+			return;
+		blend_pixel(steep ? framebuffer->span(v, u) : framebuffer->span(u, v), packed, coverage, format);
+	};
+
+	//endpoints cover their pixel by the part of the line inside it
+	float u_end = floorf(x0 + 0.5f);
+	float v_end = y0 + gradient * (u_end - x0);
+	float gap = 1 - fraction(x0 + 0.5f);
+	int u_first = (int)u_end;
+	float intersection = v_end + gradient;	//minor coordinate at u_first + 1
+	plot(u_first, (int)floorf(v_end), (1 - fraction(v_end)) * gap);
+	plot(u_first, (int)floorf(v_end) + 1, fraction(v_end) * gap);
+
+	u_end = floorf(x1 + 0.5f);
+	v_end = y1 + gradient * (u_end - x1);
+	gap = fraction(x1 + 0.5f);
+	int u_last = (int)u_end;
+	plot(u_last, (int)floorf(v_end), (1 - fraction(v_end)) * gap);
+	plot(u_last, (int)floorf(v_end) + 1, fraction(v_end) * gap);
+
+	//inner pixels: clip u to rect, and to where the two covered rows can reach [min_v, max_v]
+	int first = std::max(u_first + 1, min_u), last = std::min(u_last - 1, max_u);
+	if (gradient > 0) {
+		first = std::max(first, u_first + 1 + clamp_to_int(floorf((min_v - 1 - intersection) / gradient)));
+		last = std::min(last, u_first + 1 + clamp_to_int(ceilf((max_v + 1 - intersection) / gradient)));
+	}
+	else if (gradient < 0) {
+		first = std::max(first, u_first + 1 + clamp_to_int(floorf((max_v + 1 - intersection) / gradient)));
+		last = std::min(last, u_first + 1 + clamp_to_int(ceilf((min_v - 1 - intersection) / gradient)));
+	}
+	for (int u = first; u <= last; u++) {
+		//evaluated per pixel rather than accumulated, so any clip rect gives the same coverage
+		float v = intersection + gradient * (u - u_first - 1);
+		float v_floor = floorf(v);
+		plot(u, (int)v_floor, 1 - (v - v_floor));
+		plot(u, (int)v_floor + 1, v - v_floor);
+	}
+}
+
+void rasterize_lines(const LineSegment* lines, int count, const Color& color, bool antialias, const PixelRect& rect, FrameBuffer* framebuffer)
+{
+	assert(rect.min_x >= 0 && rect.min_y >= 0 && rect.max_x < framebuffer->width() && rect.max_y < framebuffer->height());
+	Byte packed[16];
+	framebuffer->PackColor(color, packed);
+
+	float guard_min = (float)-RASTER_GUARD_BAND;
+	float guard_max_x = (float)(framebuffer->width() + RASTER_GUARD_BAND);
+	float guard_max_y = (float)(framebuffer->height() + RASTER_GUARD_BAND);
+	for (int i = 0; i < count; i++) {
+		LineSegment line = lines[i];
+		//also drops nan endpoints
+		bool inside = line.x0 >= guard_min && line.x0 <= guard_max_x && line.x1 >= guard_min && line.x1 <= guard_max_x
+			&& line.y0 >= guard_min && line.y0 <= guard_max_y && line.y1 >= guard_min && line.y1 <= guard_max_y;
+		if (!inside) {
+			if (line.x0 != line.x0 || line.y0 != line.y0 || line.x1 != line.x1 || line.y1 != line.y1)
+				continue;
+			if (!clip_segment(guard_min, guard_min, guard_max_x, guard_max_y, &line))
+				continue;
+		}
+		//bounding box against rect, with the extra pixel that wu coverage can reach
+		if (std::max(line.x0, line.x1) < rect.min_x - 2 || std::min(line.x0, line.x1) > rect.max_x + 2
+			|| std::max(line.y0, line.y1) < rect.min_y - 2 || std::min(line.y0, line.y1) > rect.max_y + 2)
+			continue;
+		if (antialias)
+			draw_line_wu(line, packed, rect, framebuffer);
+		else
+			draw_line_aliased(line, packed, rect, framebuffer);
+	}
+}
+
+/*
+*  binning
+*/
+TileBins::TileBins(int width, int height)
+{
+	width_ = width;
+	height_ = height;
+	bins_x_ = (width + BIN_SIZE - 1) / BIN_SIZE;
+	bins_y_ = (height + BIN_SIZE - 1) / BIN_SIZE;
+	bins_ = vector<vector<int>>(bins_x_ * bins_y_);
+}
+
+void TileBins::Clear()
+{
+	for (size_t i = 0; i < bins_.size(); i++)
+		bins_[i].clear();  //keeps capacity between frames
+}
+
+PixelRect TileBins::bin_rect(int bin) const
+{
+	PixelRect rect;
+	rect.min_x = (bin % bins_x_) * BIN_SIZE;
+	rect.min_y = (bin / bins_x_) * BIN_SIZE;
+	rect.max_x = std::min(rect.min_x + BIN_SIZE, width_) - 1;
+	rect.max_y = std::min(rect.min_y + BIN_SIZE, height_) - 1;
+	return rect;
+}
+
+void TileBins::Insert(int index, const TriangleGeometry& setup)
+{
+	int bx0 = setup.bounds.min_x / BIN_SIZE, bx1 = setup.bounds.max_x / BIN_SIZE;
+	int by0 = setup.bounds.min_y / BIN_SIZE, by1 = setup.bounds.max_y / BIN_SIZE;
+	bool single = bx0 == bx1 && by0 == by1;
+	for (int by = by0; by <= by1; by++) {
+		for (int bx = bx0; bx <= bx1; bx++) {
+			int bin = by * bins_x_ + bx;
+			if (!single) {
+				//large triangles only go to bins that touch their interior
+				PixelRect rect = bin_rect(bin);
+				bool rejected = false;
+				for (int i = 0; i < 3 && !rejected; i++) {
+					int origin, min_value, max_value;
+					edge_range(setup.edges[i], rect, &origin, &min_value, &max_value);
+					rejected = max_value < 0;
+				}
+				if (rejected)
+					continue;
+			}
+			bins_[bin].push_back(index);
+		}
+	}
+}
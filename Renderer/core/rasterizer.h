@@ -0,0 +1,173 @@
+#ifndef RASTERIZER_H
+#define RASTERIZER_H
+
+#include <vector>
+#include "geometry.h"
+
+class Color;
+class FrameBuffer;
+
+using std::vector;
+
+typedef unsigned char Byte;
+
+/*
+*  half-space triangle rasterization
+*  vertices are snapped to 28.4 fixed point, every pixel center is tested against the three edge
+*  functions; the bounding box is walked in TILE_SIZE x TILE_SIZE tiles so that tiles entirely
+*  outside an edge are skipped and tiles entirely inside all edges are filled without any test
+*/
+static const int TILE_SIZE = 8;
+static const int SUBPIXEL_BITS = 4;
+static const int SUBPIXEL_ONE = 1 << SUBPIXEL_BITS;
+//vertices must stay within this many pixels outside the framebuffer to keep edge values in 32 bits
+static const int RASTER_GUARD_BAND = 2048;
+static const int RASTER_MAX_SIZE = 4096;
+//margin of hierarchical z decisions, covers rounding of the depth plane and 24-bit quantization
+static const float HIZ_EPSILON = 1.0f / (1 << 20);
+//screen is split into BIN_SIZE x BIN_SIZE bins, each bin is rasterized by one thread only
+static const int BIN_SIZE = 64;
+
+//edge function evaluated at pixel centers: e(x, y) = a * x + b * y + c, pixel covered if e >= 0
+struct EdgeFunction
+{
+	int a, b, c;
+};
+
+//inclusive pixel rectangle
+struct PixelRect
+{
+	int min_x, min_y, max_x, max_y;
+};
+
+inline PixelRect intersect_rect(const PixelRect& a, const PixelRect& b)
+{
+	PixelRect rect;
+	rect.min_x = a.min_x > b.min_x ? a.min_x : b.min_x;
+	rect.min_y = a.min_y > b.min_y ? a.min_y : b.min_y;
+	rect.max_x = a.max_x < b.max_x ? a.max_x : b.max_x;
+	rect.max_y = a.max_y < b.max_y ? a.max_y : b.max_y;
+	return rect;
+}
+
+//screen-space linear attribute at pixel centers: value(x, y) = dx * x + dy * y + c
+struct AttributePlane
+{
+	float dx, dy, c;
+};
+
+//coverage and depth of a triangle, everything binning and hierarchical z look at
+struct TriangleGeometry
+{
+	EdgeFunction edges[3];
+	PixelRect bounds;	//covered pixels, clipped to framebuffer
+	float area;			//in pixels
+	AttributePlane depth;
+	float min_z, max_z;	//depth range of the vertices
+};
+
+//triangle of DrawTriangle, colors interpolated linearly in screen space
+struct TriangleSetup : public TriangleGeometry
+{
+	bool flat;			//all vertices share one color, use the packed color instead of planes
+	Byte color[16];		//flat color packed in the framebuffer format
+	AttributePlane colors[4];	//r, g, b, a
+};
+
+//vertices of a set up triangle in 28.4 fixed point, counter-clockwise; order[i] is the argument they came from
+struct SnappedVertices
+{
+	long long x[3], y[3];
+	int order[3];
+};
+
+//work and early depth rejection counters
+struct RasterStats
+{
+	long long triangles;		//triangle and bin pairs rasterized
+	long long tiles;			//tiles handed to the fill or shade kernels
+	long long fragments;		//pixels of those tiles, partially covered tiles count whole
+	long long hiz_triangles;	//triangle and bin pairs culled by the bin level of hierarchical z
+	long long hiz_tiles;		//tiles culled by the tile level
+	long long hiz_fragments;	//covered pixels of culled tiles, plus an estimate for culled triangles
+	long long clipped;			//mesh triangles that crossed the near or far plane or the guard band
+	long long backfaces;		//mesh triangles dropped by the cull mode
+	long long culled_models;	//scene models outside the view frustum
+	long long lit_pixels;		//surfaces shaded by the lighting pass of the deferred path
+	long long light_samples;	//light and surface pairs it evaluated
+};
+
+/*
+*  edges, bounds and depth plane of a triangle in screen space (pixels, origin at bottomLeft, z in
+*  [0, 1]), either winding; returns false when the triangle is degenerate, misses the framebuffer,
+*  or leaves the guard band (such triangles have to be clipped before rasterization)
+*/
+bool setup_geometry(const Vector3f& v0, const Vector3f& v1, const Vector3f& v2, const FrameBuffer* framebuffer, TriangleGeometry* geometry, SnappedVertices* snapped);
+//screen-space plane through values[i] at argument i of setup_geometry
+AttributePlane attribute_plane(const SnappedVertices& snapped, const float values[3]);
+//setup_geometry plus color planes
+bool setup_triangle(const Vector3f& v0, const Vector3f& v1, const Vector3f& v2, Color c0, Color c1, Color c2, const FrameBuffer* framebuffer, TriangleSetup* setup);
+
+/*
+*  tile kernel: covered pixels of tile (at most TILE_SIZE wide) that pass the depth test get the
+*  interpolated color and depth; origin holds the edge values at (tile.min_x, tile.min_y),
+*  covered means no pixel needs the edge test, depth_test false means every depth test passes
+*  returns whether any pixel was written; scalar, SSE2 and AVX2 versions write identical bytes
+*/
+typedef bool(*ShadeTileFunc)(const TriangleSetup& setup, const PixelRect& tile, const int origin[3], bool covered, bool depth_test, FrameBuffer* framebuffer);
+//kernel for the current simd_level()
+ShadeTileFunc select_shade_tile();
+
+//edge values at the pixels of rect closest to and farthest from the inside of the edge, and at (rect.min_x, rect.min_y)
+inline void edge_range(const EdgeFunction& e, const PixelRect& rect, int* origin, int* min_value, int* max_value)
+{
+	*origin = e.a * rect.min_x + e.b * rect.min_y + e.c;
+	int step_x = e.a * (rect.max_x - rect.min_x), step_y = e.b * (rect.max_y - rect.min_y);
+	*max_value = *origin + (step_x > 0 ? step_x : 0) + (step_y > 0 ? step_y : 0);
+	*min_value = *origin + (step_x < 0 ? step_x : 0) + (step_y < 0 ? step_y : 0);
+}
+
+//covered pixels of a tile, only evaluated for statistics of culled tiles
+int count_covered(const EdgeFunction* edges, const PixelRect& tile, const int origin[3]);
+
+//fill the part of the triangle that lies inside rect, returns whether any pixel was written
+bool rasterize_triangle(const TriangleSetup& setup, const PixelRect& rect, ShadeTileFunc shade_tile, FrameBuffer* framebuffer, RasterStats* stats);
+
+/*
+*  lines in screen space (pixels, origin at bottomLeft)
+*  aliased lines step Bresenham between the pixels holding the endpoints and are clipped in
+*  integers, so the visible pixels are exactly those of the unclipped line; x-major lines are
+*  written as horizontal runs; antialiased lines blend Wu coverage (times color alpha) into the frame
+*  endpoints further than RASTER_GUARD_BAND outside the framebuffer are first moved onto the guard band
+*/
+struct LineSegment
+{
+	float x0, y0, x1, y1;
+};
+
+//draw the parts of lines that lie inside rect, in order; depth is neither tested nor written
+void rasterize_lines(const LineSegment* lines, int count, const Color& color, bool antialias, const PixelRect& rect, FrameBuffer* framebuffer);
+
+//lists of triangles overlapping each bin, in submission order
+class TileBins
+{
+public:
+	TileBins(int width, int height);
+
+	void Clear();
+	//add triangle to every bin its edges do not reject
+	void Insert(int index, const TriangleGeometry& geometry);
+
+	int bin_count() const { return bins_x_ * bins_y_; }
+	PixelRect bin_rect(int bin) const;
+	const vector<int>& triangles(int bin) const { return bins_[bin]; }
+
+private:
+	int width_;
+	int height_;
+	int bins_x_;
+	int bins_y_;
+	vector<vector<int>> bins_;
+};
+
+#endif
@@ -1,90 +1,420 @@
 #include "renderer.h"
 #include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
 #include <algorithm>
+#include <limits>
 #include "window.h"
 #include "color.h"
+#include "utils.h"
+#include "thread_pool.h"
+#include "mesh.h"
+#include "vertex_processor.h"
+#include "clipper.h"
+#include "scene.h"
+#include "model.h"
+#include "profiler.h"
+#include "pipeline.h"
+#include "shader.h"
+#include "gbuffer.h"
+#include "deferred.h"
 
-FrameBuffer::FrameBuffer(int width, int height)
+static const int FRAME_ALIGNMENT = 64;
+//smaller batches of lines are drawn on the calling thread
+static const int LINE_PARALLEL_MIN = 256;
+
+FrameBuffer::FrameBuffer(int width, int height, PixelFormat format, DepthFormat depth_format)
 {
+	assert(width > 0 && height > 0 && format >= 0 && format < FORMAT_NUM);
+	assert(depth_format >= 0 && depth_format < DEPTH_NUM);
 	width_ = width;	   //corresponding to x axis
 	height_ = height;   //corresponding to y axis
-	pixel_colors_ = vector<vector<Color>>(width, vector<Color>(height, Color::Black));
+	format_ = format;
+	pixel_size_ = PixelSize(format);
+	pitch_ = (width * pixel_size_ + FRAME_ALIGNMENT - 1) / FRAME_ALIGNMENT * FRAME_ALIGNMENT;
+	data_ = (Byte*)AlignedMalloc(data_size(), FRAME_ALIGNMENT);
+	Clear(Color::Black);
+
+	depth_format_ = depth_format;
+	depth_pitch_ = (width * 4 + FRAME_ALIGNMENT - 1) / FRAME_ALIGNMENT * FRAME_ALIGNMENT;
+	depth_ = NULL;
+	tiles_x_ = (width + TILE_SIZE - 1) / TILE_SIZE;
+	tiles_y_ = (height + TILE_SIZE - 1) / TILE_SIZE;
+	bins_x_ = (width + BIN_SIZE - 1) / BIN_SIZE;
+	bins_y_ = (height + BIN_SIZE - 1) / BIN_SIZE;
+	if (depth_format != DEPTH_NONE) {
+		depth_ = (Byte*)AlignedMalloc((size_t)depth_pitch_ * height, FRAME_ALIGNMENT);
+		hiz_tile_min_ = vector<float>(tiles_x_ * tiles_y_);
+		hiz_tile_max_ = vector<float>(tiles_x_ * tiles_y_);
+		hiz_bin_max_ = vector<float>(bins_x_ * bins_y_);
+		ClearDepth();
+	}
+}
+
+FrameBuffer::~FrameBuffer()
+{
+	AlignedFree(data_);
+	if (depth_)
+		AlignedFree(depth_);
 }
 
 Color FrameBuffer::GetPixel(int x, int y) const
 {
-	assert(x < width_ && y < height_);
-	return pixel_colors_[x][y];
+	assert(x >= 0 && x < width_ && y >= 0 && y < height_);
+	const Byte *pixel = span(x, y);
+	switch (format_) {
+	case FORMAT_RGBA8:
+		return Color(pixel[0] / 255.0f, pixel[1] / 255.0f, pixel[2] / 255.0f, pixel[3] / 255.0f);
+	case FORMAT_BGRA8:
+		return Color(pixel[2] / 255.0f, pixel[1] / 255.0f, pixel[0] / 255.0f, pixel[3] / 255.0f);
+	default: {
+		const float *value = (const float*)pixel;
+		return Color(value[0], value[1], value[2], value[3]);
+	}
+	}
 }
 
 void FrameBuffer::SetPixel(int x, int y, Color color) 
 { 
-	assert(x < width_ && y < height_); 
-	pixel_colors_[x][y] = color; 
+	assert(x >= 0 && x < width_ && y >= 0 && y < height_); 
+	PackColor(color, span(x, y));
+}
+
+void FrameBuffer::PackColor(Color color, Byte* pixel) const
+{
+	switch (format_) {
+	case FORMAT_RGBA8:
+		pixel[0] = FloatToByte(color.r);
+		pixel[1] = FloatToByte(color.g);
+		pixel[2] = FloatToByte(color.b);
+		pixel[3] = FloatToByte(color.a);
+		break;
+	case FORMAT_BGRA8:
+		pixel[0] = FloatToByte(color.b);
+		pixel[1] = FloatToByte(color.g);
+		pixel[2] = FloatToByte(color.r);
+		pixel[3] = FloatToByte(color.a);
+		break;
+	default: {
+		float *value = (float*)pixel;
+		value[0] = color.r;
+		value[1] = color.g;
+		value[2] = color.b;
+		value[3] = color.a;
+		break;
+	}
+	}
+}
+
+void FrameBuffer::Clear(Color color)
+{
+	//pack the color once into the first row, then replicate that row
+	Byte *first = row(0);
+	for (int x = 0; x < width_; x++) {
+		PackColor(color, first + x * pixel_size_);
+	}
+	for (int y = 1; y < height_; y++) {
+		memcpy(row(y), first, (size_t)width_ * pixel_size_);
+	}
+}
+
+void FrameBuffer::ClearDepth(float depth)
+{
+	assert(depth_ != NULL);
+	depth = depth < 0 ? 0 : (depth > 1 ? 1 : depth);
+	if (depth_format_ == DEPTH_FLOAT32) {
+		float* first = (float*)depth_row(0);
+		for (int x = 0; x < width_; x++)
+			first[x] = depth;
+	}
+	else {
+		unsigned int* first = (unsigned int*)depth_row(0);
+		unsigned int value = (unsigned int)(depth * DEPTH_UNORM24_MAX + 0.5f);
+		for (int x = 0; x < width_; x++)
+			first[x] = value;
+		depth = value / DEPTH_UNORM24_MAX;
+	}
+	for (int y = 1; y < height_; y++)
+		memcpy(depth_row(y), depth_row(0), (size_t)width_ * 4);
+
+	std::fill(hiz_tile_min_.begin(), hiz_tile_min_.end(), depth);
+	std::fill(hiz_tile_max_.begin(), hiz_tile_max_.end(), depth);
+	std::fill(hiz_bin_max_.begin(), hiz_bin_max_.end(), depth);
 }
 
-Renderer::Renderer(/*const char *name, */int width, int height)
+float FrameBuffer::GetDepth(int x, int y) const
 {
-	framebuffer_ = new FrameBuffer(width, height);
+	assert(x >= 0 && x < width_);
+	const Byte* row = depth_row(y);
+	if (depth_format_ == DEPTH_FLOAT32)
+		return ((const float*)row)[x];
+	return ((const unsigned int*)row)[x] / DEPTH_UNORM24_MAX;
+}
+
+void FrameBuffer::UpdateHiZTile(int tx, int ty)
+{
+	int x0 = tx * TILE_SIZE, x1 = std::min(x0 + TILE_SIZE, width_);
+	int y0 = ty * TILE_SIZE, y1 = std::min(y0 + TILE_SIZE, height_);
+	float min_z, max_z;
+	if (depth_format_ == DEPTH_FLOAT32) {
+		min_z = 1, max_z = 0;
+		for (int y = y0; y < y1; y++) {
+			const float* row = (const float*)depth_row(y);
+			for (int x = x0; x < x1; x++) {
+				min_z = std::min(min_z, row[x]);
+				max_z = std::max(max_z, row[x]);
+			}
+		}
+	}
+	else {
+		unsigned int min_q = 0xFFFFFF, max_q = 0;
+		for (int y = y0; y < y1; y++) {
+			const unsigned int* row = (const unsigned int*)depth_row(y);
+			for (int x = x0; x < x1; x++) {
+				min_q = std::min(min_q, row[x]);
+				max_q = std::max(max_q, row[x]);
+			}
+		}
+		min_z = min_q / DEPTH_UNORM24_MAX;
+		max_z = max_q / DEPTH_UNORM24_MAX;
+	}
+	hiz_tile_min_[ty * tiles_x_ + tx] = min_z;
+	hiz_tile_max_[ty * tiles_x_ + tx] = max_z;
+}
+
+void FrameBuffer::UpdateHiZBin(int bx, int by)
+{
+	const int tiles_per_bin = BIN_SIZE / TILE_SIZE;
+	int tx0 = bx * tiles_per_bin, tx1 = std::min(tx0 + tiles_per_bin, tiles_x_);
+	int ty0 = by * tiles_per_bin, ty1 = std::min(ty0 + tiles_per_bin, tiles_y_);
+	float max_z = 0;
+	for (int ty = ty0; ty < ty1; ty++) {
+		for (int tx = tx0; tx < tx1; tx++)
+			max_z = std::max(max_z, hiz_tile_max_[ty * tiles_x_ + tx]);
+	}
+	hiz_bin_max_[by * bins_x_ + bx] = max_z;
+}
+
+Renderer::Renderer(/*const char *name, */int width, int height, PixelFormat format, int num_threads, DepthFormat depth_format)
+{
+	framebuffer_ = new FrameBuffer(width, height, format, depth_format);
 	render_target_ = NULL;
+	view_projection_ = Matrix4::Identity();
+	thread_pool_ = new ThreadPool(num_threads);
+	bins_ = new TileBins(width, height);
+	transformed_ = new PostTransformBuffer();
+	cull_mode_ = CULL_BACK;
+	scene_pipeline_ = new ShaderPipeline<BlinnPhongShader>(this);
+	shading_mode_ = SHADING_FORWARD;
+	gbuffer_ = NULL;
+	gbuffer_pipeline_ = NULL;
+	lighting_ = NULL;
+	worker_stats_ = vector<RasterStats>(thread_pool_->size());
+	ResetStats();
 }
 
 Renderer::~Renderer()
 {
+	delete lighting_;
+	delete gbuffer_pipeline_;
+	delete gbuffer_;
+	delete scene_pipeline_;
+	delete transformed_;
+	delete bins_;
+	delete thread_pool_;
 	delete framebuffer_;
 }
 
-void Renderer::Render() const
+void Renderer::Render()
 {
-	DrawLine(20, 30, 220, 220, Color::Cyan);
+	framebuffer_->Clear(Color::Black);
+	if (framebuffer_->has_depth())
+		framebuffer_->ClearDepth();
+
+	if (render_target_) {
+		DrawScene(*render_target_, view_projection_);
+	}
+	else {
+		//test pattern while no scene is set
+		DrawTriangle(Vector3f(300, 100, 0.5f), Vector3f(700, 200, 0.5f), Vector3f(450, 500, 0.5f), Color::Red, Color::Cyan, Color::White);
+		DrawLine(20, 30, 220, 220, Color::Cyan);
+	}
+	Flush();
 }
 
-static void rasterize_line(int x0, int y0, int x1, int y1, Color color, FrameBuffer* framebuffer)
+void Renderer::Flush()
 {
-	bool steep = false;
-	if (std::abs(x1 - x0) < std::abs(y1 - y0)) { //бʾֵ1ֱ y=x һԳƱ任ͼʱٻָ
-		std::swap(x0, y0);
-		std::swap(x1, y1);
-		steep = true;
+	if (triangles_.empty())
+		return;
+
+	{
+		ProfileScope scope(STAGE_BIN);
+		bins_->Clear();
+		for (int i = 0; i < (int)triangles_.size(); i++)
+			bins_->Insert(i, triangles_[i]);
 	}
-	if (x0 > x1) { //ȷ x0 < x1
-		std::swap(x0, x1);
-		std::swap(y0, y1);
+
+	ShadeTileFunc shade_tile = select_shade_tile();
+	RasterizeBins([this](int i) -> const TriangleGeometry& { return triangles_[i]; },
+		[this, shade_tile](int i, const PixelRect& rect, RasterStats* stats) {
+		return rasterize_triangle(triangles_[i], rect, shade_tile, framebuffer_, stats);
+	});
+	triangles_.clear();
+}
+
+void Renderer::set_shading_mode(ShadingMode mode)
+{
+	assert(mode == SHADING_FORWARD || framebuffer_->has_depth());
+	shading_mode_ = mode;
+	if (mode == SHADING_DEFERRED && gbuffer_ == NULL) {
+		gbuffer_ = new GBuffer(framebuffer_->width(), framebuffer_->height());
+		gbuffer_pipeline_ = new ShaderPipeline<GBufferShader>(this);
+		lighting_ = new DeferredLighting(framebuffer_->width(), framebuffer_->height());
 	}
+}
 
-	int deltaX = x1 - x0; //ֵ֤0
-	int deltaY = y1 - y0;
-	int deltaError = std::abs(deltaY) * 2;
-	int error = 0;
-	int y = y0;
+void Renderer::ResetStats()
+{
+	memset(&stats_, 0, sizeof(RasterStats));
+}
 
-	for (int x = x0; x <= x1; x++) {
-		if (steep)
-			framebuffer->SetPixel(y, x, color);
-		else
-			framebuffer->SetPixel(x, y, color);
+void Renderer::DrawLine(int x0, int y0, int x1, int y1, Color color)
+{
+	//pixel centers, so that the line runs between exactly these two pixels
+	LineSegment line = { x0 + 0.5f, y0 + 0.5f, x1 + 0.5f, y1 + 0.5f };
+	DrawLines(&line, 1, color);
+}
 
-		error += deltaError;
-		if (error > deltaX) {
-			y += (deltaY > 0 ? 1 : -1);
-			error -= 2 * deltaX;
-		}
+void Renderer::DrawLines(const LineSegment* lines, int count, Color color, bool antialias)
+{
+	Flush(); //keep drawing order with queued triangles
+	ProfileScope scope(STAGE_RASTER);
+	PixelRect frame = { 0, 0, framebuffer_->width() - 1, framebuffer_->height() - 1 };
+	if (thread_pool_->size() == 1 || count < LINE_PARALLEL_MIN) {
+		rasterize_lines(lines, count, color, antialias, frame, framebuffer_);
+		return;
 	}
+
+	//every worker draws all lines into its own band of rows, so lines keep their order within each pixel
+	int bands = thread_pool_->size() * 2;
+	int height = framebuffer_->height();
+	thread_pool_->ParallelFor(bands, [&](int band, int) {
+		PixelRect rect = frame;
+		rect.min_y = height * band / bands;
+		rect.max_y = height * (band + 1) / bands - 1;
+		if (rect.min_y <= rect.max_y)
+			rasterize_lines(lines, count, color, antialias, rect, framebuffer_);
+	});
 }
 
-static void rasterize_triangle()
+void Renderer::DrawTriangle(const Vector3f& v0, const Vector3f& v1, const Vector3f& v2, Color color)
 {
+	DrawTriangle(v0, v1, v2, color, color, color);
+}
 
+void Renderer::DrawTriangle(const Vector3f& v0, const Vector3f& v1, const Vector3f& v2, Color c0, Color c1, Color c2)
+{
+	TriangleSetup setup;
+	if (setup_triangle(v0, v1, v2, c0, c1, c2, framebuffer_, &setup))
+		triangles_.push_back(setup);
 }
 
-void Renderer::DrawLine(int x0, int y0, int x1, int y1, Color color) const
+void Renderer::DrawMesh(const Mesh& mesh, const Matrix4& mvp, Color color)
 {
-	rasterize_line(x0, y0, x1, y1, color, framebuffer_);
+	Viewport viewport = { framebuffer_->width(), framebuffer_->height() };
+	{
+		ProfileScope scope(STAGE_VERTEX);
+		transform_vertices(mesh.streams(), mvp, Matrix4::Identity(), viewport, transformed_);
+		clip_codes_.resize(mesh.vertex_num());
+		compute_clip_codes(*transformed_, clip_guard_band(viewport), clip_codes_.data());
+	}
+	AssembleTriangles(mesh, viewport, [this, color](int, const AssembledVertex& v0, const AssembledVertex& v1, const AssembledVertex& v2) {
+		DrawTriangle(v0.screen, v1.screen, v2.screen, color);
+	});
+}
+
+void Renderer::DrawScene(const Scene& scene, const Matrix4& view_projection)
+{
+	int culled;
+	{
+		ProfileScope scope(STAGE_VERTEX);
+		culled = scene.Cull(view_projection, &visible_models_, &cull_flags_);
+	}
+	stats_.culled_models += culled;
+	profile_count(COUNTER_CULLED_MODELS, culled);
+	if (visible_models_.empty())
+		return;
+
+	//the eye is the point that clip space w vanishes at, scenes without lights get a white one there
+	Vector3f eye(0, 0, 0);
+	Matrix4 inverse = view_projection;
+	if (inverse.Inverse()) {
+		Vector4f point = inverse * Vector4f(0, 0, 1, 0);
+		if (point.w != 0)
+			eye = Vector3f(point.x / point.w, point.y / point.w, point.z / point.w);
+	}
+	PointLight headlight = { eye, { 1.0f, 1.0f, 1.0f }, std::numeric_limits<float>::infinity() };
+	const PointLight* lights = scene.light_num() > 0 ? scene.lights() : &headlight;
+	int light_num = scene.light_num() > 0 ? scene.light_num() : 1;
+	if (shading_mode_ == SHADING_DEFERRED) {
+		DrawSceneDeferred(scene, view_projection, eye, lights, light_num);
+		return;
+	}
+
+	BlinnPhongShader shader;
+	shader.eye = eye;
+	shader.lights = lights;
+	shader.light_num = light_num;
+	for (size_t i = 0; i < visible_models_.size(); i++) {
+		const Model* model = scene.model(visible_models_[i]);
+		Color color = model->color();
+		shader.set_model(model->transform(), view_projection);
+		shader.diffuse[0] = color.r;
+		shader.diffuse[1] = color.g;
+		shader.diffuse[2] = color.b;
+		shader.material = scene.material(model->material());
+		scene_pipeline_->DrawMesh(*model->mesh(), shader);
+	}
 }
 
-void Renderer::DrawTriangle() const
+void Renderer::DrawSceneDeferred(const Scene& scene, const Matrix4& view_projection, const Vector3f& eye, const PointLight* lights, int light_num)
 {
+	//surfaces hidden by what was drawn before stay empty and keep their color
+	gbuffer_->Clear();
+	GBufferShader shader;
+	for (size_t i = 0; i < visible_models_.size(); i++) {
+		const Model* model = scene.model(visible_models_[i]);
+		Color color = model->color();
+		shader.set_model(model->transform(), view_projection);
+		shader.albedo[0] = color.r;
+		shader.albedo[1] = color.g;
+		shader.albedo[2] = color.b;
+		shader.material = model->material();
+		gbuffer_pipeline_->DrawMesh(*model->mesh(), shader, gbuffer_);
+	}
+	lighting_->Shade(*gbuffer_, lights, light_num, scene.materials(), view_projection, eye, framebuffer_, thread_pool_, &stats_);
+}
 
+int Renderer::PickModel(int x, int y, float* distance) const
+{
+	if (render_target_ == NULL)
+		return -1;
+	Matrix4 inverse = view_projection_;
+	if (!inverse.Inverse())
+		return -1;
+	//pixel center to ndc, then the points of the eye ray on the near and far planes back to world space
+	float ndc_x = (x + 0.5f) * 2.0f / framebuffer_->width() - 1.0f;
+	float ndc_y = (y + 0.5f) * 2.0f / framebuffer_->height() - 1.0f;
+	Vector4f near_point = inverse * Vector4f(ndc_x, ndc_y, -1.0f, 1.0f);
+	Vector4f far_point = inverse * Vector4f(ndc_x, ndc_y, 1.0f, 1.0f);
+	Vector3f origin(near_point.x / near_point.w, near_point.y / near_point.w, near_point.z / near_point.w);
+	Vector3f direction(far_point.x / far_point.w - origin.x, far_point.y / far_point.w - origin.y, far_point.z / far_point.w - origin.z);
+	float length = sqrtf(direction.x * direction.x + direction.y * direction.y + direction.z * direction.z);
+	if (!(length > 0))
+		return -1;
+	direction = Vector3f(direction.x / length, direction.y / length, direction.z / length);
+	return render_target_->Pick(origin, direction, distance);
 }
 
 void Renderer::KeyEventResponse(KeyCode key, bool pressed) const
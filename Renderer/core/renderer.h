@@ -2,55 +2,200 @@
 #define RENDERER_H
 
 #include <vector>
+#include <assert.h>
 #include "window.h"
+#include "geometry.h"
+#include "matrix.h"
+#include "rasterizer.h"
 
 class Color;
 class Scene;
+class ThreadPool;
+class Mesh;
+class Matrix4;
+class PostTransformBuffer;
+class BlinnPhongShader;
+class GBufferShader;
+class GBuffer;
+class DeferredLighting;
+struct PointLight;
+struct Viewport;
+struct AssembledVertex;
+template <typename Shader> class ShaderPipeline;
 
 using std::vector;
 
+typedef unsigned char Byte;
+//pixel layout of framebuffer, named by byte order in memory
+typedef enum { FORMAT_RGBA8 = 0, FORMAT_BGRA8, FORMAT_RGBA32F, FORMAT_NUM } PixelFormat;
+//depth plane layout, 4 bytes per pixel; 24-bit depth is an unsigned integer in the low bits
+typedef enum { DEPTH_NONE = 0, DEPTH_FLOAT32, DEPTH_UNORM24, DEPTH_NUM } DepthFormat;
+static const float DEPTH_UNORM24_MAX = 16777215.0f;
+//mesh triangles dropped by winding on screen (y up), counter-clockwise is the front
+typedef enum { CULL_NONE = 0, CULL_BACK, CULL_FRONT } CullMode;
+/*
+*  how DrawScene lights models: forward runs every light for every fragment drawn, deferred draws
+*  the surfaces into a GBuffer first and lights each visible pixel once, see deferred.h
+*/
+typedef enum { SHADING_FORWARD = 0, SHADING_DEFERRED } ShadingMode;
+
+//row-major color and depth planes kept in 64-byte aligned blocks, row 0 is the bottom of the frame
 class FrameBuffer
 {
 public:
-	FrameBuffer(int width, int height);
+	FrameBuffer(int width, int height, PixelFormat format = FORMAT_RGBA8, DepthFormat depth_format = DEPTH_NONE);
+	~FrameBuffer();
+
+	FrameBuffer(const FrameBuffer&) = delete;
+	FrameBuffer& operator=(const FrameBuffer&) = delete;
 
 	Color GetPixel(int x, int y) const;
 	void SetPixel(int x, int y, Color color);
+	void Clear(Color color);
+	//encode color into pixel_size() bytes of this framebuffer's format
+	void PackColor(Color color, Byte* pixel) const;
+
+	//depth in [0, 1], smaller is closer; cleared to the far plane by default
+	void ClearDepth(float depth = 1.0f);
+	float GetDepth(int x, int y) const;
+
+	//hierarchical z: depth range of every TILE_SIZE cell and farthest depth of every BIN_SIZE cell,
+	//a triangle entirely behind the farthest depth of a cell cannot pass the depth test there
+	float hiz_tile_min(int tx, int ty) const { return hiz_tile_min_[ty * tiles_x_ + tx]; }
+	float hiz_tile_max(int tx, int ty) const { return hiz_tile_max_[ty * tiles_x_ + tx]; }
+	float hiz_bin_max(int bx, int by) const { return hiz_bin_max_[by * bins_x_ + bx]; }
+	//recompute a tile cell from the depth plane / a bin cell from its tiles, after depth writes
+	void UpdateHiZTile(int tx, int ty);
+	void UpdateHiZBin(int bx, int by);
+
+	//first byte of row y, rows are pitch() bytes apart
+	Byte* row(int y) const { assert(y >= 0 && y < height_); return data_ + (size_t)y * pitch_; }
+	//contiguous run of (width - x) pixels starting at (x, y)
+	Byte* span(int x, int y) const { assert(x >= 0 && x < width_); return row(y) + x * pixel_size_; }
 
 	int width() const { return width_; }
 	int height() const { return height_; }
+	int pitch() const { return pitch_; }
+	int pixel_size() const { return pixel_size_; }
+	PixelFormat format() const { return format_; }
+	size_t data_size() const { return (size_t)pitch_ * height_; }
+	Byte* data() const { return data_; }
+
+	Byte* depth_row(int y) const { assert(depth_ && y >= 0 && y < height_); return depth_ + (size_t)y * depth_pitch_; }
+	DepthFormat depth_format() const { return depth_format_; }
+	bool has_depth() const { return depth_format_ != DEPTH_NONE; }
+
+	static int PixelSize(PixelFormat format) { return format == FORMAT_RGBA32F ? 16 : 4; }
 
 private:
 	int width_;
 	int height_;
-	vector< vector<Color>> pixel_colors_;
+	int pitch_;			//bytes per row, padded to keep every row 64-byte aligned
+	int pixel_size_;		//bytes per pixel
+	PixelFormat format_;
+	Byte* data_;
+
+	DepthFormat depth_format_;
+	int depth_pitch_;
+	Byte* depth_;			//NULL without depth plane
+	int tiles_x_, tiles_y_;
+	int bins_x_, bins_y_;
+	vector<float> hiz_tile_min_;
+	vector<float> hiz_tile_max_;
+	vector<float> hiz_bin_max_;
 };
 
 class Renderer
 {
 public:
-	Renderer(/*const char *name, */int width, int height);
+	//num_threads <= 0 renders with one thread per hardware core
+	Renderer(/*const char *name, */int width, int height, PixelFormat format = FORMAT_BGRA8, int num_threads = 0, DepthFormat depth_format = DEPTH_FLOAT32);
 	~Renderer();
 
-	void Render() const;
+	//clear, then draw the render target, or a test pattern while there is none
+	void Render();
+	//rasterize all queued triangles, bins are spread over the thread pool
+	void Flush();
 
 	//events response
 	void KeyEventResponse(KeyCode key, bool pressed) const;
 	void ButtonEventResponse(Button button, bool pressed) const;
 	void ScrollEventResponse(float offset) const;
 
-	//
-	void DrawLine(int x0, int y0, int x1, int y1, Color color) const;
-	void DrawTriangle() const;
+	//line between the centers of two pixels, clipped to the framebuffer
+	void DrawLine(int x0, int y0, int x1, int y1, Color color);
+	//batch of lines in screen space (pixels, origin at bottomLeft) drawn in order, see rasterize_lines;
+	//large batches are split into bands of rows over the thread pool
+	void DrawLines(const LineSegment* lines, int count, Color color, bool antialias = false);
+	//queue a triangle until the next Flush; vertices in screen space (pixels, origin at bottomLeft), either winding
+	void DrawTriangle(const Vector3f& v0, const Vector3f& v1, const Vector3f& v2, Color color);
+	//colors and depth (z in [0, 1]) are interpolated linearly in screen space
+	void DrawTriangle(const Vector3f& v0, const Vector3f& v1, const Vector3f& v2, Color c0, Color c1, Color c2);
+	//queue all faces of mesh, positions go through mvp into clip space; faces are clipped to the
+	//near and far planes and the guard band, see clipper.h, then culled by cull_mode()
+	void DrawMesh(const Mesh& mesh, const Matrix4& mvp, Color color);
+	/*
+	*  every model of scene inside the view frustum, view_projection maps world to clip space; models
+	*  are shaded per pixel with blinn-phong in their color and material, lit by the lights of the
+	*  scene or from the eye when it has none, see shading_mode()
+	*/
+	void DrawScene(const Scene& scene, const Matrix4& view_projection);
+	/*
+	*  model of render_target() under the center of pixel (x, y) (origin at bottomLeft) as seen through
+	*  view_projection(); returns its index and the distance along the eye ray, or -1 when there is none
+	*/
+	int PickModel(int x, int y, float* distance) const;
 
 	FrameBuffer* framebuffer() const { return framebuffer_; }
+	ThreadPool* thread_pool() const { return thread_pool_; }
+	//counters summed over all Flush calls since the last ResetStats
+	const RasterStats& stats() const { return stats_; }
+	void ResetStats();
+	Scene* render_target() const { return render_target_; }
 	void set_render_target(Scene* target) { render_target_ = target; }
+	//world to clip space, used by Render and PickModel for render_target()
+	const Matrix4& view_projection() const { return view_projection_; }
+	void set_view_projection(const Matrix4& view_projection) { view_projection_ = view_projection; }
+	CullMode cull_mode() const { return cull_mode_; }
+	void set_cull_mode(CullMode mode) { cull_mode_ = mode; }
+	ShadingMode shading_mode() const { return shading_mode_; }
+	//deferred shading needs a depth plane
+	void set_shading_mode(ShadingMode mode);
+	//surfaces of the last deferred DrawScene, NULL until deferred shading was first set
+	const GBuffer* gbuffer() const { return gbuffer_; }
 
 protected:
+	template <typename Shader> friend class ShaderPipeline;
 
+	//bin loop of Flush over the thread pool, see pipeline.h
+	template <typename Geometry, typename Rasterize>
+	void RasterizeBins(Geometry geometry, Rasterize rasterize);
+	//clip, cull and fan the faces of mesh after the vertex stage filled transformed_ and clip_codes_, see pipeline.h
+	template <typename Emit>
+	void AssembleTriangles(const Mesh& mesh, const Viewport& viewport, Emit emit);
+	//geometry and lighting pass of DrawScene in SHADING_DEFERRED, for the models in visible_models_
+	void DrawSceneDeferred(const Scene& scene, const Matrix4& view_projection, const Vector3f& eye, const PointLight* lights, int light_num);
 
 	FrameBuffer* framebuffer_;	 //data of one frame
 	Scene* render_target_;			//scene to render
+	Matrix4 view_projection_;
+
+	ThreadPool* thread_pool_;
+	vector<TriangleSetup> triangles_;	//queued triangles of current frame
+	TileBins* bins_;
+	PostTransformBuffer* transformed_;	//vertex stage output, reused by every DrawMesh
+	vector<unsigned short> clip_codes_;	//ClipCode of every vertex in transformed_
+	vector<int> visible_models_;		//scratch of DrawScene
+	vector<Byte> cull_flags_;			//scratch of DrawScene, see Scene::Cull
+	ShaderPipeline<BlinnPhongShader>* scene_pipeline_;	//of DrawScene
+	CullMode cull_mode_;
+	ShadingMode shading_mode_;
+	//deferred path, made by the first set_shading_mode(SHADING_DEFERRED)
+	GBuffer* gbuffer_;
+	ShaderPipeline<GBufferShader>* gbuffer_pipeline_;
+	DeferredLighting* lighting_;
+	vector<RasterStats> worker_stats_;	//one slot per worker, summed into stats_ after Flush
+	RasterStats stats_;
 };
 
 #endif
\ No newline at end of file
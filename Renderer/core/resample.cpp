@@ -0,0 +1,350 @@
+#include "resample.h"
+#include <assert.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include "thread_pool.h"
+#include "simd.h"
+
+using std::vector;
+
+//destination rows filtered by one task
+static const int RESAMPLE_BAND = 16;
+//float rows are padded so that a 4-wide load or store at the last pixel stays inside
+static const int ROW_PADDING = 4;
+
+static const float PI = 3.14159265358979f;
+
+static float filter_radius(ResampleFilter filter)
+{
+	switch (filter) {
+	case FILTER_BOX: return 0.5f;
+	case FILTER_BILINEAR: return 1.0f;
+	case FILTER_BICUBIC: return 2.0f;
+	case FILTER_LANCZOS3: return 3.0f;
+	default: assert(0); return 1.0f;
+	}
+}
+
+static float sinc(float x)
+{
+	if (x == 0)
+		return 1.0f;
+	x *= PI;
+	return sinf(x) / x;
+}
+
+static float filter_value(ResampleFilter filter, float x)
+{
+	x = fabsf(x);
+	switch (filter) {
+	case FILTER_BOX:
+		return x <= 0.5f ? 1.0f : 0.0f;
+	case FILTER_BILINEAR:
+		return x < 1.0f ? 1.0f - x : 0.0f;
+	case FILTER_BICUBIC: {
+		//catmull-rom, a = -0.5
+		const float a = -0.5f;
+		if (x < 1.0f)
+			return ((a + 2) * x - (a + 3)) * x * x + 1;
+		if (x < 2.0f)
+			return ((a * x - 5 * a) * x + 8 * a) * x - 4 * a;
+		return 0.0f;
+	}
+	case FILTER_LANCZOS3:
+		return x < 3.0f ? sinc(x) * sinc(x / 3.0f) : 0.0f;
+	default:
+		assert(0);
+		return 0.0f;
+	}
+}
+
+//taps of every destination pixel along one axis, weights sum to 1
+struct FilterWeights
+{
+	int max_taps;
+	vector<int> first;		//first source pixel
+	vector<int> count;		//number of source pixels
+	vector<float> weights;	//max_taps per destination pixel
+};
+
+static FilterWeights compute_weights(int src_size, int dst_size, ResampleFilter filter)
+{
+	float scale = (float)src_size / dst_size;
+	//widen the filter when shrinking so that it also acts as the low-pass
+	float filter_scale = std::max(scale, 1.0f);
+	float support = filter_radius(filter) * filter_scale;
+
+	FilterWeights result;
+	result.max_taps = (int)ceilf(support) * 2 + 1;
+	result.first.resize(dst_size);
+	result.count.resize(dst_size);
+	result.weights.assign((size_t)dst_size * result.max_taps, 0.0f);
+
+	for (int i = 0; i < dst_size; i++) {
+		//pixel centers are at half integers in both images
+		float center = (i + 0.5f) * scale;
+		int begin = std::max((int)floorf(center - support + 0.5f), 0);
+		int end = std::min((int)floorf(center + support + 0.5f), src_size);
+		end = std::max(end, begin + 1);
+		if (end - begin > result.max_taps)
+			end = begin + result.max_taps;
+		if (end > src_size) {
+			end = src_size;
+			begin = std::max(end - result.max_taps, 0);
+		}
+
+		float *weights = &result.weights[(size_t)i * result.max_taps];
+		float total = 0;
+		for (int j = begin; j < end; j++) {
+			weights[j - begin] = filter_value(filter, (j + 0.5f - center) / filter_scale);
+			total += weights[j - begin];
+		}
+		if (total != 0) {
+			for (int j = 0; j < end - begin; j++)
+				weights[j] /= total;
+		}
+		else {
+			//support narrower than a pixel, take the nearest one
+			begin = std::min((int)center, src_size - 1);
+			end = begin + 1;
+			weights[0] = 1.0f;
+		}
+		result.first[i] = begin;
+		result.count[i] = end - begin;
+	}
+	return result;
+}
+
+/*
+*  vertical pass first: every destination row is a weighted sum of a few source rows, converted
+*  to float on the fly, so shrinking never filters source rows that are averaged away anyway;
+*  the horizontal pass then only runs over destination rows
+*  all kernels add the taps in the same order, one separate multiply and add each, so the simd
+*  results equal the scalar ones; the simd horizontal kernels also run over the zero weights up
+*  to max_taps, which leaves the sums unchanged
+*/
+static void vertical_pass_scalar(const Byte* const* rows, const float* weights, int taps, int begin, int end, float* dst)
+{
+	for (int i = begin; i < end; i++) {
+		float sum = 0;
+		for (int k = 0; k < taps; k++)
+			sum = sum + weights[k] * (float)rows[k][i];
+		dst[i] = sum;
+	}
+}
+
+//interleaved channels: one pixel per pass of the channel loop
+static void horizontal_pass_scalar(const float* src, float* dst, int dst_width, int channels, const FilterWeights& fw)
+{
+	for (int x = 0; x < dst_width; x++) {
+		const float *weights = &fw.weights[(size_t)x * fw.max_taps];
+		const float *pixels = src + fw.first[x] * channels;
+		for (int c = 0; c < channels; c++) {
+			float sum = 0;
+			for (int k = 0; k < fw.count[x]; k++)
+				sum = sum + weights[k] * pixels[k * channels + c];
+			dst[x * channels + c] = sum;
+		}
+	}
+}
+
+static inline Byte round_to_byte(float value)
+{
+	value = value < 0 ? 0 : (value > 255.0f ? 255.0f : value);
+	return (Byte)(int)(value + 0.5f);
+}
+
+static void round_row_scalar(const float* src, int begin, int end, Byte* dst)
+{
+	for (int i = begin; i < end; i++)
+		dst[i] = round_to_byte(src[i]);
+}
+
+#if SIMD_X86
+static void vertical_pass_sse2(const Byte* const* rows, const float* weights, int taps, int begin, int end, float* dst)
+{
+	__m128i zero = _mm_setzero_si128();
+	int i = begin;
+	for (; i + 4 <= end; i += 4) {
+		__m128 sum = _mm_setzero_ps();
+		for (int k = 0; k < taps; k++) {
+			__m128i bytes = _mm_cvtsi32_si128(*(const int*)(rows[k] + i));
+			__m128 values = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(bytes, zero), zero));
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), values));
+		}
+		_mm_storeu_ps(dst + i, sum);
+	}
+	vertical_pass_scalar(rows, weights, taps, i, end, dst);
+}
+
+//one pixel per register, lanes past the channel count are overwritten by the next pixel
+static void horizontal_pass_sse2(const float* src, float* dst, int dst_width, int channels, const FilterWeights& fw)
+{
+	if (channels == 1) {
+		horizontal_pass_scalar(src, dst, dst_width, channels, fw);
+		return;
+	}
+	for (int x = 0; x < dst_width; x++) {
+		const float *weights = &fw.weights[(size_t)x * fw.max_taps];
+		const float *pixels = src + fw.first[x] * channels;
+		__m128 sum = _mm_setzero_ps();
+		for (int k = 0; k < fw.count[x]; k++)
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(pixels + k * channels)));
+		_mm_storeu_ps(dst + x * channels, sum);
+	}
+}
+
+static void round_row_sse2(const float* src, int begin, int end, Byte* dst)
+{
+	__m128 zero = _mm_setzero_ps(), max = _mm_set1_ps(255.0f), half = _mm_set1_ps(0.5f);
+	int i = begin;
+	for (; i + 4 <= end; i += 4) {
+		__m128 value = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), zero), max);
+		__m128i rounded = _mm_cvttps_epi32(_mm_add_ps(value, half));
+		rounded = _mm_packus_epi16(_mm_packs_epi32(rounded, rounded), rounded);
+		*(int*)(dst + i) = _mm_cvtsi128_si32(rounded);
+	}
+	round_row_scalar(src, i, end, dst);
+}
+
+SIMD_TARGET_AVX2
+static void vertical_pass_avx2(const Byte* const* rows, const float* weights, int taps, int begin, int end, float* dst)
+{
+	int i = begin;
+	for (; i + 8 <= end; i += 8) {
+		__m256 sum = _mm256_setzero_ps();
+		for (int k = 0; k < taps; k++) {
+			__m256 values = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(rows[k] + i))));
+			sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(weights[k]), values));
+		}
+		_mm256_storeu_ps(dst + i, sum);
+	}
+	vertical_pass_scalar(rows, weights, taps, i, end, dst);
+}
+
+//four channels: two pixels per register, each half with its own taps
+SIMD_TARGET_AVX2
+static void horizontal_pass_avx2(const float* src, float* dst, int dst_width, int channels, const FilterWeights& fw)
+{
+	if (channels != 4) {
+		horizontal_pass_sse2(src, dst, dst_width, channels, fw);
+		return;
+	}
+	int x = 0;
+	for (; x + 2 <= dst_width; x += 2) {
+		const float *weights0 = &fw.weights[(size_t)x * fw.max_taps];
+		const float *weights1 = weights0 + fw.max_taps;
+		const float *pixels0 = src + fw.first[x] * 4;
+		const float *pixels1 = src + fw.first[x + 1] * 4;
+		int taps = std::max(fw.count[x], fw.count[x + 1]);
+		__m256 sum = _mm256_setzero_ps();
+		for (int k = 0; k < taps; k++) {
+			__m256 weight = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(weights0[k])), _mm_set1_ps(weights1[k]), 1);
+			__m256 pixel = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(pixels0 + k * 4)), _mm_loadu_ps(pixels1 + k * 4), 1);
+			sum = _mm256_add_ps(sum, _mm256_mul_ps(weight, pixel));
+		}
+		_mm256_storeu_ps(dst + x * 4, sum);
+	}
+	for (; x < dst_width; x++) {
+		const float *weights = &fw.weights[(size_t)x * fw.max_taps];
+		const float *pixels = src + fw.first[x] * 4;
+		__m128 sum = _mm_setzero_ps();
+		for (int k = 0; k < fw.count[x]; k++)
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(pixels + k * 4)));
+		_mm_storeu_ps(dst + x * 4, sum);
+	}
+}
+
+SIMD_TARGET_AVX2
+static void round_row_avx2(const float* src, int begin, int end, Byte* dst)
+{
+	__m256 zero = _mm256_setzero_ps(), max = _mm256_set1_ps(255.0f), half = _mm256_set1_ps(0.5f);
+	int i = begin;
+	for (; i + 8 <= end; i += 8) {
+		__m256 value = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(src + i), zero), max);
+		__m256i rounded = _mm256_cvttps_epi32(_mm256_add_ps(value, half));
+		__m128i packed = _mm_packs_epi32(_mm256_castsi256_si128(rounded), _mm256_extracti128_si256(rounded, 1));
+		_mm_storel_epi64((__m128i*)(dst + i), _mm_packus_epi16(packed, packed));
+	}
+	round_row_scalar(src, i, end, dst);
+}
+#endif
+
+typedef void(*VerticalPassFunc)(const Byte* const* rows, const float* weights, int taps, int begin, int end, float* dst);
+typedef void(*HorizontalPassFunc)(const float* src, float* dst, int dst_width, int channels, const FilterWeights& fw);
+typedef void(*RoundRowFunc)(const float* src, int begin, int end, Byte* dst);
+
+//scratch rows of one worker
+struct ResampleScratch
+{
+	vector<const Byte*> taps;	//source rows of the current destination row
+	vector<float> column;		//vertically filtered row, source width
+	vector<float> row;			//horizontally filtered row, destination width
+};
+
+void resample_image(const ImageView& src, const ImageView& dst, ResampleFilter filter, ThreadPool* pool)
+{
+	assert(!src.empty() && !dst.empty() && src.channels == dst.channels);
+	assert(src.channels >= 1 && src.channels <= 4);
+	assert(filter >= 0 && filter < FILTER_NUM);
+
+	int channels = src.channels;
+	FilterWeights horizontal = compute_weights(src.width, dst.width, filter);
+	FilterWeights vertical = compute_weights(src.height, dst.height, filter);
+
+	VerticalPassFunc vertical_pass = vertical_pass_scalar;
+	HorizontalPassFunc horizontal_pass = horizontal_pass_scalar;
+	RoundRowFunc round_row = round_row_scalar;
+#if SIMD_X86
+	switch (simd_level()) {
+	case SIMD_AVX2: vertical_pass = vertical_pass_avx2; horizontal_pass = horizontal_pass_avx2; round_row = round_row_avx2; break;
+	case SIMD_SSE2: vertical_pass = vertical_pass_sse2; horizontal_pass = horizontal_pass_sse2; round_row = round_row_sse2; break;
+	default: break;
+	}
+#endif
+
+	//zero padding: room for the full max_taps window of the last pixel plus one 4-wide store
+	size_t column_size = (size_t)(src.width + horizontal.max_taps) * channels + ROW_PADDING;
+	size_t row_size = (size_t)dst.width * channels + ROW_PADDING;
+	int bands = (dst.height + RESAMPLE_BAND - 1) / RESAMPLE_BAND;
+	vector<ResampleScratch> scratch(pool ? pool->size() : 1);
+
+	auto resample_band = [&](int band, int worker) {
+		ResampleScratch& s = scratch[worker];
+		if (s.column.size() != column_size) {
+			s.taps.resize(vertical.max_taps);
+			s.column.assign(column_size, 0.0f);
+			s.row.assign(row_size, 0.0f);
+		}
+
+		int y1 = std::min((band + 1) * RESAMPLE_BAND, dst.height);
+		for (int y = band * RESAMPLE_BAND; y < y1; y++) {
+			int taps = vertical.count[y];
+			for (int k = 0; k < taps; k++)
+				s.taps[k] = src.row(vertical.first[y] + k);
+			vertical_pass(&s.taps[0], &vertical.weights[(size_t)y * vertical.max_taps], taps, 0, src.width * channels, &s.column[0]);
+			horizontal_pass(&s.column[0], &s.row[0], dst.width, channels, horizontal);
+			round_row(&s.row[0], 0, dst.width * channels, dst.row(y));
+		}
+	};
+
+	if (pool != NULL) {
+		pool->ParallelFor(bands, resample_band);
+	}
+	else {
+		for (int band = 0; band < bands; band++)
+			resample_band(band, 0);
+	}
+}
+
+const char *resample_filter_name(ResampleFilter filter)
+{
+	switch (filter) {
+	case FILTER_BOX: return "box";
+	case FILTER_BILINEAR: return "bilinear";
+	case FILTER_BICUBIC: return "bicubic";
+	case FILTER_LANCZOS3: return "lanczos3";
+	default: return "unknown";
+	}
+}
@@ -0,0 +1,20 @@
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+#include "image.h"
+
+class ThreadPool;
+
+/*
+*  separable resampling: every destination row is first filtered vertically from a few source rows
+*  into floats, then that row horizontally into the destination, so the horizontal pass only runs
+*  over destination rows; the taps and weights of every destination column and row are computed once,
+*  and when shrinking the filter is widened by the scale so that every source pixel contributes
+*  destination rows are processed in bands, spread over pool when one is given
+*  src and dst must have the same number of channels; scalar, SSE2 and AVX2 give identical bytes
+*/
+void resample_image(const ImageView& src, const ImageView& dst, ResampleFilter filter, ThreadPool* pool = NULL);
+
+const char *resample_filter_name(ResampleFilter filter);
+
+#endif
@@ -1 +1,178 @@
-#include "scene.h"
\ No newline at end of file
+#include "scene.h"
+#include <assert.h>
+#include <math.h>
+#include <algorithm>
+#include <limits>
+#include "model.h"
+#include "mesh.h"
+#include "matrix.h"
+#include "vertex_processor.h"
+
+Scene::Scene()
+{
+	bvhCost_ = 0;
+	bvhBuilt_ = false;
+	bvhMoved_ = false;
+	Material material = { 0.1f, 0.3f, 32.0f };
+	materials_.push_back(material);
+}
+
+Scene::~Scene()
+{
+	for (size_t i = 0; i < models_.size(); i++)
+		delete models_[i];
+}
+
+int Scene::AddModel(Model* model)
+{
+	assert(model != NULL);
+	models_.push_back(model);
+	sphereX_.push_back(0);
+	sphereY_.push_back(0);
+	sphereZ_.push_back(0);
+	sphereRadius_.push_back(0);
+	boxes_.push_back(BoundingBox());
+	UpdateBounds(model_num() - 1);
+	bvhBuilt_ = false;
+	return model_num() - 1;
+}
+
+void Scene::SetTransform(int i, const Matrix4& transform)
+{
+	assert(i >= 0 && i < model_num());
+	models_[i]->set_transform(transform);
+	UpdateBounds(i);
+	bvhMoved_ = true;
+}
+
+void Scene::SetMaterial(int i, int material)
+{
+	assert(i >= 0 && i < model_num());
+	assert(material >= 0 && material < material_num());
+	models_[i]->set_material(material);
+}
+
+int Scene::AddLight(const PointLight& light)
+{
+	assert(light.radius > 0);
+	lights_.push_back(light);
+	return light_num() - 1;
+}
+
+void Scene::SetLight(int i, const PointLight& light)
+{
+	assert(i >= 0 && i < light_num() && light.radius > 0);
+	lights_[i] = light;
+}
+
+int Scene::AddMaterial(const Material& material)
+{
+	assert(material_num() < SCENE_MAX_MATERIALS);
+	materials_.push_back(material);
+	return material_num() - 1;
+}
+
+void Scene::UpdateBounds(int i)
+{
+	const BoundingSphere& sphere = models_[i]->sphere();
+	sphereX_[i] = sphere.center.x;
+	sphereY_[i] = sphere.center.y;
+	sphereZ_[i] = sphere.center.z;
+	sphereRadius_[i] = sphere.radius;
+	boxes_[i] = models_[i]->bounds();
+}
+
+void Scene::UpdateHierarchy() const
+{
+	if (bvhBuilt_ && bvhMoved_) {
+		bvh_.Refit(boxes_.data());
+		bvhBuilt_ = bvh_.cost() <= bvhCost_ * SCENE_BVH_REBUILD_COST;
+	}
+	if (!bvhBuilt_) {
+		bvh_.Build(boxes_.data(), model_num());
+		bvhCost_ = bvh_.cost();
+		bvhBuilt_ = true;
+	}
+	bvhMoved_ = false;
+}
+
+int Scene::Cull(const Matrix4& view_projection, vector<int>* visible, vector<Byte>* flags) const
+{
+	visible->clear();
+	if (models_.empty())
+		return 0;
+	Frustum frustum = frustum_from_matrix(view_projection);
+	if (model_num() >= SCENE_BVH_MIN_MODELS) {
+		UpdateHierarchy();
+		bvh_.Cull(frustum, boxes_.data(), visible);
+		std::sort(visible->begin(), visible->end());
+		return model_num() - (int)visible->size();
+	}
+
+	flags->resize(models_.size());
+	cull_spheres(frustum, sphereX_.data(), sphereY_.data(), sphereZ_.data(), sphereRadius_.data(), model_num(), flags->data());
+	for (int i = 0; i < model_num(); i++) {
+		if ((*flags)[i] && box_in_frustum(frustum, boxes_[i]))
+			visible->push_back(i);
+	}
+	return model_num() - (int)visible->size();
+}
+
+//nearest t in (0, max_t) where the ray meets a triangle of mesh, max_t when there is none (Moller-Trumbore, both windings)
+static float ray_mesh_hit(const Mesh& mesh, const Vector3f& origin, const Vector3f& direction, float max_t)
+{
+	VertexStreams streams = mesh.streams();
+	for (int i = 0; i < mesh.face_num(); i++) {
+		const int *indices = mesh.face(i).indics();
+		float p[3][3];
+		for (int j = 0; j < 3; j++) {
+			for (int c = 0; c < 3; c++)
+				p[j][c] = streams.position[c][indices[j]];
+		}
+		float e1[3] = { p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2] };
+		float e2[3] = { p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2] };
+		float h[3] = { direction.y * e2[2] - direction.z * e2[1], direction.z * e2[0] - direction.x * e2[2], direction.x * e2[1] - direction.y * e2[0] };
+		float det = e1[0] * h[0] + e1[1] * h[1] + e1[2] * h[2];
+		if (fabsf(det) < 1e-12f)
+			continue;
+		float inv_det = 1.0f / det;
+		float s[3] = { origin.x - p[0][0], origin.y - p[0][1], origin.z - p[0][2] };
+		float u = (s[0] * h[0] + s[1] * h[1] + s[2] * h[2]) * inv_det;
+		if (u < 0 || u > 1)
+			continue;
+		float q[3] = { s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0] };
+		float v = (direction.x * q[0] + direction.y * q[1] + direction.z * q[2]) * inv_det;
+		if (v < 0 || u + v > 1)
+			continue;
+		float t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inv_det;
+		if (t > 0 && t < max_t)
+			max_t = t;
+	}
+	return max_t;
+}
+
+int Scene::Pick(const Vector3f& origin, const Vector3f& direction, float* distance) const
+{
+	UpdateHierarchy();
+	float inf = std::numeric_limits<float>::infinity();
+	int picked = -1;
+	float nearest = inf;
+	bvh_.Raycast(origin, direction, inf, boxes_.data(), [&](int i, float) {
+		//t carries over to model space as long as the direction is transformed without normalizing
+		const Model* model = models_[i];
+		Matrix4 to_model = model->transform();
+		if (!to_model.Inverse())
+			return inf;
+		Vector4f o = to_model * Vector4f(origin.x, origin.y, origin.z, 1.0f);
+		Vector4f d = to_model * Vector4f(direction.x, direction.y, direction.z, 0.0f);
+		float t = ray_mesh_hit(*model->mesh(), Vector3f(o.x, o.y, o.z), Vector3f(d.x, d.y, d.z), nearest);
+		if (t < nearest) {
+			nearest = t;
+			picked = i;
+		}
+		return t;
+	});
+	if (picked >= 0 && distance != NULL)
+		*distance = nearest;
+	return picked;
+}
@@ -2,22 +2,93 @@
 #define SCENE_H
 
 #include <vector>
+#include "bounds.h"
+#include "bvh.h"
+#include "light.h"
 
 class Model;
+class Matrix4;
 
 using std::vector;
 
+//below this many models Cull tests every sphere instead of walking the hierarchy
+static const int SCENE_BVH_MIN_MODELS = 64;
+//the hierarchy is built again once refits made it this much more expensive than when it was built
+static const float SCENE_BVH_REBUILD_COST = 1.5f;
+//material ids fit a byte of the g-buffer, with one value left for empty pixels
+static const int SCENE_MAX_MATERIALS = 255;
+
+/*
+*  models are owned by the scene; their bounding spheres are mirrored in arrays for the culling
+*  kernels and their boxes feed a bvh, which is built on first use after models were added and
+*  refit after models moved
+*  lights and materials are kept by value; material 0 always exists and is what models start with
+*/
 class Scene
 {
 public:
 	Scene();
 	~Scene();
 
+	Scene(const Scene&) = delete;
+	Scene& operator=(const Scene&) = delete;
+
+	//takes ownership, returns the index of the model
+	int AddModel(Model* model);
+	//move model i, its bounds follow
+	void SetTransform(int i, const Matrix4& transform);
+
+	int model_num() const { return (int)models_.size(); }
+	const Model* model(int i) const { return models_[i]; }
+	//give model i material, an index returned by AddMaterial (or 0)
+	void SetMaterial(int i, int material);
+
+	//returns the index of the light
+	int AddLight(const PointLight& light);
+	void SetLight(int i, const PointLight& light);
+	int light_num() const { return (int)lights_.size(); }
+	const PointLight& light(int i) const { return lights_[i]; }
+	//NULL without lights
+	const PointLight* lights() const { return lights_.empty() ? NULL : lights_.data(); }
+
+	//returns the material id, at most SCENE_MAX_MATERIALS materials
+	int AddMaterial(const Material& material);
+	int material_num() const { return (int)materials_.size(); }
+	const Material& material(int i) const { return materials_[i]; }
+	const Material* materials() const { return materials_.data(); }
+
+	/*
+	*  indices of the models inside the view frustum of view_projection (world to clip space), in
+	*  model order: small scenes test every sphere first and the boxes of the models they keep
+	*  second, larger ones walk the bvh and test boxes only; returns the number of models culled
+	*  flags is scratch for the sphere results, owned by the caller like visible
+	*/
+	int Cull(const Matrix4& view_projection, vector<int>* visible, vector<Byte>* flags) const;
+	/*
+	*  nearest model hit by the ray origin + t * direction (world space, t > 0), tested against the
+	*  triangles of its mesh; returns the model index and sets distance to t, or -1 when nothing is hit
+	*/
+	int Pick(const Vector3f& origin, const Vector3f& direction, float* distance) const;
+	//bvh over the model boxes, brought up to date first
+	const Bvh& hierarchy() const { UpdateHierarchy(); return bvh_; }
+
 private:
+	void UpdateBounds(int i);
+	//build or refit bvh_ when models were added or moved since the last call
+	void UpdateHierarchy() const;
+
 	vector<Model* > models_;
+	//world bounding spheres, one array per component
+	vector<float> sphereX_, sphereY_, sphereZ_, sphereRadius_;
+	vector<BoundingBox> boxes_;		//world boxes of the models
+	mutable Bvh bvh_;
+	mutable float bvhCost_;			//cost() right after the last Build
+	mutable bool bvhBuilt_;			//false after AddModel
+	mutable bool bvhMoved_;			//models moved since the last refit
+	vector<PointLight> lights_;
+	vector<Material> materials_;
 	//Color bgColor_;
 	//Model* skybox_;
-	//vector<Light* > lights_;
 	//Camera* camera_;
 };
 
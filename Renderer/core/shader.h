@@ -0,0 +1,246 @@
+#ifndef SHADER_H
+#define SHADER_H
+
+#include <stddef.h>
+#include <math.h>
+#include "geometry.h"
+#include "matrix.h"
+#include "vertex_processor.h"
+#include "light.h"
+#include "gbuffer.h"
+
+/*
+*  programmable shading: a shader is a plain class handed to ShaderPipeline (pipeline.h) as a
+*  template parameter, so both stages are inlined into a rasterizer instantiated for it and no
+*  pixel goes through a virtual call; a shader provides
+*
+*    struct Varyings { float ...; };
+*    Vector4f Vertex(const VertexStreams& input, int i, Varyings* output) const;
+*    Vector4f Fragment(const Varyings& input) const;
+*
+*  Varyings holds floats only (arrays of them are fine, Vector3f is not trivially copyable); the
+*  pipeline interpolates every one of them perspective correct across the triangle
+*  Vertex returns the clip space position of vertex i (opengl clip space, see Matrix4) and fills
+*  the varyings of that vertex; Fragment returns rgba in [0, 1], clamped when stored
+*  uniforms are members of the shader, set before the draw
+*  shaders for the deferred path (ShaderPipeline::DrawMesh into a GBuffer) describe the surface
+*  instead of shading it, with
+*
+*    void Surface(const Varyings& input, GBufferSample* output) const;
+*/
+
+static inline float shader_dot(const float a[3], const float b[3])
+{
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+//v / |v|, zero stays zero
+static inline void shader_normalize(float v[3])
+{
+	float length_sq = shader_dot(v, v);
+	float inv = length_sq > 0 ? 1.0f / sqrtf(length_sq) : 0.0f;
+	v[0] *= inv;
+	v[1] *= inv;
+	v[2] *= inv;
+}
+
+//position of vertex i through matrix, w = 1
+static inline Vector4f shader_transform_point(const Matrix4& matrix, const VertexStreams& input, int i)
+{
+	return matrix * Vector4f(input.position[0][i], input.position[1][i], input.position[2][i], 1.0f);
+}
+
+//normal of vertex i through the upper 3x3 of matrix, zero when the streams have none
+static inline Vector4f shader_transform_normal(const Matrix4& matrix, const VertexStreams& input, int i)
+{
+	if (input.normal[0] == NULL)
+		return Vector4f(0, 0, 0, 0);
+	return matrix * Vector4f(input.normal[0][i], input.normal[1][i], input.normal[2][i], 0.0f);
+}
+
+//inverse transpose of the upper 3x3 of model, for normals; identity when model is singular
+static inline Matrix4 shader_normal_matrix(const Matrix4& model)
+{
+	Matrix4 inverse = model;
+	if (!inverse.Inverse())
+		return Matrix4::Identity();
+	Matrix4 normal = inverse.Transpose();
+	for (int i = 0; i < 3; i++) {
+		normal(i, 3) = 0;
+		normal(3, i) = 0;
+	}
+	normal(3, 3) = 1;
+	return normal;
+}
+
+/*
+*  blinn-phong at a surface point: albedo * ambient, plus for every light that reaches the point
+*  light * falloff * (albedo * n.l + specular * max(n.h, 0)^shininess) where n.l > 0, with falloff
+*  (1 - d^2 / radius^2)^2 at distance d; normal and view (towards the eye) are unit vectors
+*/
+static inline void shade_point_lights(const float position[3], const float normal[3], const float view[3], const float albedo[3],
+	const Material& material, const PointLight* lights, int light_num, float color[3])
+{
+	for (int k = 0; k < 3; k++)
+		color[k] = albedo[k] * material.ambient;
+	for (int i = 0; i < light_num; i++) {
+		const PointLight& light = lights[i];
+		float l[3] = { light.position.x - position[0], light.position.y - position[1], light.position.z - position[2] };
+		float reach = shader_dot(l, l) / (light.radius * light.radius);
+		if (!(reach < 1.0f))
+			continue;
+		shader_normalize(l);
+		float n_dot_l = shader_dot(normal, l);
+		if (!(n_dot_l > 0))
+			continue;
+		float h[3] = { l[0] + view[0], l[1] + view[1], l[2] + view[2] };
+		shader_normalize(h);
+		float n_dot_h = shader_dot(normal, h);
+		float highlight = n_dot_h > 0 ? material.specular * powf(n_dot_h, material.shininess) : 0.0f;
+		float falloff = (1.0f - reach) * (1.0f - reach);
+		for (int k = 0; k < 3; k++)
+			color[k] += light.color[k] * falloff * (albedo[k] * n_dot_l + highlight);
+	}
+}
+
+//world space normals mapped to colors, for looking at geometry
+class NormalShader
+{
+public:
+	struct Varyings
+	{
+		float normal[3];
+	};
+
+	NormalShader() : mvp(Matrix4::Identity()), normal_matrix(Matrix4::Identity()) {}
+	void set_model(const Matrix4& model, const Matrix4& view_projection)
+	{
+		mvp = view_projection * model;
+		normal_matrix = shader_normal_matrix(model);
+	}
+
+	Vector4f Vertex(const VertexStreams& input, int i, Varyings* output) const
+	{
+		Vector4f normal = shader_transform_normal(normal_matrix, input, i);
+		output->normal[0] = normal.x;
+		output->normal[1] = normal.y;
+		output->normal[2] = normal.z;
+		return shader_transform_point(mvp, input, i);
+	}
+
+	Vector4f Fragment(const Varyings& input) const
+	{
+		float n[3] = { input.normal[0], input.normal[1], input.normal[2] };
+		shader_normalize(n);
+		return Vector4f(n[0] * 0.5f + 0.5f, n[1] * 0.5f + 0.5f, n[2] * 0.5f + 0.5f, 1.0f);
+	}
+
+	Matrix4 mvp;
+	Matrix4 normal_matrix;
+};
+
+//Blinn-Phong lighting per pixel with a list of point lights, see shade_point_lights
+class BlinnPhongShader
+{
+public:
+	struct Varyings
+	{
+		float position[3];	//world space
+		float normal[3];	//world space, not normalized
+	};
+
+	BlinnPhongShader()
+		: mvp(Matrix4::Identity()), model(Matrix4::Identity()), normal_matrix(Matrix4::Identity()),
+		eye(0, 0, 0), lights(NULL), light_num(0)
+	{
+		diffuse[0] = diffuse[1] = diffuse[2] = 1.0f;
+		material.ambient = 0.1f;
+		material.specular = 0.3f;
+		material.shininess = 32.0f;
+	}
+	void set_model(const Matrix4& model_matrix, const Matrix4& view_projection)
+	{
+		model = model_matrix;
+		mvp = view_projection * model_matrix;
+		normal_matrix = shader_normal_matrix(model_matrix);
+	}
+
+	Vector4f Vertex(const VertexStreams& input, int i, Varyings* output) const
+	{
+		Vector4f position = shader_transform_point(model, input, i);
+		Vector4f normal = shader_transform_normal(normal_matrix, input, i);
+		output->position[0] = position.x;
+		output->position[1] = position.y;
+		output->position[2] = position.z;
+		output->normal[0] = normal.x;
+		output->normal[1] = normal.y;
+		output->normal[2] = normal.z;
+		return shader_transform_point(mvp, input, i);
+	}
+
+	Vector4f Fragment(const Varyings& input) const
+	{
+		float n[3] = { input.normal[0], input.normal[1], input.normal[2] };
+		float v[3] = { eye.x - input.position[0], eye.y - input.position[1], eye.z - input.position[2] };
+		shader_normalize(n);
+		shader_normalize(v);
+		float color[3];
+		shade_point_lights(input.position, n, v, diffuse, material, lights, light_num, color);
+		return Vector4f(color[0], color[1], color[2], 1.0f);
+	}
+
+	Matrix4 mvp;
+	Matrix4 model;
+	Matrix4 normal_matrix;
+	Vector3f eye;				//world space camera position
+	const PointLight* lights;	//world space, not owned
+	int light_num;
+	float diffuse[3];			//rgb
+	Material material;
+};
+
+//surfaces of a model in one color and material for the g-buffer
+class GBufferShader
+{
+public:
+	struct Varyings
+	{
+		float normal[3];	//world space, not normalized
+	};
+
+	GBufferShader() : mvp(Matrix4::Identity()), normal_matrix(Matrix4::Identity()), material(0)
+	{
+		albedo[0] = albedo[1] = albedo[2] = 1.0f;
+	}
+	void set_model(const Matrix4& model, const Matrix4& view_projection)
+	{
+		mvp = view_projection * model;
+		normal_matrix = shader_normal_matrix(model);
+	}
+
+	Vector4f Vertex(const VertexStreams& input, int i, Varyings* output) const
+	{
+		Vector4f normal = shader_transform_normal(normal_matrix, input, i);
+		output->normal[0] = normal.x;
+		output->normal[1] = normal.y;
+		output->normal[2] = normal.z;
+		return shader_transform_point(mvp, input, i);
+	}
+
+	void Surface(const Varyings& input, GBufferSample* output) const
+	{
+		for (int k = 0; k < 3; k++) {
+			output->normal[k] = input.normal[k];
+			output->albedo[k] = albedo[k];
+		}
+		shader_normalize(output->normal);
+		output->material = material;
+	}
+
+	Matrix4 mvp;
+	Matrix4 normal_matrix;
+	float albedo[3];	//rgb
+	int material;		//id in the materials of the scene
+};
+
+#endif
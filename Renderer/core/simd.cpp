@@ -0,0 +1,67 @@
+#include "simd.h"
+#if SIMD_X86 && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#include <atomic>
+
+//SIMD_NUM until detected; atomic since every thread that runs a kernel reads it
+static std::atomic<int> current_level(SIMD_NUM);
+
+SimdLevel detect_simd_level()
+{
+#if SIMD_X86
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] >= 7) {
+		__cpuid(info, 1);
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+		//the os has to save ymm registers on context switch
+		bool ymm_enabled = osxsave && (_xgetbv(0) & 0x6) == 0x6;
+		__cpuidex(info, 7, 0);
+		bool avx2 = (info[1] & (1 << 5)) != 0;
+		if (avx && ymm_enabled && avx2)
+			return SIMD_AVX2;
+	}
+	return SIMD_SSE2;
+#else
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return SIMD_AVX2;
+	if (__builtin_cpu_supports("sse2"))
+		return SIMD_SSE2;
+	return SIMD_SCALAR;
+#endif
+#else
+	return SIMD_SCALAR;
+#endif
+}
+
+SimdLevel simd_level()
+{
+	int level = current_level.load(std::memory_order_relaxed);
+	if (level == SIMD_NUM) {
+		//racing first calls all detect the same level, a set_simd_level in between wins
+		int detected = detect_simd_level();
+		if (current_level.compare_exchange_strong(level, detected, std::memory_order_relaxed))
+			level = detected;
+	}
+	return (SimdLevel)level;
+}
+
+void set_simd_level(SimdLevel level)
+{
+	SimdLevel supported = detect_simd_level();
+	current_level.store(level < supported ? level : supported, std::memory_order_relaxed);
+}
+
+const char *simd_level_name(SimdLevel level)
+{
+	switch (level) {
+	case SIMD_SCALAR: return "scalar";
+	case SIMD_SSE2:   return "sse2";
+	case SIMD_AVX2:   return "avx2";
+	default:          return "unknown";
+	}
+}
@@ -0,0 +1,32 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+/*
+*  instruction set selection
+*  SSE2 is part of every x86-64 cpu, AVX2 kernels are compiled per function and only called
+*  after cpuid reports support, so the binary still runs on older machines
+*/
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SIMD_X86 1
+#include <immintrin.h>
+#else
+#define SIMD_X86 0
+#endif
+
+#if defined(_MSC_VER)
+#define SIMD_TARGET_AVX2
+#else
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+typedef enum { SIMD_SCALAR = 0, SIMD_SSE2, SIMD_AVX2, SIMD_NUM } SimdLevel;
+
+//best level supported by this cpu
+SimdLevel detect_simd_level();
+//level used by the kernels, defaults to detect_simd_level()
+SimdLevel simd_level();
+//force a lower level, e.g. to compare kernels; levels the cpu lacks are clamped
+void set_simd_level(SimdLevel level);
+const char *simd_level_name(SimdLevel level);
+
+#endif
@@ -0,0 +1,309 @@
+#include "texture.h"
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include "color.h"
+#include "utils.h"
+
+static const int TEXTURE_ALIGNMENT = 64;
+
+/*
+*  srgb transfer functions, decoding goes through a table of all 256 byte values
+*/
+static const float *srgb_to_linear_table()
+{
+	static float table[256];
+	static bool initialized = [] {
+		for (int i = 0; i < 256; i++) {
+			float value = i / 255.0f;
+			table[i] = value <= 0.04045f ? value / 12.92f : powf((value + 0.055f) / 1.055f, 2.4f);
+		}
+		return true;
+	}();
+	(void)initialized;
+	return table;
+}
+
+static Byte linear_to_srgb(float value)
+{
+	value = value <= 0.0031308f ? value * 12.92f : 1.055f * powf(value, 1.0f / 2.4f) - 0.055f;
+	return FloatToByte(value);
+}
+
+static int block_bits(TextureLayout layout)
+{
+	return layout == LAYOUT_TILED4 ? 2 : 3;
+}
+
+static int ceil_log2(int value)
+{
+	int bits = 0;
+	while ((1 << bits) < value)
+		bits++;
+	return bits;
+}
+
+//spread the low 16 bits of value to the even bits
+static inline unsigned spread_bits(unsigned value)
+{
+	value &= 0xFFFF;
+	value = (value | (value << 8)) & 0x00FF00FF;
+	value = (value | (value << 4)) & 0x0F0F0F0F;
+	value = (value | (value << 2)) & 0x33333333;
+	value = (value | (value << 1)) & 0x55555555;
+	return value;
+}
+
+Texture::Texture(const Image& image, bool srgb, WrapMode wrap, TextureLayout layout)
+{
+	assert(image.width() > 0 && image.height() > 0 && image.data() != NULL);
+	assert(layout >= 0 && layout < LAYOUT_NUM);
+	srgb_ = srgb;
+	wrap_ = wrap;
+	layout_ = layout;
+
+	//every level halves both sides down to 1 x 1
+	int width = image.width(), height = image.height();
+	size_t size = 0;
+	while (true) {
+		Level level = { width, height, size, 0, 0 };
+		size_t texels;
+		if (layout == LAYOUT_TILED4 || layout == LAYOUT_TILED8) {
+			int block = 1 << block_bits(layout);
+			level.blocks_x = (width + block - 1) / block;
+			texels = (size_t)level.blocks_x * ((height + block - 1) / block) * block * block;
+		}
+		else if (layout == LAYOUT_MORTON) {
+			int bits_x = ceil_log2(width), bits_y = ceil_log2(height);
+			level.morton_bits = std::min(bits_x, bits_y);
+			texels = (size_t)1 << (bits_x + bits_y);
+		}
+		else {
+			texels = (size_t)width * height;
+		}
+		levels_.push_back(level);
+		size += texels * 4;
+		if (width == 1 && height == 1)
+			break;
+		width = std::max(width / 2, 1);
+		height = std::max(height / 2, 1);
+	}
+	data_size_ = size;
+	data_ = (Byte*)AlignedMalloc(size, TEXTURE_ALIGNMENT);
+	memset(data_, 0, size);
+
+	//level 0 in rgba
+	int channels = image.channels();
+	for (int y = 0; y < image.height(); y++) {
+		for (int x = 0; x < image.width(); x++) {
+			const Byte *src = image.GetPixel(x, y);
+			Byte *dst = data_ + TexelOffset(levels_[0], x, y);
+			if (channels >= 3) {
+				dst[0] = src[2];
+				dst[1] = src[1];
+				dst[2] = src[0];
+				dst[3] = channels == 4 ? src[3] : 255;
+			}
+			else {
+				dst[0] = dst[1] = dst[2] = src[0];
+				dst[3] = channels == 2 ? src[1] : 255;
+			}
+		}
+	}
+	BuildMips();
+}
+
+Texture::~Texture()
+{
+	AlignedFree(data_);
+}
+
+//2 x 2 box filter of the level above, averaged in linear space for srgb textures
+void Texture::BuildMips()
+{
+	const float *to_linear = srgb_to_linear_table();
+	for (int i = 1; i < level_count(); i++) {
+		const Level& src = levels_[i - 1];
+		const Level& dst = levels_[i];
+		for (int y = 0; y < dst.height; y++) {
+			int y0 = std::min(y * 2, src.height - 1), y1 = std::min(y * 2 + 1, src.height - 1);
+			for (int x = 0; x < dst.width; x++) {
+				int x0 = std::min(x * 2, src.width - 1), x1 = std::min(x * 2 + 1, src.width - 1);
+				const Byte *texels[4] = { GetTexel(i - 1, x0, y0), GetTexel(i - 1, x1, y0), GetTexel(i - 1, x0, y1), GetTexel(i - 1, x1, y1) };
+				Byte *out = data_ + TexelOffset(dst, x, y);
+				for (int c = 0; c < 4; c++) {
+					if (srgb_ && c < 3) {
+						float sum = to_linear[texels[0][c]] + to_linear[texels[1][c]] + to_linear[texels[2][c]] + to_linear[texels[3][c]];
+						out[c] = linear_to_srgb(sum * 0.25f);
+					}
+					else {
+						out[c] = (Byte)((texels[0][c] + texels[1][c] + texels[2][c] + texels[3][c] + 2) / 4);
+					}
+				}
+			}
+		}
+	}
+}
+
+size_t Texture::TexelOffset(const Level& level, int x, int y) const
+{
+	size_t index;
+	switch (layout_) {
+	case LAYOUT_TILED4:
+	case LAYOUT_TILED8: {
+		int bits = block_bits(layout_), mask = (1 << bits) - 1;
+		size_t block = (size_t)(y >> bits) * level.blocks_x + (x >> bits);
+		index = (block << (2 * bits)) + ((y & mask) << bits) + (x & mask);
+		break;
+	}
+	case LAYOUT_MORTON: {
+		int bits = level.morton_bits;
+		unsigned low_mask = (1u << bits) - 1;
+		//past the shorter side only one coordinate has bits left, they go on top
+		index = spread_bits(x & low_mask) | (spread_bits(y & low_mask) << 1);
+		index |= (size_t)((x >> bits) | (y >> bits)) << (2 * bits);
+		break;
+	}
+	default:
+		index = (size_t)y * level.width + x;
+		break;
+	}
+	return level.offset + index * 4;
+}
+
+const Byte *Texture::GetTexel(int level, int x, int y) const
+{
+	const Level& l = levels_[level];
+	assert(x >= 0 && x < l.width && y >= 0 && y < l.height);
+	return data_ + TexelOffset(l, x, y);
+}
+
+//Sample keeps u and v in [0, 1], so coordinates are at most one texel outside the level
+static inline int wrap_coord(int value, int size, WrapMode wrap)
+{
+	if (wrap == WRAP_REPEAT)
+		return value < 0 ? value + size : (value >= size ? value - size : value);
+	return std::min(std::max(value, 0), size - 1);
+}
+
+void Texture::FetchTexel(int level, int x, int y, float texel[4]) const
+{
+	const Byte *rgba = data_ + TexelOffset(levels_[level], x, y);
+	if (srgb_) {
+		const float *to_linear = srgb_to_linear_table();
+		texel[0] = to_linear[rgba[0]];
+		texel[1] = to_linear[rgba[1]];
+		texel[2] = to_linear[rgba[2]];
+	}
+	else {
+		texel[0] = rgba[0] / 255.0f;
+		texel[1] = rgba[1] / 255.0f;
+		texel[2] = rgba[2] / 255.0f;
+	}
+	texel[3] = rgba[3] / 255.0f;
+}
+
+void Texture::SampleNearest(int level, float u, float v, float texel[4]) const
+{
+	const Level& l = levels_[level];
+	int x = wrap_coord((int)(u * l.width), l.width, wrap_);
+	int y = wrap_coord((int)(v * l.height), l.height, wrap_);
+	FetchTexel(level, x, y, texel);
+}
+
+void Texture::SampleBilinear(int level, float u, float v, float texel[4]) const
+{
+	const Level& l = levels_[level];
+	//texel centers sit at half integers
+	float x = u * l.width - 0.5f, y = v * l.height - 0.5f;
+	float fx = floorf(x), fy = floorf(y);
+	int x0 = (int)fx, y0 = (int)fy;
+	float tx = x - fx, ty = y - fy;
+
+	int x1 = wrap_coord(x0 + 1, l.width, wrap_), y1 = wrap_coord(y0 + 1, l.height, wrap_);
+	x0 = wrap_coord(x0, l.width, wrap_);
+	y0 = wrap_coord(y0, l.height, wrap_);
+
+	float t00[4], t10[4], t01[4], t11[4];
+	FetchTexel(level, x0, y0, t00);
+	FetchTexel(level, x1, y0, t10);
+	FetchTexel(level, x0, y1, t01);
+	FetchTexel(level, x1, y1, t11);
+	for (int c = 0; c < 4; c++) {
+		float bottom = Lerp(t00[c], t10[c], tx);
+		float top = Lerp(t01[c], t11[c], tx);
+		texel[c] = Lerp(bottom, top, ty);
+	}
+}
+
+float Texture::Lod(float dudx, float dvdx, float dudy, float dvdy) const
+{
+	//longer side of the pixel footprint, in texels of level 0
+	float w = (float)width(), h = (float)height();
+	float x_len = (dudx * w) * (dudx * w) + (dvdx * h) * (dvdx * h);
+	float y_len = (dudy * w) * (dudy * w) + (dvdy * h) * (dvdy * h);
+	float rho_squared = std::max(x_len, y_len);
+	if (rho_squared <= 0)
+		return 0.0f;
+	return 0.5f * log2f(rho_squared);
+}
+
+Color Texture::Sample(float u, float v, float lod, SampleFilter filter) const
+{
+	int last = level_count() - 1;
+	lod = std::min(std::max(lod, 0.0f), (float)last);
+	float texel[4];
+
+	//keep texel coordinates small enough for int
+	if (wrap_ == WRAP_REPEAT) {
+		u -= floorf(u);
+		v -= floorf(v);
+	}
+	else {
+		u = std::min(std::max(u, 0.0f), 1.0f);
+		v = std::min(std::max(v, 0.0f), 1.0f);
+	}
+
+	switch (filter) {
+	case SAMPLE_NEAREST:
+		SampleNearest((int)(lod + 0.5f), u, v, texel);
+		break;
+	case SAMPLE_BILINEAR:
+		SampleBilinear((int)(lod + 0.5f), u, v, texel);
+		break;
+	case SAMPLE_TRILINEAR: {
+		int level = (int)lod;
+		float t = lod - level;
+		SampleBilinear(level, u, v, texel);
+		if (t > 0 && level < last) {
+			float next[4];
+			SampleBilinear(level + 1, u, v, next);
+			for (int c = 0; c < 4; c++)
+				texel[c] = Lerp(texel[c], next[c], t);
+		}
+		break;
+	}
+	default:
+		assert(0);
+		texel[0] = texel[1] = texel[2] = texel[3] = 0;
+		break;
+	}
+	return Color(texel[0], texel[1], texel[2], texel[3]);
+}
+
+Color Texture::Sample(float u, float v, float dudx, float dvdx, float dudy, float dvdy, SampleFilter filter) const
+{
+	return Sample(u, v, Lod(dudx, dvdx, dudy, dvdy), filter);
+}
+
+const char *texture_layout_name(TextureLayout layout)
+{
+	switch (layout) {
+	case LAYOUT_LINEAR: return "linear";
+	case LAYOUT_TILED4: return "tiled4";
+	case LAYOUT_TILED8: return "tiled8";
+	case LAYOUT_MORTON: return "morton";
+	default: return "unknown";
+	}
+}
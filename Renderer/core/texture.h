@@ -2,19 +2,83 @@
 #define TEXTURE_H
 
 #include <vector>
+#include "image.h"
 
 class Color;
 
 using std::vector;
 
+//NEAREST and BILINEAR read the level closest to the lod, TRILINEAR blends the two around it
+typedef enum { SAMPLE_NEAREST = 0, SAMPLE_BILINEAR, SAMPLE_TRILINEAR, SAMPLE_NUM } SampleFilter;
+typedef enum { WRAP_REPEAT = 0, WRAP_CLAMP, WRAP_NUM } WrapMode;
+/*
+*  texel order inside a level: LINEAR is row by row; TILED4 and TILED8 store 4x4 or 8x8 blocks
+*  one after another (block rows are 16 or 32 bytes); MORTON interleaves the bits of x and y
+*  so that every aligned power-of-two square is contiguous
+*  blocked levels are padded to whole blocks, morton levels to power-of-two sides
+*/
+typedef enum { LAYOUT_LINEAR = 0, LAYOUT_TILED4, LAYOUT_TILED8, LAYOUT_MORTON, LAYOUT_NUM } TextureLayout;
+
+const char *texture_layout_name(TextureLayout layout);
+
+/*
+*  rgba8 texture with its full mip chain, all levels in one aligned block (level 0 first)
+*  color textures are srgb: levels are averaged in linear space and samples come back linear;
+*  data textures (normals, masks) pass srgb = false and are filtered as stored
+*  texture coordinates follow Image: (0, 0) is the bottomLeft corner, (1, 1) the topRight
+*/
 class Texture
 {
 public:
+	//image in tga channel order (gray, bgr or bgra), levels are built here
+	Texture(const Image& image, bool srgb = true, WrapMode wrap = WRAP_REPEAT, TextureLayout layout = LAYOUT_LINEAR);
+	~Texture();
+
+	Texture(const Texture&) = delete;
+	Texture& operator=(const Texture&) = delete;
+
+	//level of detail of a pixel footprint, from the screen-space derivatives of u and v
+	float Lod(float dudx, float dvdx, float dudy, float dvdy) const;
+	Color Sample(float u, float v, float lod, SampleFilter filter = SAMPLE_TRILINEAR) const;
+	Color Sample(float u, float v, float dudx, float dvdx, float dudy, float dvdy, SampleFilter filter = SAMPLE_TRILINEAR) const;
+
+	int width() const { return levels_[0].width; }
+	int height() const { return levels_[0].height; }
+	int level_count() const { return (int)levels_.size(); }
+	int level_width(int level) const { return levels_[level].width; }
+	int level_height(int level) const { return levels_[level].height; }
+	bool srgb() const { return srgb_; }
+	WrapMode wrap() const { return wrap_; }
+	TextureLayout layout() const { return layout_; }
+	//bytes of all levels, including layout padding
+	size_t data_size() const { return data_size_; }
+	//rgba texel of a level, x and y inside the level
+	const Byte *GetTexel(int level, int x, int y) const;
 
 private:
-	int width_;
-	int height_;
-	vector<vector<Color>> texData_;
+	struct Level
+	{
+		int width;
+		int height;
+		size_t offset;	//in bytes from data_
+		int blocks_x;	//blocks per block row (tiled)
+		int morton_bits;	//bits of x and y interleaved (morton), higher bits of the longer side follow
+	};
+
+	//bytes from data_ of texel (x, y) of level
+	size_t TexelOffset(const Level& level, int x, int y) const;
+	void BuildMips();
+	//texel as linear (srgb) or plain [0, 1] floats, x and y inside the level
+	void FetchTexel(int level, int x, int y, float texel[4]) const;
+	void SampleNearest(int level, float u, float v, float texel[4]) const;
+	void SampleBilinear(int level, float u, float v, float texel[4]) const;
+
+	vector<Level> levels_;
+	Byte *data_;
+	size_t data_size_;
+	bool srgb_;
+	WrapMode wrap_;
+	TextureLayout layout_;
 };
 
 #endif
@@ -0,0 +1,105 @@
+#include "thread_pool.h"
+#include <assert.h>
+#include <new>
+#include "utils.h"
+
+ThreadPool::ThreadPool(int num_threads)
+{
+	if (num_threads <= 0) {
+		num_threads = (int)std::thread::hardware_concurrency();
+		if (num_threads <= 0)
+			num_threads = 1;
+	}
+
+	generation_ = 0;
+	running_ = 0;
+	quit_ = false;
+	task_ = NULL;
+	shares_ = (Share*)AlignedMalloc(sizeof(Share) * num_threads, SHARE_ALIGNMENT);
+	for (int i = 0; i < num_threads; i++)
+		new (&shares_[i]) Share();
+	for (int i = 1; i < num_threads; i++)
+		threads_.push_back(std::thread(&ThreadPool::WorkerLoop, this, i));
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		quit_ = true;
+	}
+	start_cond_.notify_all();
+	for (size_t i = 0; i < threads_.size(); i++)
+		threads_[i].join();
+	for (int i = 0; i < size(); i++)
+		shares_[i].~Share();
+	AlignedFree(shares_);
+}
+
+void ThreadPool::ParallelFor(int count, const std::function<void(int index, int worker)>& task)
+{
+	if (count <= 0)
+		return;
+
+	int workers = size();
+	if (workers == 1 || count == 1) {
+		for (int i = 0; i < count; i++)
+			task(i, 0);
+		return;
+	}
+
+	for (int w = 0; w < workers; w++) {
+		shares_[w].next.store((int)((long long)count * w / workers), std::memory_order_relaxed);
+		shares_[w].end = (int)((long long)count * (w + 1) / workers);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		task_ = &task;
+		running_ = workers - 1;
+		generation_++;
+	}
+	start_cond_.notify_all();
+
+	RunShares(0);
+
+	std::unique_lock<std::mutex> lock(mutex_);
+	done_cond_.wait(lock, [this] { return running_ == 0; });
+	task_ = NULL;
+}
+
+void ThreadPool::RunShares(int worker)
+{
+	const std::function<void(int, int)>& task = *task_;
+	int workers = size();
+	//own share first, then steal from the others starting with the next worker
+	for (int k = 0; k < workers; k++) {
+		Share& share = shares_[(worker + k) % workers];
+		for (;;) {
+			int index = share.next.fetch_add(1, std::memory_order_relaxed);
+			if (index >= share.end)
+				break;
+			task(index, worker);
+		}
+	}
+}
+
+void ThreadPool::WorkerLoop(int worker)
+{
+	unsigned long long seen = 0;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			start_cond_.wait(lock, [&] { return quit_ || generation_ != seen; });
+			if (quit_)
+				return;
+			seen = generation_;
+		}
+
+		RunShares(worker);
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (--running_ == 0)
+			done_cond_.notify_one();
+	}
+}
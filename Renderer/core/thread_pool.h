@@ -0,0 +1,59 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+using std::vector;
+
+/*
+*  fixed set of worker threads for data-parallel loops
+*  every ParallelFor hands each worker a contiguous share of the indices; a worker that runs out
+*  steals single indices from the shares of the others, so uneven tasks still keep all cores busy
+*/
+class ThreadPool
+{
+public:
+	//num_threads <= 0 uses one thread per hardware core, the calling thread counts as one of them
+	explicit ThreadPool(int num_threads = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	//call task(index, worker) for every index in [0, count), returns when all calls are done
+	void ParallelFor(int count, const std::function<void(int index, int worker)>& task);
+
+	//number of workers, including the calling thread
+	int size() const { return (int)threads_.size() + 1; }
+
+private:
+	static const int SHARE_ALIGNMENT = 64;
+
+	//a cache line each so that workers claiming indices do not contend on the same line
+	struct alignas(SHARE_ALIGNMENT) Share
+	{
+		std::atomic<int> next;
+		int end;
+	};
+
+	void WorkerLoop(int worker);
+	void RunShares(int worker);
+
+	vector<std::thread> threads_;
+	Share* shares_;		//size() of them, from AlignedMalloc since new does not honor alignas before C++17
+
+	std::mutex mutex_;
+	std::condition_variable start_cond_;
+	std::condition_variable done_cond_;
+	unsigned long long generation_;	//bumped for every ParallelFor
+	int running_;					//workers still busy with the current generation
+	bool quit_;
+	const std::function<void(int, int)>* task_;
+};
+
+#endif
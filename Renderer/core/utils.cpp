@@ -1,6 +1,22 @@
 #include "utils.h"
 #include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
 #include <algorithm>
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 #include "image.h"
 #include "renderer.h"
 #include "color.h"
@@ -27,41 +43,185 @@ void WriteBytes(FILE *file, void *buffer, int size)
 	assert(count == size);
 }
 
-void LoadTGA(FILE *file, Image *image)
+void *AlignedMalloc(size_t size, size_t alignment)
+{
+	void *ptr;
+#ifdef _MSC_VER
+	ptr = _aligned_malloc(size, alignment);
+#else
+	if (posix_memalign(&ptr, alignment, size) != 0) {
+		ptr = NULL;
+	}
+#endif
+	assert(ptr != NULL);
+	return ptr;
+}
+
+void AlignedFree(void *ptr)
+{
+#ifdef _MSC_VER
+	_aligned_free(ptr);
+#else
+	free(ptr);
+#endif
+}
+
+MappedFile::MappedFile()
+{
+	data_ = NULL;
+	size_ = 0;
+	file_ = NULL;
+	mapping_ = NULL;
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::Open(const char *filePath)
+{
+	Close();
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filePath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size)) {
+		CloseHandle(file);
+		return false;
+	}
+	file_ = file;
+	size_ = (size_t)size.QuadPart;
+	if (size_ == 0)
+		return true;
+	mapping_ = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping_ != NULL)
+		data_ = (Byte*)MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+#else
+	int fd = open(filePath, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat info;
+	if (fstat(fd, &info) != 0) {
+		close(fd);
+		return false;
+	}
+	size_ = (size_t)info.st_size;
+	if (size_ == 0) {
+		close(fd);
+		return true;
+	}
+	void *data = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);	//the mapping keeps its own reference
+	if (data != MAP_FAILED) {
+		data_ = (Byte*)data;
+		//read front to back, let the kernel prefetch ahead
+		madvise(data, size_, MADV_SEQUENTIAL);
+	}
+#endif
+	if (data_ == NULL) {
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::Close()
+{
+#ifdef _WIN32
+	if (data_ != NULL)
+		UnmapViewOfFile(data_);
+	if (mapping_ != NULL)
+		CloseHandle((HANDLE)mapping_);
+	if (file_ != NULL)
+		CloseHandle((HANDLE)file_);
+#else
+	if (data_ != NULL)
+		munmap(data_, size_);
+#endif
+	data_ = NULL;
+	size_ = 0;
+	file_ = NULL;
+	mapping_ = NULL;
+}
+
+bool GetFileStamp(const char *filePath, unsigned long long *size, long long *time)
+{
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA info;
+	if (!GetFileAttributesExA(filePath, GetFileExInfoStandard, &info))
+		return false;
+	*size = ((unsigned long long)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+	*time = (long long)(((unsigned long long)info.ftLastWriteTime.dwHighDateTime << 32) | info.ftLastWriteTime.dwLowDateTime);
+#else
+	struct stat info;
+	if (stat(filePath, &info) != 0)
+		return false;
+	*size = (unsigned long long)info.st_size;
+	//with the sub-second part, an edit within the same second that keeps the size still changes the stamp
+#if defined(__APPLE__)
+	*time = (long long)info.st_mtimespec.tv_sec * 1000000000LL + info.st_mtimespec.tv_nsec;
+#else
+	*time = (long long)info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+#endif
+#endif
+	return true;
+}
+
+bool RenameFile(const char *from, const char *to)
+{
+#ifdef _WIN32
+	return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return rename(from, to) == 0;
+#endif
+}
+
+bool LoadTGA(const Byte *data, size_t size, Image *image)
 {
 	Byte *buffer = image->data();
-	int channels = image->channels();
-	int buffer_size = image->data_size();
-	int elem_count = 0;
-	while (elem_count < buffer_size) {
-		Byte header = ReadByte(file);
-		int rle_packet = header & 0x80;
-		int pixel_count = (header & 0x7F) + 1;
-		Byte pixel[4];
-		int i, j;
-		assert(elem_count + pixel_count * channels <= buffer_size);
-		if (rle_packet) {  /* rle packet */
-			for (j = 0; j < channels; j++) {
-				pixel[j] = ReadByte(file);
+	size_t channels = image->channels();
+	size_t buffer_size = image->data_size();
+	size_t elem_count = 0;
+	size_t read = 0;
+	while (elem_count < buffer_size && read < size) {
+		Byte header = data[read++];
+		size_t pixel_count = (header & 0x7F) + 1;
+		size_t run_size = pixel_count * channels;
+		if (run_size > buffer_size - elem_count)
+			return false;
+		Byte *dst = buffer + elem_count;
+		if (header & 0x80) {  /* rle packet */
+			if (channels > size - read)
+				return false;
+			if (channels == 1) {
+				memset(dst, data[read], run_size);
 			}
-			for (i = 0; i < pixel_count; i++) {
-				for (j = 0; j < channels; j++) {
-					buffer[elem_count++] = pixel[j];
+			else {
+				//one pixel, then keep doubling the part already written
+				size_t filled = min(channels, run_size);
+				memcpy(dst, data + read, filled);
+				while (filled < run_size) {
+					size_t count = min(filled, run_size - filled);
+					memcpy(dst + filled, dst, count);
+					filled += count;
 				}
 			}
+			read += channels;
 		}
 		else {           /* raw packet */
-			for (i = 0; i < pixel_count; i++) {
-				for (j = 0; j < channels; j++) {
-					buffer[elem_count++] = ReadByte(file);
-				}
-			}
+			if (run_size > size - read)
+				return false;
+			memcpy(dst, data + read, run_size);
+			read += run_size;
 		}
+		elem_count += run_size;
 	}
-	assert(elem_count == buffer_size);
+	return elem_count == buffer_size;
 }
 
-void SaveTGA(const Image *image, const char *filePath)
+void SaveTGA(const ImageView& image, const char *filePath)
 {
 	Byte header[TGA_HEADER_SIZE];
 	FILE *file;
@@ -70,15 +230,18 @@ void SaveTGA(const Image *image, const char *filePath)
 	assert(file != NULL);
 
 	memset(header, 0, TGA_HEADER_SIZE);
-	header[2] = image->channels() == 1 ? 3 : 2;     /* image type */
-	header[12] = image->width() & 0xFF;             /* width, lsb */
-	header[13] = (image->width() >> 8) & 0xFF;      /* width, msb */
-	header[14] = image->height() & 0xFF;            /* height, lsb */
-	header[15] = (image->height() >> 8) & 0xFF;     /* height, msb */
-	header[16] = (image->channels() * 8) & 0xFF;    /* image depth */
+	header[2] = image.channels == 1 ? 3 : 2;        /* image type */
+	header[12] = image.width & 0xFF;                /* width, lsb */
+	header[13] = (image.width >> 8) & 0xFF;         /* width, msb */
+	header[14] = image.height & 0xFF;               /* height, lsb */
+	header[15] = (image.height >> 8) & 0xFF;        /* height, msb */
+	header[16] = (image.channels * 8) & 0xFF;       /* image depth */
 	WriteBytes(file, header, TGA_HEADER_SIZE);
 
-	WriteBytes(file, image->data(), image->data_size());
+	int row_size = image.width * image.channels;
+	for (int row = 0; row < image.height; row++) {
+		WriteBytes(file, image.row(row), row_size);
+	}
 	fclose(file);
 }
 
@@ -86,85 +249,6 @@ void SaveTGA(const Image *image, const char *filePath)
 /* hdr format */
 
 
-/*
-*  blit image data
-*/
-void blit_image_bgr(Image *src, int buffer_width, int buffer_height, Byte* buffer)
-{
-	int width = min(src->width(), buffer_width);
-	int height = min(src->height(), buffer_height);
-	int row, col;
-
-	assert(width > 0 && height > 0);
-	assert(src->channels() >= 1 && src->channels() <= 4);
-
-	for (row = 0; row < height; row++) {
-		for (col = 0; col < width; col++) {
-			int flipped_row = src->height() - 1 - row;
-			Byte *src_pixel = src->GetPixel(col, flipped_row);
-			int dst_pixel_index = row * buffer_width * 4 + col * 4;
-			if (src->channels() == 3 || src->channels() == 4) {
-				buffer[dst_pixel_index + 0] = src_pixel[0];  /* blue */
-				buffer[dst_pixel_index + 1] = src_pixel[1];  /* green */
-				buffer[dst_pixel_index + 2] = src_pixel[2];  /* red */
-			}
-			else {
-				Byte gray = src_pixel[0];
-				buffer[dst_pixel_index + 0] = buffer[dst_pixel_index + 1] = buffer[dst_pixel_index + 2] = gray;
-			}
-		}
-	}
-}
-
-void blit_image_rgb(Image *src, int buffer_width, int buffer_height, Byte* buffer)
-{
-	int width = min(src->width(), buffer_width);
-	int height = min(src->height(), buffer_height);
-	int row, col;
-
-	assert(width > 0 && height > 0);
-	assert(src->channels() >= 1 && src->channels() <= 4);
-
-	for (row = 0; row < height; row++) {
-		for (col = 0; col < width; col++) {
-			int flipped_row = src->height() - 1 - row;
-			Byte *src_pixel = src->GetPixel(col, flipped_row);
-			int dst_pixel_index = row * buffer_width * 4 + col * 4;
-			if (src->channels() == 3 || src->channels() == 4) {
-				buffer[dst_pixel_index + 0] = src_pixel[2];  /* red */
-				buffer[dst_pixel_index + 1] = src_pixel[1];  /* green */
-				buffer[dst_pixel_index + 2] = src_pixel[0];  /* blue */
-			}
-			else {
-				Byte gray = src_pixel[0];
-				buffer[dst_pixel_index + 0] = buffer[dst_pixel_index + 1] = buffer[dst_pixel_index + 2] = gray;
-			}
-		}
-	}
-}
-
-void blit_frame_bgr(FrameBuffer* src, int buffer_width, int buffer_height, Byte* buffer)
-{
-	int width = min(src->width(), buffer_width);
-	int height = min(src->height(), buffer_height);
-	int row, col;
-
-	assert(width > 0 && height > 0);
-
-	for (row = 0; row < height; row++) {
-		for (col = 0; col < width; col++) {
-			//window origin is topLeft while frame and image are default as bottomLeft
-			int flipped_row = src->height() - 1 - row;
-			Color src_pixel = src->GetPixel(col, flipped_row);
-			int dst_pixel_index = row * buffer_width * 4 + col * 4;
-
-			buffer[dst_pixel_index + 0] = src_pixel.b * 255;  /* blue */
-			buffer[dst_pixel_index + 1] = src_pixel.g * 255;  /* green */
-			buffer[dst_pixel_index + 2] = src_pixel.r * 255;  /* red */
-		}
-	}
-}
-
 const char *GetExtension(const char *filename)
 {
 	const char *dot_pos = strrchr(filename, '.');
@@ -4,7 +4,7 @@
 #include <stdio.h>
 
 class Image;
-class FrameBuffer;
+struct ImageView;
 typedef unsigned char Byte;
 
 /*
@@ -15,17 +15,48 @@ void ReadBytes(FILE *file, void *buffer, int size);
 void WriteBytes(FILE *file, void *buffer, int size);
 
 /*
-*  load/save file of certain format
+*  read-only mapping of a whole file, pages are loaded by the os on first access
+*/
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	//returns false when the file cannot be opened or mapped; an empty file maps to size 0
+	bool Open(const char *filePath);
+	void Close();
+
+	const Byte *data() const { return data_; }
+	size_t size() const { return size_; }
+
+private:
+	Byte *data_;
+	size_t size_;
+	void *file_;		//win32 handles, unused elsewhere
+	void *mapping_;
+};
+
+//size in bytes and last modification time of a file (nanoseconds, 100 ns units on windows), false when it cannot be queried
+bool GetFileStamp(const char *filePath, unsigned long long *size, long long *time);
+//move from over to in one step, so that readers see either the old or the new file; false on failure
+bool RenameFile(const char *from, const char *to);
+
+/*
+*  aligned memory, released only by AlignedFree
 */
-void LoadTGA(FILE *file, Image *image);
-void SaveTGA(const Image *image, const char *filePath);
+void *AlignedMalloc(size_t size, size_t alignment);
+void AlignedFree(void *ptr);
 
 /*
-*  blit image data
+*  load/save file of certain format
 */
-void blit_image_bgr(Image *src, int buffer_width, int buffer_height, Byte* buffer);
-void blit_image_rgb(Image *src, int buffer_width, int buffer_height, Byte* buffer);
-void blit_frame_bgr(FrameBuffer* src, int buffer_width, int buffer_height, Byte* buffer);
+//decode run-length encoded pixels of size bytes into image, false when the data ends early or a run overflows the image
+bool LoadTGA(const Byte *data, size_t size, Image *image);
+void SaveTGA(const ImageView& image, const char *filePath);
 
 /*
 *  misc functions 
@@ -36,5 +67,11 @@ const char *GetExtension(const char *filename);
 *  math functions
 */
 float Lerp(float d0, float d1, float t);
+//clamp to [0, 1] and round to nearest 8-bit value
+inline Byte FloatToByte(float value)
+{
+	value = value < 0 ? 0 : (value > 1 ? 1 : value);
+	return (Byte)(value * 255 + 0.5f);
+}
 
 #endif
\ No newline at end of file
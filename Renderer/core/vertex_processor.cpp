@@ -0,0 +1,176 @@
+#include "vertex_processor.h"
+#include <assert.h>
+#include "utils.h"
+#include "simd.h"
+
+static const int STREAM_ALIGNMENT = 32;
+static const int STREAM_NUM = 11;	//clip 4, screen 4, normal 3
+
+PostTransformBuffer::PostTransformBuffer()
+{
+	count_ = 0;
+	capacity_ = 0;
+	storage_ = NULL;
+	for (int i = 0; i < 4; i++) {
+		clip_[i] = NULL;
+		screen_[i] = NULL;
+	}
+	for (int i = 0; i < 3; i++)
+		normal_[i] = NULL;
+}
+
+PostTransformBuffer::~PostTransformBuffer()
+{
+	AlignedFree(storage_);
+}
+
+void PostTransformBuffer::Resize(int count)
+{
+	assert(count >= 0);
+	count_ = count;
+	if (count <= capacity_)
+		return;
+
+	AlignedFree(storage_);
+	//every stream starts aligned and holds whole blocks
+	capacity_ = (count + VERTEX_BLOCK - 1) / VERTEX_BLOCK * VERTEX_BLOCK;
+	storage_ = (float*)AlignedMalloc((size_t)capacity_ * STREAM_NUM * sizeof(float), STREAM_ALIGNMENT);
+	float *stream = storage_;
+	for (int i = 0; i < 4; i++, stream += capacity_)
+		clip_[i] = stream;
+	for (int i = 0; i < 4; i++, stream += capacity_)
+		screen_[i] = stream;
+	for (int i = 0; i < 3; i++, stream += capacity_)
+		normal_[i] = stream;
+}
+
+/*
+*  constants of one transform_vertices call; every kernel evaluates
+*    clip = ((m0 * x + m1 * y) + m2 * z) + m3 per row, inv_w = 1 / clip.w,
+*    screen = (clip * inv_w) * scale + offset
+*  with separate multiplies and adds in this order, so all kernels agree to the last bit
+*/
+struct TransformConstants
+{
+	float mvp[4][4];	//[row][col]
+	float normal[3][3];	//[row][col]
+	float scale[3];
+	float offset[3];
+	bool has_normal;
+};
+
+static void transform_range_scalar(const VertexStreams& input, const TransformConstants& k, int begin, int end, PostTransformBuffer* output)
+{
+	const float *px = input.position[0], *py = input.position[1], *pz = input.position[2];
+	for (int i = begin; i < end; i++) {
+		float clip[4];
+		for (int row = 0; row < 4; row++)
+			clip[row] = k.mvp[row][0] * px[i] + k.mvp[row][1] * py[i] + k.mvp[row][2] * pz[i] + k.mvp[row][3];
+		float inv_w = 1.0f / clip[3];
+		for (int row = 0; row < 4; row++)
+			output->clip(row)[i] = clip[row];
+		for (int c = 0; c < 3; c++)
+			output->screen(c)[i] = clip[c] * inv_w * k.scale[c] + k.offset[c];
+		output->screen(3)[i] = inv_w;
+
+		if (k.has_normal) {
+			const float *nx = input.normal[0], *ny = input.normal[1], *nz = input.normal[2];
+			for (int row = 0; row < 3; row++)
+				output->normal(row)[i] = k.normal[row][0] * nx[i] + k.normal[row][1] * ny[i] + k.normal[row][2] * nz[i];
+		}
+	}
+}
+
+#if SIMD_X86
+static void transform_range_sse2(const VertexStreams& input, const TransformConstants& k, int begin, int end, PostTransformBuffer* output)
+{
+	const float *px = input.position[0], *py = input.position[1], *pz = input.position[2];
+	int i = begin;
+	for (; i + 4 <= end; i += 4) {
+		__m128 x = _mm_loadu_ps(px + i), y = _mm_loadu_ps(py + i), z = _mm_loadu_ps(pz + i);
+		__m128 clip[4];
+		for (int row = 0; row < 4; row++) {
+			__m128 value = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(k.mvp[row][0]), x), _mm_mul_ps(_mm_set1_ps(k.mvp[row][1]), y));
+			value = _mm_add_ps(value, _mm_mul_ps(_mm_set1_ps(k.mvp[row][2]), z));
+			clip[row] = _mm_add_ps(value, _mm_set1_ps(k.mvp[row][3]));
+			_mm_storeu_ps(output->clip(row) + i, clip[row]);
+		}
+		__m128 inv_w = _mm_div_ps(_mm_set1_ps(1.0f), clip[3]);
+		for (int c = 0; c < 3; c++) {
+			__m128 value = _mm_mul_ps(_mm_mul_ps(clip[c], inv_w), _mm_set1_ps(k.scale[c]));
+			_mm_storeu_ps(output->screen(c) + i, _mm_add_ps(value, _mm_set1_ps(k.offset[c])));
+		}
+		_mm_storeu_ps(output->screen(3) + i, inv_w);
+
+		if (k.has_normal) {
+			__m128 nx = _mm_loadu_ps(input.normal[0] + i), ny = _mm_loadu_ps(input.normal[1] + i), nz = _mm_loadu_ps(input.normal[2] + i);
+			for (int row = 0; row < 3; row++) {
+				__m128 value = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(k.normal[row][0]), nx), _mm_mul_ps(_mm_set1_ps(k.normal[row][1]), ny));
+				_mm_storeu_ps(output->normal(row) + i, _mm_add_ps(value, _mm_mul_ps(_mm_set1_ps(k.normal[row][2]), nz)));
+			}
+		}
+	}
+	transform_range_scalar(input, k, i, end, output);
+}
+
+SIMD_TARGET_AVX2
+static void transform_range_avx2(const VertexStreams& input, const TransformConstants& k, int begin, int end, PostTransformBuffer* output)
+{
+	const float *px = input.position[0], *py = input.position[1], *pz = input.position[2];
+	int i = begin;
+	for (; i + VERTEX_BLOCK <= end; i += VERTEX_BLOCK) {
+		__m256 x = _mm256_loadu_ps(px + i), y = _mm256_loadu_ps(py + i), z = _mm256_loadu_ps(pz + i);
+		__m256 clip[4];
+		for (int row = 0; row < 4; row++) {
+			__m256 value = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(k.mvp[row][0]), x), _mm256_mul_ps(_mm256_set1_ps(k.mvp[row][1]), y));
+			value = _mm256_add_ps(value, _mm256_mul_ps(_mm256_set1_ps(k.mvp[row][2]), z));
+			clip[row] = _mm256_add_ps(value, _mm256_set1_ps(k.mvp[row][3]));
+			_mm256_storeu_ps(output->clip(row) + i, clip[row]);
+		}
+		__m256 inv_w = _mm256_div_ps(_mm256_set1_ps(1.0f), clip[3]);
+		for (int c = 0; c < 3; c++) {
+			__m256 value = _mm256_mul_ps(_mm256_mul_ps(clip[c], inv_w), _mm256_set1_ps(k.scale[c]));
+			_mm256_storeu_ps(output->screen(c) + i, _mm256_add_ps(value, _mm256_set1_ps(k.offset[c])));
+		}
+		_mm256_storeu_ps(output->screen(3) + i, inv_w);
+
+		if (k.has_normal) {
+			__m256 nx = _mm256_loadu_ps(input.normal[0] + i), ny = _mm256_loadu_ps(input.normal[1] + i), nz = _mm256_loadu_ps(input.normal[2] + i);
+			for (int row = 0; row < 3; row++) {
+				__m256 value = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(k.normal[row][0]), nx), _mm256_mul_ps(_mm256_set1_ps(k.normal[row][1]), ny));
+				_mm256_storeu_ps(output->normal(row) + i, _mm256_add_ps(value, _mm256_mul_ps(_mm256_set1_ps(k.normal[row][2]), nz)));
+			}
+		}
+	}
+	transform_range_scalar(input, k, i, end, output);
+}
+#endif
+
+void transform_vertices(const VertexStreams& input, const Matrix4& mvp, const Matrix4& normal_matrix, const Viewport& viewport, PostTransformBuffer* output)
+{
+	assert(input.count >= 0 && input.position[0] && input.position[1] && input.position[2]);
+	assert(viewport.width > 0 && viewport.height > 0);
+
+	TransformConstants k;
+	for (int row = 0; row < 4; row++)
+		for (int col = 0; col < 4; col++)
+			k.mvp[row][col] = mvp(row, col);
+	for (int row = 0; row < 3; row++)
+		for (int col = 0; col < 3; col++)
+			k.normal[row][col] = normal_matrix(row, col);
+	//ndc [-1, 1] to [0, width] x [0, height] x [0, 1]
+	k.scale[0] = k.offset[0] = viewport.width * 0.5f;
+	k.scale[1] = k.offset[1] = viewport.height * 0.5f;
+	k.scale[2] = k.offset[2] = 0.5f;
+	k.has_normal = input.normal[0] && input.normal[1] && input.normal[2];
+
+	output->Resize(input.count);
+#if SIMD_X86
+	switch (simd_level()) {
+	case SIMD_AVX2: transform_range_avx2(input, k, 0, input.count, output); return;
+	case SIMD_SSE2: transform_range_sse2(input, k, 0, input.count, output); return;
+	default: break;
+	}
+#endif
+	transform_range_scalar(input, k, 0, input.count, output);
+}
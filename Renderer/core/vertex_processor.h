@@ -0,0 +1,71 @@
+#ifndef VERTEX_PROCESSOR_H
+#define VERTEX_PROCESSOR_H
+
+#include "matrix.h"
+
+/*
+*  vertex stage: positions are transformed VERTEX_BLOCK at a time out of structure-of-arrays
+*  streams, so one register holds the same component of 8 vertices (AVX2, or two SSE2 halves)
+*  and the perspective divide and viewport map happen in the same pass
+*/
+static const int VERTEX_BLOCK = 8;
+
+//one array per component, not owned; normal may be null, texcoords are not touched by this stage
+struct VertexStreams
+{
+	const float *position[3];	//x, y, z
+	const float *normal[3];		//x, y, z
+	const float *texcoord[2];	//u, v
+	int count;
+};
+
+//maps normalized device coordinates onto the framebuffer, origin at bottomLeft, z to [0, 1]
+struct Viewport
+{
+	int width, height;
+};
+
+/*
+*  output of the vertex stage, reused from frame to frame: streams only grow, so a mesh that
+*  was transformed once is transformed again without allocation
+*  screen coordinates are only meaningful for vertices with clip w > 0, the others have to be
+*  clipped first
+*/
+class PostTransformBuffer
+{
+public:
+	PostTransformBuffer();
+	~PostTransformBuffer();
+
+	PostTransformBuffer(const PostTransformBuffer&) = delete;
+	PostTransformBuffer& operator=(const PostTransformBuffer&) = delete;
+
+	//make room for count vertices, keeps nothing when it has to grow
+	void Resize(int count);
+
+	int count() const { return count_; }
+	//clip space x, y, z, w
+	float* clip(int component) const { assert(component >= 0 && component < 4); return clip_[component]; }
+	//framebuffer x, y in pixels, depth z in [0, 1], and 1 / clip w
+	float* screen(int component) const { assert(component >= 0 && component < 4); return screen_[component]; }
+	//transformed, not normalized
+	float* normal(int component) const { assert(component >= 0 && component < 3); return normal_[component]; }
+	Vector3f screen_position(int i) const { assert(i >= 0 && i < count_); return Vector3f(screen_[0][i], screen_[1][i], screen_[2][i]); }
+
+private:
+	int count_;
+	int capacity_;
+	float *clip_[4];
+	float *screen_[4];
+	float *normal_[3];
+	float *storage_;
+};
+
+/*
+*  transform all vertices of input by mvp and map them onto viewport; normals (when present) go
+*  through the upper 3x3 of normal_matrix, usually the inverse transpose of the model-view
+*  scalar, SSE2 and AVX2 versions write identical results
+*/
+void transform_vertices(const VertexStreams& input, const Matrix4& mvp, const Matrix4& normal_matrix, const Viewport& viewport, PostTransformBuffer* output);
+
+#endif
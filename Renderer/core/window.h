@@ -1,11 +1,12 @@
 #ifndef WINDOW_H
 #define WINDOW_H
 
-#include <Windows.h>
 #include <assert.h>
+#include <stddef.h>
 
 class Image;
 class FrameBuffer;
+class ThreadPool;
 class Window;
 
 typedef unsigned char Byte;
@@ -24,9 +25,9 @@ public:
 	Window(const char *title, int width, int height);
 	~Window();
 
-	// display function
-	void Display(Image* image) const;
-	void Display(FrameBuffer* framebuffer) const;
+	// display function, the conversion is spread over pool when one is given
+	void Display(Image* image, ThreadPool* pool = NULL) const;
+	void Display(FrameBuffer* framebuffer, ThreadPool* pool = NULL) const;
 
 	// monitor input message
 	void PollEvents() const;
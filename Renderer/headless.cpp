@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include "core/image.h"
+#include "core/mesh.h"
+#include "core/scene.h"
+#include "core/model.h"
+#include "core/matrix.h"
+#include "core/color.h"
+#include "core/renderer.h"
+#include "core/blit.h"
+#include "core/profiler.h"
+
+/*
+*  headless batch renderer: no window and no platform headers, runs Renderer::Render() for a
+*  number of frames and writes the framebuffer to a tga file
+*  usage: renderer_headless [-w width] [-h height] [-n frames] [-t threads] [-o output.tga] [-l input.tga]... [-m model.obj]... [-lights n] [-d] [-p] [-trace trace.json]
+*  an output path containing %d gets the frame index in place of its first %d and is written every frame,
+*  every -l loads an image and every -m a mesh first and reports the load throughput
+*  (parsed meshes also the vertex cache miss ratio before and after reordering); loaded meshes are
+*  placed side by side and rendered lit, see Renderer::DrawScene, from the eye or by -lights
+*  colored point lights scattered over them; -d shades them deferred instead of forward,
+*  -p prints the stage profile and -trace writes a chrome://tracing file of all frames
+*/
+
+static void PrintUsage(const char *name)
+{
+	printf("usage: %s [-w width] [-h height] [-n frames] [-t threads] [-o output.tga] [-l input.tga]... [-m model.obj]... [-lights n] [-d] [-p] [-trace trace.json]\n", name);
+}
+
+//meshes side by side along x in a scene with lights around them, returns a view projection that sees all of them
+static Matrix4 MakeMeshScene(const vector<Mesh*>& meshes, int lights, float aspect, Scene* scene)
+{
+	float offset = 0;
+	BoundingBox all;
+	all.min = Vector3f(0, 0, 0);
+	all.max = Vector3f(0, 0, 0);
+	for (size_t i = 0; i < meshes.size(); i++) {
+		Vector3f min = meshes[i]->bounds_min(), max = meshes[i]->bounds_max();
+		if (max.x < min.x)
+			continue;
+		Matrix4 transform = Matrix4::TranslateMatrix(offset - min.x, 0, 0);
+		scene->AddModel(new Model(meshes[i], transform, Color(0.8f, 0.8f, 0.8f, 1.0f)));
+		all.min = Vector3f(0, std::min(all.min.y, min.y), std::min(all.min.z, min.z));
+		all.max = Vector3f(offset + max.x - min.x, std::max(all.max.y, max.y), std::max(all.max.z, max.z));
+		offset = all.max.x + (max.x - min.x) * 0.1f;
+	}
+	BoundingSphere sphere = box_sphere(all);
+	float radius = std::max(sphere.radius, 1e-3f), fovy = 0.8f;
+	unsigned seed = 25;
+	auto unit = [&seed]() { seed = seed * 1664525u + 1013904223u; return (seed >> 16) / 65535.0f; };
+	for (int i = 0; i < lights; i++) {
+		Vector3f position(all.min.x + (all.max.x - all.min.x) * unit(), all.min.y + (all.max.y - all.min.y) * unit(),
+			all.max.z + radius * 0.1f - (all.max.z - all.min.z) * unit());
+		PointLight light = { position, { unit(), unit(), unit() }, radius * 0.5f };
+		scene->AddLight(light);
+	}
+	float distance = radius / sinf(fovy * 0.5f);
+	Vector3f eye(sphere.center.x, sphere.center.y + radius * 0.3f, sphere.center.z + distance);
+	return Matrix4::PerspectiveMatrix(fovy, aspect, distance * 0.05f, distance + radius * 2) *
+		Matrix4::LookAtMatrix(eye, sphere.center, Vector3f(0, 1, 0));
+}
+
+//output with its first %d replaced by frame; any other % is taken literally, output is never a format string
+static void FramePath(const char *output, int frame, char *path, size_t size)
+{
+	const char *field = strstr(output, "%d");
+	snprintf(path, size, "%.*s%d%s", (int)(field - output), output, frame, field + 2);
+}
+
+static void DeleteMeshes(vector<Mesh*>* meshes)
+{
+	for (size_t i = 0; i < meshes->size(); i++)
+		delete (*meshes)[i];
+	meshes->clear();
+}
+
+static void SaveFrame(Renderer *renderer, Image *image, const char *path)
+{
+	blit_frame_image(renderer->framebuffer(), image, renderer->thread_pool());
+	ProfileScope scope(STAGE_PRESENT);
+	image->SaveAsFile(path);
+}
+
+int main(int argc, char *argv[])
+{
+	int width = 800;
+	int height = 600;
+	int frames = 1;
+	int threads = 0;
+	const char *output = "frame.tga";
+	const char *trace = NULL;
+	bool profile = false;
+	bool deferred = false;
+	int lights = 0;
+	vector<Mesh*> meshes;
+
+	for (int i = 1; i < argc; i++) {
+		if (i + 1 < argc && strcmp(argv[i], "-w") == 0) {
+			width = atoi(argv[++i]);
+		}
+		else if (i + 1 < argc && strcmp(argv[i], "-h") == 0) {
+			height = atoi(argv[++i]);
+		}
+		else if (i + 1 < argc && strcmp(argv[i], "-n") == 0) {
+			frames = atoi(argv[++i]);
+		}
+		else if (i + 1 < argc && strcmp(argv[i], "-t") == 0) {
+			threads = atoi(argv[++i]);
+		}
+		else if (i + 1 < argc && strcmp(argv[i], "-o") == 0) {
+			output = argv[++i];
+		}
+		else if (i + 1 < argc && strcmp(argv[i], "-l") == 0) {
+			const char *input = argv[++i];
+			Image loaded;
+			ImageLoadStats stats = {};
+			if (!loaded.LoadFromFile(input, &stats)) {
+				printf("cannot load %s\n", input);
+				DeleteMeshes(&meshes);
+				return 1;
+			}
+			printf("loaded %s: %dx%dx%d, %.1f MB in %.3f ms, %.1f MB/s\n", input, loaded.width(), loaded.height(), loaded.channels(),
+				stats.file_size / (1024.0 * 1024.0), stats.seconds * 1000, stats.megabytes_per_second());
+		}
+		else if (i + 1 < argc && strcmp(argv[i], "-m") == 0) {
+			const char *input = argv[++i];
+			Mesh *mesh = new Mesh();
+			MeshLoadStats stats;
+			if (!mesh->LoadFromFile(input, &stats)) {
+				printf("cannot load %s\n", input);
+				delete mesh;
+				DeleteMeshes(&meshes);
+				return 1;
+			}
+			printf("loaded %s%s: %d vertices, %d triangles, %.1f MB in %.3f ms, %.1f MB/s\n", input, stats.cached ? " (cached)" : "",
+				stats.vertices, stats.faces, stats.file_size / (1024.0 * 1024.0), stats.seconds * 1000, stats.megabytes_per_second());
+			if (stats.optimized) {
+				printf("vertex cache order: acmr %.3f -> %.3f in %.3f ms\n", stats.optimize.acmr_before, stats.optimize.acmr_after,
+					stats.optimize.seconds * 1000);
+			}
+			meshes.push_back(mesh);
+		}
+		else if (i + 1 < argc && strcmp(argv[i], "-lights") == 0) {
+			lights = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-d") == 0) {
+			deferred = true;
+		}
+		else if (strcmp(argv[i], "-p") == 0) {
+			profile = true;
+		}
+		else if (i + 1 < argc && strcmp(argv[i], "-trace") == 0) {
+			trace = argv[++i];
+		}
+		else {
+			PrintUsage(argv[0]);
+			return 1;
+		}
+	}
+	if (width <= 0 || height <= 0 || width > RASTER_MAX_SIZE || height > RASTER_MAX_SIZE || frames <= 0 || lights < 0) {
+		PrintUsage(argv[0]);
+		return 1;
+	}
+
+	bool every_frame = strstr(output, "%d") != NULL;
+	Renderer* renderer = new Renderer(width, height, FORMAT_BGRA8, threads);
+	Image image(width, height, 4);
+	Scene scene;
+	if (!meshes.empty()) {
+		renderer->set_view_projection(MakeMeshScene(meshes, lights, (float)width / height, &scene));
+		renderer->set_render_target(&scene);
+	}
+	if (deferred)
+		renderer->set_shading_mode(SHADING_DEFERRED);
+	char path[1024];
+	double render_seconds = 0;
+
+	profiler_enable(profile || trace != NULL);
+	if (trace != NULL)
+		profiler_start_trace();
+
+	for (int frame = 0; frame < frames; frame++) {
+		profiler_begin_frame();
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		renderer->Render();
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+		render_seconds += std::chrono::duration<double>(end - start).count();
+
+		if (every_frame) {
+			FramePath(output, frame, path, sizeof(path));
+			SaveFrame(renderer, &image, path);
+		}
+		profiler_end_frame();
+	}
+	if (!every_frame) {
+		SaveFrame(renderer, &image, output);
+	}
+
+	printf("%d frames of %dx%d, total %.3f ms, average %.3f ms/frame\n",
+		frames, width, height, render_seconds * 1000, render_seconds * 1000 / frames);
+	if (profile)
+		profiler_print_report(stdout);
+	if (trace != NULL && !profiler_write_trace(trace))
+		printf("cannot write %s\n", trace);
+
+	delete renderer;
+	DeleteMeshes(&meshes);
+	return 0;
+}
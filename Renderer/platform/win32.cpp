@@ -1,9 +1,14 @@
 /**********************************************
 * https://github.com/zauonlok/renderer/blob/v1.2/renderer/platforms/win32.c
 ***********************************************/
-#include "../core/window.h"
+#include <Windows.h>
 #include <direct.h>
+#include "../core/window.h"
 #include "../core/utils.h"
+#include "../core/image.h"
+#include "../core/blit.h"
+#include "../core/renderer.h"
+#include "../core/profiler.h"
 
 
 static HWND handle_;
@@ -209,22 +214,26 @@ void Window::ResetBuffer() const
 
 void Window::SwapBuffer() const
 {
+	ProfileScope scope(STAGE_PRESENT);
 	HDC window_dc = GetDC(handle_);
 	BitBlt(window_dc, 0, 0, width_, height_, memory_dc_, 0, 0, SRCCOPY);
 	ReleaseDC(handle_, window_dc);
 }
 
-void Window::Display(Image *image) const
+void Window::Display(Image *image, ThreadPool* pool) const
 {
-	ResetBuffer();
-	blit_image_bgr(image, width_, height_, back_buffer_);
+	//the blit overwrites every pixel it covers, only a smaller image leaves old pixels behind
+	if (image->width() < width_ || image->height() < height_)
+		ResetBuffer();
+	blit_image_bgr(image->view(), width_, height_, back_buffer_, pool);
 	SwapBuffer();
 }
 
-void Window::Display(FrameBuffer* framebuffer) const
+void Window::Display(FrameBuffer* framebuffer, ThreadPool* pool) const
 {
-	ResetBuffer();
-	blit_frame_bgr(framebuffer, width_, height_, back_buffer_);
+	if (framebuffer->width() < width_ || framebuffer->height() < height_)
+		ResetBuffer();
+	blit_frame_bgr(framebuffer, width_, height_, back_buffer_, pool);
 	SwapBuffer();
 }
 
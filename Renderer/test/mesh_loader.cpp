@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include "core/mesh.h"
+
+/*
+*  obj parsing and the binary cache: a fixture with every face form, negative indices, invalid
+*  faces and no newline at the end is loaded twice, parsed and then mapped from the cache, and
+*  both have to give the same mesh; growing the obj afterwards has to bring the parser back
+*  exits non-zero when any check fails
+*/
+
+using std::vector;
+
+static const char *FIXTURE_PATH = "mesh_loader_fixture.obj";
+
+//14 distinct vertices and 7 triangles, see the comments
+static const char *FIXTURE =
+	"# unit square\n"
+	"v 0 0 0\n"
+	"v 1 0 0\n"
+	"v 1 1 0\n"
+	"v 0 1 0\n"
+	"vt 0 0\n"
+	"vt 1 0\n"
+	"vt 1 1\n"
+	"vt 0 1\n"
+	"vn 0 0 1\n"
+	"f 1 2 3\n"						//3 vertices, 1 face
+	"f 1/1 2/2 3/3 4/4\n"			//4 vertices, a fan of 2 faces
+	"f 1//1 3//1 4//1\n"			//3 vertices, 1 face
+	"f -4/-4/-1 -3/-3/-1 -2/-2/-1\n"	//3 vertices, 1 face
+	"f 1/1/1 2/2/1 3/3/1 # same\n"	//the vertices above again, 1 face
+	"f 1 2 9\n"						//position out of range, dropped
+	"f 1 0 2\n"						//no position 0, dropped
+	"f 1 2\n"						//no triangle
+	"\tf  2 3   4";					//1 vertex, 1 face
+static const int FIXTURE_VERTICES = 14;
+static const int FIXTURE_FACES = 7;
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+			failures++; \
+		} \
+	} while (0)
+
+static bool write_file(const char *path, const char *text)
+{
+	FILE *file = fopen(path, "wb");
+	if (file == NULL)
+		return false;
+	bool written = fwrite(text, 1, strlen(text), file) == strlen(text);
+	return fclose(file) == 0 && written;
+}
+
+//all streams and indices of mesh as bytes, to compare two loads
+static vector<unsigned char> mesh_bytes(const Mesh& mesh)
+{
+	vector<unsigned char> bytes;
+	VertexStreams streams = mesh.streams();
+	const float *arrays[] = { streams.position[0], streams.position[1], streams.position[2],
+		streams.texcoord[0], streams.texcoord[1], streams.normal[0], streams.normal[1], streams.normal[2] };
+	for (size_t i = 0; i < sizeof(arrays) / sizeof(arrays[0]); i++) {
+		const unsigned char *data = (const unsigned char*)arrays[i];
+		bytes.insert(bytes.end(), data, data + mesh.vertex_num() * sizeof(float));
+	}
+	for (int i = 0; i < mesh.face_num(); i++) {
+		const unsigned char *data = (const unsigned char*)mesh.face(i).indics();
+		bytes.insert(bytes.end(), data, data + 3 * sizeof(int));
+	}
+	return bytes;
+}
+
+static void check_fixture_mesh(const Mesh& mesh, int vertices, int faces)
+{
+	CHECK(mesh.vertex_num() == vertices);
+	CHECK(mesh.face_num() == faces);
+	for (int i = 0; i < mesh.face_num(); i++) {
+		const int *indices = mesh.face(i).indics();
+		for (int k = 0; k < 3; k++)
+			CHECK(indices[k] >= 0 && indices[k] < mesh.vertex_num());
+	}
+	//the square faces +z, with given normals and computed ones alike
+	for (int i = 0; i < mesh.vertex_num(); i++) {
+		Vertex vertex = mesh.vertex(i);
+		CHECK(vertex.position_.x >= 0 && vertex.position_.x <= 1 && vertex.position_.y >= 0 && vertex.position_.y <= 1 && vertex.position_.z == 0);
+		CHECK(fabsf(vertex.normal_.z - 1.0f) < 1e-5f);
+	}
+	CHECK(mesh.bounds_min().x == 0 && mesh.bounds_min().y == 0 && mesh.bounds_max().x == 1 && mesh.bounds_max().y == 1);
+}
+
+int main()
+{
+	std::string cache_path = std::string(FIXTURE_PATH) + ".mesh";
+	remove(cache_path.c_str());
+	if (!write_file(FIXTURE_PATH, FIXTURE)) {
+		printf("cannot write %s\n", FIXTURE_PATH);
+		return 1;
+	}
+
+	MeshLoadStats stats;
+	Mesh parsed;
+	CHECK(parsed.LoadFromFile(FIXTURE_PATH, &stats));
+	CHECK(!stats.cached && stats.optimized);
+	check_fixture_mesh(parsed, FIXTURE_VERTICES, FIXTURE_FACES);
+
+	Mesh cached;
+	CHECK(cached.LoadFromFile(FIXTURE_PATH, &stats));
+	CHECK(stats.cached && !stats.optimized && cached.mapped());
+	check_fixture_mesh(cached, FIXTURE_VERTICES, FIXTURE_FACES);
+	CHECK(mesh_bytes(cached) == mesh_bytes(parsed));
+
+	//a different source size makes the cache stale, the new face brings one new vertex
+	std::string grown = std::string(FIXTURE) + "\nf 4/4/1 1 3/3\n";
+	CHECK(write_file(FIXTURE_PATH, grown.c_str()));
+	Mesh reparsed;
+	CHECK(reparsed.LoadFromFile(FIXTURE_PATH, &stats));
+	CHECK(!stats.cached);
+	check_fixture_mesh(reparsed, FIXTURE_VERTICES + 1, FIXTURE_FACES + 1);
+
+	Mesh missing;
+	CHECK(!missing.LoadFromFile("mesh_loader_missing.obj"));
+
+	cached.Clear();
+	remove(FIXTURE_PATH);
+	remove(cache_path.c_str());
+	printf("%s\n", failures == 0 ? "all checks passed" : "checks failed");
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,327 @@
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+#include "core/renderer.h"
+#include "core/color.h"
+#include "core/simd.h"
+#include "core/blit.h"
+#include "core/bounds.h"
+#include "core/resample.h"
+#include "core/vertex_processor.h"
+
+/*
+*  every kernel that has simd versions has to produce the same bits at each level: the tile
+*  kernels draw one triangle set (flat and gradient, partly off screen, overlapping at many
+*  depths) into every pixel and depth format; row conversion, sphere culling, resampling and the
+*  vertex stage run on random input of odd sizes, so the scalar tails are covered as well
+*  source rows of the conversion end right before an inaccessible page, a kernel that reads past
+*  the row crashes the test
+*  exits non-zero on any difference; levels the cpu lacks are skipped
+*/
+
+using std::vector;
+
+static const int SIZE = 256;
+static const int TRIANGLE_NUM = 400;
+static const int MAX_BLIT_WIDTH = 79;
+static const int SPHERE_NUM = 1003;
+static const int VERTEX_NUM = 1001;
+
+class Random
+{
+public:
+	explicit Random(unsigned seed) : state_(seed) {}
+	unsigned Next() { state_ = state_ * 1664525u + 1013904223u; return state_ >> 8; }
+	float Unit() { return (Next() & 0xFFFF) / 65535.0f; }
+	float Range(float low, float high) { return low + Unit() * (high - low); }
+
+private:
+	unsigned state_;
+};
+
+//one page of memory followed by one that cannot be touched
+class GuardedPage
+{
+public:
+	GuardedPage()
+	{
+#ifdef _WIN32
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		size_ = info.dwPageSize;
+		base_ = (Byte*)VirtualAlloc(NULL, size_ * 2, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+		DWORD old_protect;
+		VirtualProtect(base_ + size_, size_, PAGE_NOACCESS, &old_protect);
+#else
+		size_ = (size_t)sysconf(_SC_PAGESIZE);
+		base_ = (Byte*)mmap(NULL, size_ * 2, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		mprotect(base_ + size_, size_, PROT_NONE);
+#endif
+	}
+	~GuardedPage()
+	{
+#ifdef _WIN32
+		VirtualFree(base_, 0, MEM_RELEASE);
+#else
+		munmap(base_, size_ * 2);
+#endif
+	}
+
+	GuardedPage(const GuardedPage&) = delete;
+	GuardedPage& operator=(const GuardedPage&) = delete;
+
+	//copy of size bytes of data that ends at the guard
+	const Byte* Place(const Byte* data, size_t size)
+	{
+		Byte* start = base_ + size_ - size;
+		memcpy(start, data, size);
+		return start;
+	}
+
+private:
+	Byte* base_;
+	size_t size_;
+};
+
+template <typename T>
+static void append_bytes(const T* data, size_t count, vector<Byte>* out)
+{
+	const Byte* bytes = (const Byte*)data;
+	out->insert(out->end(), bytes, bytes + count * sizeof(T));
+}
+
+//run(level, output) at every supported level, each output compared with the scalar one
+template <typename Run>
+static int compare_levels(const char *name, Run run)
+{
+	SimdLevel detected = detect_simd_level();
+	vector<Byte> reference;
+	set_simd_level(SIMD_SCALAR);
+	run(&reference);
+	int failures = 0;
+	for (int level = SIMD_SSE2; level < SIMD_NUM; level++) {
+		if (level > detected) {
+			printf("%s: %s not supported, skipped\n", name, simd_level_name((SimdLevel)level));
+			continue;
+		}
+		vector<Byte> output;
+		set_simd_level((SimdLevel)level);
+		run(&output);
+		bool same = output == reference;
+		printf("%s: %s %s\n", name, simd_level_name((SimdLevel)level), same ? "matches scalar" : "differs");
+		if (!same)
+			failures++;
+	}
+	set_simd_level(detected);
+	return failures;
+}
+
+/*
+*  tile kernels
+*/
+static void RenderTriangles(PixelFormat format, DepthFormat depth_format, vector<Byte>* planes)
+{
+	Renderer renderer(SIZE, SIZE, format, 1, depth_format);
+	FrameBuffer* framebuffer = renderer.framebuffer();
+	framebuffer->Clear(Color::Black);
+	if (framebuffer->has_depth())
+		framebuffer->ClearDepth();
+	Random random(4);
+	for (int i = 0; i < TRIANGLE_NUM; i++) {
+		Vector3f v[3];
+		float c[3][4];
+		for (int j = 0; j < 3; j++) {
+			v[j] = Vector3f(random.Unit() * (SIZE + 64) - 32, random.Unit() * (SIZE + 64) - 32, random.Unit());
+			for (int k = 0; k < 4; k++)
+				c[j][k] = random.Unit();
+		}
+		Color c0(c[0][0], c[0][1], c[0][2], c[0][3]), c1(c[1][0], c[1][1], c[1][2], c[1][3]), c2(c[2][0], c[2][1], c[2][2], c[2][3]);
+		if (i % 3 == 0)
+			renderer.DrawTriangle(v[0], v[1], v[2], c0);
+		else
+			renderer.DrawTriangle(v[0], v[1], v[2], c0, c1, c2);
+	}
+	renderer.Flush();
+
+	//color plane, then depth plane
+	for (int y = 0; y < SIZE; y++)
+		append_bytes(framebuffer->row(y), SIZE * framebuffer->pixel_size(), planes);
+	for (int y = 0; framebuffer->has_depth() && y < SIZE; y++)
+		append_bytes(framebuffer->depth_row(y), SIZE * 4, planes);
+}
+
+static int CompareTiles()
+{
+	const char *formats[] = { "rgba8", "bgra8", "rgba32f" };
+	const char *depth_formats[] = { "none", "float32", "unorm24" };
+	int failures = 0;
+	for (int format = 0; format < FORMAT_NUM; format++) {
+		for (int depth_format = 0; depth_format < DEPTH_NUM; depth_format++) {
+			char name[64];
+			snprintf(name, sizeof(name), "tiles %s/%s", formats[format], depth_formats[depth_format]);
+			failures += compare_levels(name, [&](vector<Byte>* out) {
+				RenderTriangles((PixelFormat)format, (DepthFormat)depth_format, out);
+			});
+		}
+	}
+	return failures;
+}
+
+/*
+*  row conversion, every width up to MAX_BLIT_WIDTH
+*/
+static int CompareBlit()
+{
+	const char *names[] = { "gray8", "gray_alpha8", "bgr8", "rgb8", "bgra8", "rgba8", "rgba32f" };
+	const int pixel_sizes[] = { 1, 2, 3, 3, 4, 4, 16 };
+	static const int SENTINEL = 16;
+	GuardedPage page;
+	int failures = 0;
+	for (int format = 0; format < BLIT_NUM; format++) {
+		int pixel_size = pixel_sizes[format];
+		Random random(format + 1);
+		vector<Byte> source(MAX_BLIT_WIDTH * pixel_size);
+		if (format == BLIT_RGBA32F) {
+			//out of range values too, they are clamped
+			float* values = (float*)source.data();
+			for (int i = 0; i < MAX_BLIT_WIDTH * 4; i++)
+				values[i] = random.Range(-0.25f, 1.25f);
+		}
+		else {
+			for (size_t i = 0; i < source.size(); i++)
+				source[i] = (Byte)random.Next();
+		}
+
+		char name[64];
+		snprintf(name, sizeof(name), "convert_row_bgra8 %s", names[format]);
+		failures += compare_levels(name, [&](vector<Byte>* out) {
+			for (int width = 1; width <= MAX_BLIT_WIDTH; width++) {
+				const Byte* src = page.Place(source.data(), (size_t)width * pixel_size);
+				//bytes past the row must stay untouched
+				vector<Byte> dst(width * 4 + SENTINEL, 0xCD);
+				convert_row_bgra8(src, (BlitFormat)format, width, dst.data());
+				append_bytes(dst.data(), dst.size(), out);
+			}
+		});
+	}
+	return failures;
+}
+
+/*
+*  sphere culling
+*/
+static int CompareSpheres()
+{
+	Random random(7);
+	vector<float> x(SPHERE_NUM), y(SPHERE_NUM), z(SPHERE_NUM), radius(SPHERE_NUM);
+	for (int i = 0; i < SPHERE_NUM; i++) {
+		x[i] = random.Range(-40.0f, 40.0f);
+		y[i] = random.Range(-40.0f, 40.0f);
+		z[i] = random.Range(-40.0f, 40.0f);
+		radius[i] = i % 5 == 0 ? 0.0f : random.Range(0.0f, 4.0f);
+	}
+	Matrix4 view_projection = Matrix4::PerspectiveMatrix(1.0f, 1.3f, 0.5f, 30.0f) *
+		Matrix4::LookAtMatrix(Vector3f(0, 0, 0), Vector3f(1, 0.2f, -1), Vector3f(0, 1, 0));
+	Frustum frustum = frustum_from_matrix(view_projection);
+
+	return compare_levels("cull_spheres", [&](vector<Byte>* out) {
+		//every count from a partial block up to all of them
+		for (int count = SPHERE_NUM - 17; count <= SPHERE_NUM; count++) {
+			vector<Byte> visible(count);
+			int culled = cull_spheres(frustum, x.data(), y.data(), z.data(), radius.data(), count, visible.data());
+			append_bytes(&culled, 1, out);
+			append_bytes(visible.data(), visible.size(), out);
+		}
+	});
+}
+
+/*
+*  resampling, shrinking and growing with every filter and channel count
+*/
+static int CompareResample()
+{
+	static const int SRC_WIDTH = 37, SRC_HEIGHT = 29;
+	const int sizes[][2] = { { 13, 11 }, { 71, 53 }, { 37, 5 }, { 1, 1 } };
+	int failures = 0;
+	for (int channels = 1; channels <= 4; channels++) {
+		Random random(channels);
+		vector<Byte> source(SRC_WIDTH * SRC_HEIGHT * channels);
+		for (size_t i = 0; i < source.size(); i++)
+			source[i] = (Byte)random.Next();
+		ImageView src(SRC_WIDTH, SRC_HEIGHT, channels, source.data());
+
+		for (int filter = 0; filter < FILTER_NUM; filter++) {
+			char name[64];
+			snprintf(name, sizeof(name), "resample_image %s/%d", resample_filter_name((ResampleFilter)filter), channels);
+			failures += compare_levels(name, [&](vector<Byte>* out) {
+				for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+					vector<Byte> pixels(sizes[i][0] * sizes[i][1] * channels);
+					resample_image(src, ImageView(sizes[i][0], sizes[i][1], channels, pixels.data()), (ResampleFilter)filter);
+					append_bytes(pixels.data(), pixels.size(), out);
+				}
+			});
+		}
+	}
+	return failures;
+}
+
+/*
+*  vertex stage, with vertices behind the eye as well
+*/
+static int CompareVertices()
+{
+	Random random(11);
+	vector<float> streams[6];
+	for (int c = 0; c < 6; c++) {
+		streams[c].resize(VERTEX_NUM);
+		for (int i = 0; i < VERTEX_NUM; i++)
+			streams[c][i] = c < 3 ? random.Range(-10.0f, 10.0f) : random.Range(-1.0f, 1.0f);
+	}
+	Matrix4 mvp = Matrix4::PerspectiveMatrix(1.0f, 1.3f, 0.5f, 30.0f) *
+		Matrix4::LookAtMatrix(Vector3f(0, 0, 12), Vector3f(0, 0, 0), Vector3f(0, 1, 0));
+	Matrix4 normal_matrix = Matrix4::RotateMatrix(Vector3f(1, 1, 0), 0.7f);
+	Viewport viewport = { 640, 480 };
+
+	int failures = 0;
+	for (int with_normals = 0; with_normals < 2; with_normals++) {
+		VertexStreams input;
+		memset(&input, 0, sizeof(input));
+		for (int c = 0; c < 3; c++) {
+			input.position[c] = streams[c].data();
+			input.normal[c] = with_normals ? streams[3 + c].data() : NULL;
+		}
+		failures += compare_levels(with_normals ? "transform_vertices normals" : "transform_vertices", [&](vector<Byte>* out) {
+			PostTransformBuffer output;
+			//every count from a partial block up to all of them
+			for (int count = VERTEX_NUM - VERTEX_BLOCK * 2; count <= VERTEX_NUM; count++) {
+				input.count = count;
+				transform_vertices(input, mvp, normal_matrix, viewport, &output);
+				for (int c = 0; c < 4; c++) {
+					append_bytes(output.clip(c), count, out);
+					append_bytes(output.screen(c), count, out);
+				}
+				for (int c = 0; c < 3 && with_normals; c++)
+					append_bytes(output.normal(c), count, out);
+			}
+		});
+	}
+	return failures;
+}
+
+int main()
+{
+	int failures = CompareTiles();
+	failures += CompareBlit();
+	failures += CompareSpheres();
+	failures += CompareResample();
+	failures += CompareVertices();
+	return failures == 0 ? 0 : 1;
+}